@@ -63,7 +63,7 @@ pub fn build(b: *std.Build) void {
             "vendor/lite3/src/json_enc.c",
             "vendor/lite3/src/json_dec.c",
             "vendor/lite3/lib/yyjson/yyjson.c",
-            "vendor/lite3/lib/nibble_base64/base64.c",
+            "src/lite3_base64.c",
         };
         for (json_sources) |src| {
             lite3_mod.addCSourceFile(.{
@@ -163,6 +163,7 @@ pub fn build(b: *std.Build) void {
     });
 
     const run_bench = b.addRunArtifact(bench_exe);
+    if (b.args) |args| run_bench.addArgs(args);
     const bench_step = b.step("bench", "Run lite3-zig benchmarks");
     bench_step.dependOn(&run_bench.step);
 
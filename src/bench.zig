@@ -1,9 +1,13 @@
 //! Benchmark suite for lite3-zig
 //!
 //! Run with: zig build bench
-//! Results show min/median/max nanoseconds per operation across multiple trials.
+//! Results show min/median/max nanoseconds per operation across multiple trials,
+//! latency percentiles where operations are timed individually, and hardware
+//! counters where available. `--json` writes the results to stdout and
+//! `--compare baseline.json` checks them against an earlier run.
 
 const std = @import("std");
+const builtin = @import("builtin");
 const lite3 = @import("lite3");
 
 const Timer = std.time.Timer;
@@ -18,18 +22,404 @@ fn nsPerOp(count: u64, elapsed_ns: u64) f64 {
     return @as(f64, @floatFromInt(elapsed_ns)) / @as(f64, @floatFromInt(count));
 }
 
+// ---------------------------------------------------------------------------
+// Hardware counters
+//
+// Linux perf_event_open counters, read around every timed trial and printed
+// per operation under each result. Events the kernel or CPU refuses (no
+// PMU in a VM, perf_event_paranoid, non-Linux) are left out.
+// ---------------------------------------------------------------------------
+
+const Counters = struct {
+    fds: [events.len]?std.posix.fd_t = @splat(null),
+    totals: [events.len]f64 = @splat(0),
+
+    const linux = std.os.linux;
+    const HW = linux.PERF.COUNT.HW;
+    const Cache = HW.CACHE;
+
+    const Event = struct { name: []const u8, field: []const u8, type: linux.PERF.TYPE, config: u64 };
+
+    /// Per-operation values for one case, as stored in the JSON report.
+    const Values = struct {
+        cycles: ?f64 = null,
+        instructions: ?f64 = null,
+        l1d_misses: ?f64 = null,
+        llc_misses: ?f64 = null,
+        branch_misses: ?f64 = null,
+        dtlb_misses: ?f64 = null,
+    };
+
+    fn cacheMiss(cache: Cache) u64 {
+        return @intFromEnum(cache) | @as(u64, @intFromEnum(Cache.OP.READ)) << 8 | @as(u64, @intFromEnum(Cache.RESULT.MISS)) << 16;
+    }
+
+    const events = [_]Event{
+        .{ .name = "cycles", .field = "cycles", .type = .HARDWARE, .config = @intFromEnum(HW.CPU_CYCLES) },
+        .{ .name = "instr", .field = "instructions", .type = .HARDWARE, .config = @intFromEnum(HW.INSTRUCTIONS) },
+        .{ .name = "L1d-miss", .field = "l1d_misses", .type = .HW_CACHE, .config = cacheMiss(.L1D) },
+        .{ .name = "LLC-miss", .field = "llc_misses", .type = .HW_CACHE, .config = cacheMiss(.LL) },
+        .{ .name = "br-miss", .field = "branch_misses", .type = .HARDWARE, .config = @intFromEnum(HW.BRANCH_MISSES) },
+        .{ .name = "dTLB-miss", .field = "dtlb_misses", .type = .HW_CACHE, .config = cacheMiss(.DTLB) },
+    };
+
+    // read_format: value, time enabled, time running (to undo multiplexing).
+    const read_format: u64 = 1 | 2;
+
+    /// Open what is available; null if nothing is.
+    fn open() ?Counters {
+        var self: Counters = .{};
+        var any = false;
+        if (builtin.os.tag == .linux) {
+            for (events, &self.fds) |ev, *fd| {
+                var attr: linux.perf_event_attr = .{
+                    .type = ev.type,
+                    .config = ev.config,
+                    .read_format = read_format,
+                    .flags = .{ .disabled = true, .exclude_kernel = true, .exclude_hv = true },
+                };
+                const rc = linux.perf_event_open(&attr, 0, -1, -1, linux.PERF.FLAG.FD_CLOEXEC);
+                if (linux.E.init(rc) != .SUCCESS) continue;
+                fd.* = @intCast(rc);
+                any = true;
+            }
+        }
+        return if (any) self else null;
+    }
+
+    fn close(self: *Counters) void {
+        for (self.fds) |fd| if (fd) |f| std.posix.close(f);
+    }
+
+    fn start(self: *Counters) void {
+        for (self.fds) |fd| if (fd) |f| {
+            _ = linux.ioctl(f, linux.PERF.EVENT_IOC.RESET, 0);
+            _ = linux.ioctl(f, linux.PERF.EVENT_IOC.ENABLE, 0);
+        };
+    }
+
+    fn stop(self: *Counters) void {
+        for (self.fds) |fd| if (fd) |f| {
+            _ = linux.ioctl(f, linux.PERF.EVENT_IOC.DISABLE, 0);
+        };
+        for (self.fds, &self.totals) |fd, *total| if (fd) |f| {
+            var v: [3]u64 = undefined;
+            const n = std.posix.read(f, std.mem.asBytes(&v)) catch 0;
+            if (n != @sizeOf(@TypeOf(v)) or v[2] == 0) continue;
+            total.* += @as(f64, @floatFromInt(v[0])) * @as(f64, @floatFromInt(v[1])) / @as(f64, @floatFromInt(v[2]));
+        };
+    }
+
+    /// Print totals since the last report divided by `ops`, then clear them.
+    fn report(self: *Counters, ops: u64) Values {
+        const per_op = @as(f64, @floatFromInt(ops));
+        var out: Values = .{};
+        std.debug.print("  {s:<18}", .{""});
+        inline for (events, 0..) |ev, i| {
+            if (self.fds[i] != null) {
+                @field(out, ev.field) = self.totals[i] / per_op;
+                std.debug.print(" {s} {d:.2}", .{ ev.name, self.totals[i] / per_op });
+            }
+        }
+        if (self.fds[0] != null and self.fds[1] != null and self.totals[0] > 0) {
+            std.debug.print("  IPC {d:.2}", .{self.totals[1] / self.totals[0]});
+        }
+        std.debug.print("  /op\n", .{});
+        self.totals = @splat(0);
+        return out;
+    }
+};
+
+var counters: ?Counters = null;
+
+/// One timed trial; also brackets the hardware counters when enabled.
+const Trial = struct {
+    timer: Timer,
+
+    fn start() !Trial {
+        if (counters) |*c| c.start();
+        return .{ .timer = try Timer.start() };
+    }
+
+    fn stop(self: *Trial) u64 {
+        const ns = self.timer.read();
+        if (counters) |*c| c.stop();
+        return ns;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Latency histograms
+//
+// HDR-style log-linear buckets: exact below 128 ns, then 64 buckets per
+// power of two (under 1.6% relative error) up to the full u64 range.
+// ---------------------------------------------------------------------------
+
+const Histogram = struct {
+    counts: [bucket_count]u64 = @splat(0),
+    total: u64 = 0,
+    max: u64 = 0,
+
+    const sub_bits = 7;
+    const sub_count: u64 = 1 << sub_bits;
+    const half: u64 = sub_count / 2;
+    const bucket_count: usize = sub_count + (64 - sub_bits) * half;
+
+    fn indexOf(v: u64) usize {
+        if (v < sub_count) return @intCast(v);
+        const e: u64 = 63 - @clz(v);
+        const shift: u6 = @intCast(e - (sub_bits - 1));
+        return @intCast(sub_count + (e - sub_bits) * half + ((v >> shift) - half));
+    }
+
+    /// Largest value that lands in bucket `i`.
+    fn highestOf(i: usize) u64 {
+        if (i < sub_count) return i;
+        const j: u64 = i - sub_count;
+        const shift: u6 = @intCast(j / half + 1);
+        const low = ((j % half) + half) << shift;
+        return low + ((@as(u64, 1) << shift) - 1);
+    }
+
+    fn record(self: *Histogram, v: u64) void {
+        self.counts[indexOf(v)] += 1;
+        self.total += 1;
+        self.max = @max(self.max, v);
+    }
+
+    fn merge(self: *Histogram, other: *const Histogram) void {
+        for (&self.counts, other.counts) |*a, b| a.* += b;
+        self.total += other.total;
+        self.max = @max(self.max, other.max);
+    }
+
+    fn percentile(self: *const Histogram, p: f64) u64 {
+        if (self.total == 0) return 0;
+        const rank: u64 = @max(1, @as(u64, @intFromFloat(@ceil(p / 100.0 * @as(f64, @floatFromInt(self.total))))));
+        var seen: u64 = 0;
+        for (self.counts, 0..) |n, i| {
+            seen += n;
+            if (seen >= rank) return @min(highestOf(i), self.max);
+        }
+        return self.max;
+    }
+
+    fn percentiles(self: *const Histogram) Percentiles {
+        return .{
+            .p50 = @floatFromInt(self.percentile(50)),
+            .p90 = @floatFromInt(self.percentile(90)),
+            .p99 = @floatFromInt(self.percentile(99)),
+            .p999 = @floatFromInt(self.percentile(99.9)),
+            .max = @floatFromInt(self.max),
+        };
+    }
+};
+
+const Percentiles = struct { p50: f64, p90: f64, p99: f64, p999: f64, max: f64 };
+
+/// Median cost of an empty pair of timer reads, subtracted from single-op timings.
+var timer_overhead: u64 = 0;
+
+fn calibrateTimer() !void {
+    var h: Histogram = .{};
+    var timer = try Timer.start();
+    for (0..10_000) |_| {
+        const a = timer.read();
+        const b = timer.read();
+        h.record(b - a);
+    }
+    timer_overhead = h.percentile(50);
+}
+
+fn printLatency(name: []const u8, p: Percentiles) void {
+    std.debug.print("  {s:<18} latency ns: p50 {d:.0}  p90 {d:.0}  p99 {d:.0}  p99.9 {d:.0}  max {d:.0}\n", .{
+        name, p.p50, p.p90, p.p99, p.p999, p.max,
+    });
+}
+
+/// Time `count` individual calls of `func(ctx)` per pass. Each pass's p99
+/// is one sample, so regressions in the tail can be tested like trial times.
+fn benchLatency(name: []const u8, count: u64, ctx: anytype, comptime func: anytype) !void {
+    var all: Histogram = .{};
+    var p99s: [NUM_TRIALS]f64 = undefined;
+    var timer = try Timer.start();
+    for (&p99s) |*p99| {
+        var h: Histogram = .{};
+        for (0..count) |_| {
+            const t0 = timer.read();
+            const r = try func(ctx);
+            const t1 = timer.read();
+            if (@TypeOf(r) != void) std.mem.doNotOptimizeAway(&r);
+            h.record((t1 - t0) -| timer_overhead);
+        }
+        p99.* = @floatFromInt(h.percentile(99));
+        all.merge(&h);
+    }
+    const p = all.percentiles();
+    printLatency(name, p);
+    recordCase(name, "p99_ns", count, &p99s, p, null);
+}
+
+// ---------------------------------------------------------------------------
+// Results, JSON report and baseline comparison
+// ---------------------------------------------------------------------------
+
+const Case = struct {
+    name: []const u8,
+    /// What `samples` measure: "ns_per_op" per trial, or "p99_ns" per pass.
+    metric: []const u8,
+    ops: u64,
+    samples: []const f64,
+    median: f64,
+    latency: ?Percentiles = null,
+    counters: ?Counters.Values = null,
+};
+
+const Report = struct {
+    version: u32 = 1,
+    trials: u32 = NUM_TRIALS,
+    cases: []const Case,
+};
+
+var results: std.ArrayListUnmanaged(Case) = .empty;
+var results_arena = std.heap.ArenaAllocator.init(std.heap.page_allocator);
+var group_buf: [64]u8 = undefined;
+var group: []const u8 = "";
+
+/// Print a section header; results until the next one are named `key/...`.
+fn section(title: []const u8, key: []const u8) void {
+    std.debug.print("\n{s}:\n", .{title});
+    setGroup(key);
+}
+
+fn setGroup(key: []const u8) void {
+    const n = @min(key.len, group_buf.len);
+    @memcpy(group_buf[0..n], key[0..n]);
+    group = group_buf[0..n];
+}
+
+fn recordCase(
+    name: []const u8,
+    metric: []const u8,
+    ops: u64,
+    samples: []const f64,
+    latency: ?Percentiles,
+    counter_values: ?Counters.Values,
+) void {
+    recordCaseImpl(name, metric, ops, samples, latency, counter_values) catch
+        std.debug.print("  (out of memory recording {s})\n", .{name});
+}
+
+fn recordCaseImpl(
+    name: []const u8,
+    metric: []const u8,
+    ops: u64,
+    samples: []const f64,
+    latency: ?Percentiles,
+    counter_values: ?Counters.Values,
+) !void {
+    const a = results_arena.allocator();
+    const trimmed = std.mem.trimRight(u8, name, ": ");
+    const sorted = try a.dupe(f64, samples);
+    std.mem.sort(f64, sorted, {}, std.sort.asc(f64));
+    try results.append(a, .{
+        .name = try std.fmt.allocPrint(a, "{s}/{s}", .{ group, trimmed }),
+        .metric = metric,
+        .ops = ops,
+        .samples = try a.dupe(f64, samples),
+        .median = sorted[sorted.len / 2],
+        .latency = latency,
+        .counters = counter_values,
+    });
+}
+
+fn writeJson() !void {
+    var buf: [4096]u8 = undefined;
+    var w = std.fs.File.stdout().writer(&buf);
+    const out = &w.interface;
+    try out.print("{f}\n", .{std.json.fmt(Report{ .cases = results.items }, .{ .whitespace = .indent_2 })});
+    try out.flush();
+}
+
+/// Two-sided Mann-Whitney U test (normal approximation with continuity
+/// correction; exact enough at five samples each to separate p < 0.05).
+fn mannWhitneyP(a: []const f64, b: []const f64) f64 {
+    var u: f64 = 0;
+    for (a) |x| for (b) |y| {
+        u += if (x > y) 1.0 else if (x == y) 0.5 else 0.0;
+    };
+    const n1: f64 = @floatFromInt(a.len);
+    const n2: f64 = @floatFromInt(b.len);
+    const mean = n1 * n2 / 2.0;
+    const sd = @sqrt(n1 * n2 * (n1 + n2 + 1.0) / 12.0);
+    if (sd == 0) return 1.0;
+    const z = (@abs(u - mean) - 0.5) / sd;
+    if (z <= 0) return 1.0;
+    return erfc(z / std.math.sqrt2);
+}
+
+/// Complementary error function, Abramowitz & Stegun 7.1.26 (|error| < 1.5e-7).
+fn erfc(x: f64) f64 {
+    const t = 1.0 / (1.0 + 0.3275911 * x);
+    const poly = t * (0.254829592 + t * (-0.284496736 + t * (1.421413741 + t * (-1.453152027 + t * 1.061405429))));
+    return poly * @exp(-x * x);
+}
+
+/// Compare this run against `path`; returns the number of regressions.
+/// A case regresses when its median is more than `threshold` worse and
+/// the samples differ significantly (p < 0.05).
+fn compareBaseline(allocator: std.mem.Allocator, path: []const u8, threshold: f64) !usize {
+    const bytes = try std.fs.cwd().readFileAlloc(allocator, path, 64 * 1024 * 1024);
+    defer allocator.free(bytes);
+    const parsed = try std.json.parseFromSlice(Report, allocator, bytes, .{ .ignore_unknown_fields = true });
+    defer parsed.deinit();
+
+    std.debug.print("\nComparison with {s} (threshold {d:.1}%, p < 0.05):\n", .{ path, threshold * 100 });
+    var regressions: usize = 0;
+    for (results.items) |cur| {
+        const base = for (parsed.value.cases) |c| {
+            if (std.mem.eql(u8, c.name, cur.name) and std.mem.eql(u8, c.metric, cur.metric)) break c;
+        } else continue;
+        if (base.median == 0) continue;
+        const change = cur.median / base.median - 1.0;
+        const p = mannWhitneyP(cur.samples, base.samples);
+        const verdict = if (p >= 0.05 or @abs(change) <= threshold)
+            "same"
+        else if (change > 0)
+            "REGRESSION"
+        else
+            "improved";
+        if (change > 0 and p < 0.05 and change > threshold) regressions += 1;
+        std.debug.print("  {s:<40} {s:<10} {d:>12.1} -> {d:>12.1}  {d:>7.1}%  p={d:.3}  {s}\n", .{
+            cur.name, cur.metric, base.median, cur.median, change * 100, p, verdict,
+        });
+    }
+    std.debug.print("  {d} regression(s)\n", .{regressions});
+    return regressions;
+}
+
 fn printStats(name: []const u8, count: u64, times: *[NUM_TRIALS]u64) void {
+    printStatsLatency(name, count, times, null);
+}
+
+fn printStatsLatency(name: []const u8, count: u64, times: *[NUM_TRIALS]u64, hist: ?*const Histogram) void {
+    var samples: [NUM_TRIALS]f64 = undefined;
+    for (&samples, times) |*s, t| s.* = nsPerOp(count, t);
     std.mem.sort(u64, times, {}, std.sort.asc(u64));
     const min = times[0];
     const median = times[NUM_TRIALS / 2];
     const max = times[NUM_TRIALS - 1];
-    std.debug.print("  {s:<14} {d:>12.0} ops/sec  (min {d:.1} ns/op, med {d:.1}, max {d:.1})\n", .{
+    std.debug.print("  {s:<18} {d:>12.0} ops/sec  (min {d:.1} ns/op, med {d:.1}, max {d:.1})\n", .{
         name,
         formatRate(count, median),
         nsPerOp(count, min),
         nsPerOp(count, median),
         nsPerOp(count, max),
     });
+    const latency = if (hist) |h| h.percentiles() else null;
+    if (latency) |p| printLatency("", p);
+    const counter_values = if (counters) |*c| c.report(count * NUM_TRIALS) else null;
+    recordCase(name, "ns_per_op", count, &samples, latency, counter_values);
 }
 
 fn benchSetGetI64() !void {
@@ -46,11 +436,11 @@ fn benchSetGetI64() !void {
     for (&set_times) |*t| {
         var mem: [65536]u8 align(4) = undefined;
         var buf = try lite3.Buffer.initObj(&mem);
-        var timer = try Timer.start();
+        var trial = try Trial.start();
         for (0..iterations) |_| {
             try buf.setI64(lite3.root, "key", 42);
         }
-        t.* = timer.read();
+        t.* = trial.stop();
         std.mem.doNotOptimizeAway(&buf);
     }
     printStats("set_i64:", iterations, &set_times);
@@ -61,12 +451,12 @@ fn benchSetGetI64() !void {
         var mem: [65536]u8 align(4) = undefined;
         var buf = try lite3.Buffer.initObj(&mem);
         try buf.setI64(lite3.root, "key", 42);
-        var timer = try Timer.start();
+        var trial = try Trial.start();
         for (0..iterations) |_| {
             const val = try buf.getI64(lite3.root, "key");
             std.mem.doNotOptimizeAway(&val);
         }
-        t.* = timer.read();
+        t.* = trial.stop();
     }
     printStats("get_i64:", iterations, &get_times);
 }
@@ -85,11 +475,11 @@ fn benchSetGetStr() !void {
     for (&set_times) |*t| {
         var mem: [65536]u8 align(4) = undefined;
         var buf = try lite3.Buffer.initObj(&mem);
-        var timer = try Timer.start();
+        var trial = try Trial.start();
         for (0..iterations) |_| {
             try buf.setStr(lite3.root, "key", "hello world benchmark string");
         }
-        t.* = timer.read();
+        t.* = trial.stop();
         std.mem.doNotOptimizeAway(&buf);
     }
     printStats("set_str:", iterations, &set_times);
@@ -100,12 +490,12 @@ fn benchSetGetStr() !void {
         var mem: [65536]u8 align(4) = undefined;
         var buf = try lite3.Buffer.initObj(&mem);
         try buf.setStr(lite3.root, "key", "hello world benchmark string");
-        var timer = try Timer.start();
+        var trial = try Trial.start();
         for (0..iterations) |_| {
             const val = try buf.getStr(lite3.root, "key");
             std.mem.doNotOptimizeAway(&val);
         }
-        t.* = timer.read();
+        t.* = trial.stop();
     }
     printStats("get_str:", iterations, &get_times);
 }
@@ -126,11 +516,11 @@ fn benchArrayAppend() !void {
     for (&times) |*t| {
         var mem: [4194304]u8 align(4) = undefined;
         var buf = try lite3.Buffer.initArr(&mem);
-        var timer = try Timer.start();
+        var trial = try Trial.start();
         for (0..iterations) |i| {
             try buf.arrAppendI64(lite3.root, @intCast(i));
         }
-        t.* = timer.read();
+        t.* = trial.stop();
         std.mem.doNotOptimizeAway(&buf);
     }
     printStats("arr_append:", iterations, &times);
@@ -157,7 +547,7 @@ fn benchIterate() !void {
         std.mem.doNotOptimizeAway(&sink);
     }
     for (&times) |*t| {
-        var timer = try Timer.start();
+        var trial = try Trial.start();
         for (0..iterations) |_| {
             var iter = try buf.iterate(lite3.root);
             var sink: usize = 0;
@@ -166,7 +556,7 @@ fn benchIterate() !void {
             }
             std.mem.doNotOptimizeAway(&sink);
         }
-        t.* = timer.read();
+        t.* = trial.stop();
     }
     std.mem.sort(u64, &times, {}, std.sort.asc(u64));
     const median = times[NUM_TRIALS / 2];
@@ -178,6 +568,10 @@ fn benchIterate() !void {
         nsPerOp(iterations, median),
         nsPerOp(iterations, times[NUM_TRIALS - 1]),
     });
+    const counter_values = if (counters) |*c| c.report(iterations * NUM_TRIALS) else null;
+    var samples: [NUM_TRIALS]f64 = undefined;
+    for (&samples, times) |*s, t| s.* = nsPerOp(iterations, t);
+    recordCase("iterate", "ns_per_op", iterations, &samples, null, counter_values);
 }
 
 fn benchJsonRoundTrip() !void {
@@ -198,13 +592,13 @@ fn benchJsonRoundTrip() !void {
         j.deinit();
     }
     for (&enc_times) |*t| {
-        var timer = try Timer.start();
+        var trial = try Trial.start();
         for (0..iterations) |_| {
             const json = try buf.jsonEncode(lite3.root);
             std.mem.doNotOptimizeAway(&json);
             json.deinit();
         }
-        t.* = timer.read();
+        t.* = trial.stop();
     }
     printStats("json_enc:", iterations, &enc_times);
 
@@ -221,13 +615,13 @@ fn benchJsonRoundTrip() !void {
         std.mem.doNotOptimizeAway(&b);
     }
     for (&dec_times) |*t| {
-        var timer = try Timer.start();
+        var trial = try Trial.start();
         for (0..iterations) |_| {
             var mem2: [65536]u8 align(4) = undefined;
             const b = try lite3.Buffer.jsonDecode(&mem2, json.slice());
             std.mem.doNotOptimizeAway(&b);
         }
-        t.* = timer.read();
+        t.* = trial.stop();
     }
     printStats("json_dec:", iterations, &dec_times);
 }
@@ -246,11 +640,11 @@ fn benchContextVsBuffer() !void {
     for (&buf_times) |*t| {
         var mem: [65536]u8 align(4) = undefined;
         var buf = try lite3.Buffer.initObj(&mem);
-        var timer = try Timer.start();
+        var trial = try Trial.start();
         for (0..iterations) |_| {
             try buf.setI64(lite3.root, "k", 1);
         }
-        t.* = timer.read();
+        t.* = trial.stop();
         std.mem.doNotOptimizeAway(&buf);
     }
     printStats("buffer_set:", iterations, &buf_times);
@@ -267,11 +661,11 @@ fn benchContextVsBuffer() !void {
     for (&ctx_times) |*t| {
         var ctx = try lite3.Context.init();
         try ctx.resetObj();
-        var timer = try Timer.start();
+        var trial = try Trial.start();
         for (0..iterations) |_| {
             try ctx.setI64(lite3.root, "k", 1);
         }
-        t.* = timer.read();
+        t.* = trial.stop();
         std.mem.doNotOptimizeAway(&ctx);
         ctx.deinit();
     }
@@ -286,29 +680,1308 @@ fn benchContextVsBuffer() !void {
     });
 }
 
+const periodic_table_path = "vendor/lite3/examples/periodic_table.json";
+
+fn medianOf(times: *[NUM_TRIALS]u64) u64 {
+    std.mem.sort(u64, times, {}, std.sort.asc(u64));
+    return times[NUM_TRIALS / 2];
+}
+
+fn mbPerSec(bytes: u64, elapsed_ns: u64) f64 {
+    return formatRate(bytes, elapsed_ns) / (1024.0 * 1024.0);
+}
+
+/// Report lz ratio and compress/decompress throughput for one input.
+/// Records `name/compress` and `name/decompress` (ns per call over the
+/// whole input) and `name/size` (compressed bytes).
+fn benchCodec(allocator: std.mem.Allocator, name: []const u8, input: []const u8) !void {
+    const compressed = try allocator.alloc(u8, lite3.lz.compressBound(input.len));
+    defer allocator.free(compressed);
+    const out = try allocator.alloc(u8, input.len);
+    defer allocator.free(out);
+
+    const compressed_len = try lite3.lz.compress(compressed, input);
+    if (try lite3.lz.decompress(out, compressed[0..compressed_len]) != input.len or !std.mem.eql(u8, out, input)) {
+        return error.RoundTripMismatch;
+    }
+    // Enough repetitions for ~32 MiB per trial.
+    const reps: u64 = @max(1, (32 * 1024 * 1024) / @max(input.len, 1));
+
+    var comp_times: [NUM_TRIALS]u64 = undefined;
+    for (&comp_times) |*t| {
+        var timer = try Timer.start();
+        for (0..reps) |_| {
+            const n = try lite3.lz.compress(compressed, input);
+            std.mem.doNotOptimizeAway(&n);
+        }
+        t.* = timer.read();
+    }
+    var dec_times: [NUM_TRIALS]u64 = undefined;
+    for (&dec_times) |*t| {
+        var timer = try Timer.start();
+        for (0..reps) |_| {
+            const n = try lite3.lz.decompress(out, compressed[0..compressed_len]);
+            std.mem.doNotOptimizeAway(&n);
+        }
+        t.* = timer.read();
+    }
+
+    var key: [96]u8 = undefined;
+    var samples: [NUM_TRIALS]f64 = undefined;
+    for (&samples, comp_times) |*s, t| s.* = nsPerOp(reps, t);
+    recordCase(try std.fmt.bufPrint(&key, "{s}/compress", .{name}), "ns_per_op", reps, &samples, null, null);
+    for (&samples, dec_times) |*s, t| s.* = nsPerOp(reps, t);
+    recordCase(try std.fmt.bufPrint(&key, "{s}/decompress", .{name}), "ns_per_op", reps, &samples, null, null);
+    // Deterministic, so every trial would report the same size.
+    @memset(&samples, @floatFromInt(compressed_len));
+    recordCase(try std.fmt.bufPrint(&key, "{s}/size", .{name}), "bytes", 1, &samples, null, null);
+
+    std.debug.print("  {s:<20} {d:>9} -> {d:>9} B  ratio {d:>5.2}  comp {d:>7.0} MB/s  decomp {d:>7.0} MB/s\n", .{
+        name,
+        input.len,
+        compressed_len,
+        @as(f64, @floatFromInt(input.len)) / @as(f64, @floatFromInt(compressed_len)),
+        mbPerSec(reps * input.len, medianOf(&comp_times)),
+        mbPerSec(reps * input.len, medianOf(&dec_times)),
+    });
+}
+
+fn benchCompression(allocator: std.mem.Allocator) !void {
+    const mem = try allocator.alignedAlloc(u8, .@"4", 8 * 1024 * 1024);
+    defer allocator.free(mem);
+
+    // --- periodic_table.json, as text and as a lite3 message ---
+    if (std.fs.cwd().readFileAlloc(allocator, periodic_table_path, 16 * 1024 * 1024)) |json| {
+        defer allocator.free(json);
+        try benchCodec(allocator, "periodic_table.json", json);
+        if (lite3.json_enabled) {
+            const buf = try lite3.Buffer.jsonDecode(mem, json);
+            try benchCodec(allocator, "periodic_table.lite3", buf.data());
+        }
+    } else |_| {
+        std.debug.print("  {s:<20} skipped (run from the repository root)\n", .{"periodic_table"});
+    }
+
+    // --- Generated: an array of small records ---
+    {
+        var buf = try lite3.Buffer.initArr(mem);
+        var prng = std.Random.DefaultPrng.init(0x5eed);
+        const rand = prng.random();
+        for (0..5000) |i| {
+            const rec = try buf.arrAppendObj(lite3.root);
+            var text: [64]u8 = undefined;
+            try buf.setI64(rec, "id", @intCast(i));
+            try buf.setStr(rec, "name", try std.fmt.bufPrint(&text, "user-{d}", .{rand.int(u16)}));
+            try buf.setStr(rec, "email", try std.fmt.bufPrint(&text, "user{d}@example.com", .{i}));
+            try buf.setF64(rec, "score", rand.float(f64) * 100.0);
+            try buf.setBool(rec, "active", rand.boolean());
+        }
+        try benchCodec(allocator, "records.lite3", buf.data());
+    }
+
+    // --- Generated: a numeric series ---
+    {
+        var buf = try lite3.Buffer.initArr(mem);
+        var v: i64 = 1_000_000;
+        for (0..50_000) |i| {
+            v += @as(i64, @intCast(i % 7)) - 3;
+            try buf.arrAppendI64(lite3.root, v);
+        }
+        try benchCodec(allocator, "series.lite3", buf.data());
+    }
+
+    // --- Generated: random bytes (incompressible) ---
+    {
+        const noise = try allocator.alloc(u8, 1024 * 1024);
+        defer allocator.free(noise);
+        var prng = std.Random.DefaultPrng.init(1);
+        prng.random().bytes(noise);
+        try benchCodec(allocator, "random", noise);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Dataset benchmarks
+//
+// The simdjson twitter tasks and the kostya coordinate sum, as described in
+// vendor/lite3/README.md. Generated data is used unless the real files are
+// passed with --twitter/--kostya (requires JSON support).
+// ---------------------------------------------------------------------------
+
+/// Published Lite3 Buffer API results on the real twitter.json, for reference.
+const published_twitter_ns = .{ .top_tweet = 2221, .partial_tweets = 17659, .find_tweet = 448, .distinct_user_id = 11699 };
+
+/// Time `reps` calls of `func(ctx)` per trial.
+fn runCase(name: []const u8, reps: u64, ctx: anytype, comptime func: anytype) !void {
+    var times: [NUM_TRIALS]u64 = undefined;
+    var hist: Histogram = .{};
+    {
+        // warmup
+        const r = try func(ctx);
+        std.mem.doNotOptimizeAway(&r);
+    }
+    for (&times) |*t| {
+        var trial = try Trial.start();
+        var last: u64 = 0;
+        for (0..reps) |_| {
+            const r = try func(ctx);
+            std.mem.doNotOptimizeAway(&r);
+            const now = trial.timer.read();
+            hist.record(now - last);
+            last = now;
+        }
+        t.* = trial.stop();
+    }
+    printStatsLatency(name, reps, &times, &hist);
+}
+
+/// A serialized document held three ways, so each task can be timed
+/// through the Buffer API, the pure-Zig ConstView reader and the C
+/// context API.
+const Document = struct {
+    mem: []align(4) u8,
+    buf: lite3.Buffer,
+    view: lite3.ConstView,
+    ctx: lite3.Context,
+
+    fn init(allocator: std.mem.Allocator, bytes: []const u8) !Document {
+        const mem = try allocator.alignedAlloc(u8, .@"4", bytes.len);
+        errdefer allocator.free(mem);
+        @memcpy(mem, bytes);
+        return .{
+            .mem = mem,
+            .buf = try lite3.Buffer.fromSerialized(mem, bytes.len),
+            .view = try lite3.ConstView.init(mem),
+            .ctx = try lite3.Context.initFromBuf(bytes),
+        };
+    }
+
+    fn deinit(self: *Document, allocator: std.mem.Allocator) void {
+        self.ctx.deinit();
+        allocator.free(self.mem);
+    }
+};
+
+fn jsonToDocument(allocator: std.mem.Allocator, path: []const u8) !Document {
+    if (!lite3.json_enabled) return error.JsonDisabled;
+    const json = try std.fs.cwd().readFileAlloc(allocator, path, 1 << 30);
+    defer allocator.free(json);
+    var doc = try lite3.ManagedContext.init(allocator);
+    defer doc.deinit();
+    try doc.jsonDecode(json);
+    return Document.init(allocator, doc.data());
+}
+
+/// Roughly the shape of twitter.json: statuses with a nested user, some
+/// replies and some retweets carrying their own status and user.
+fn generateTwitter(allocator: std.mem.Allocator, n: usize) !Document {
+    var doc = try lite3.ManagedContext.init(allocator);
+    defer doc.deinit();
+    var prng = std.Random.DefaultPrng.init(0x7417);
+    const rand = prng.random();
+    const statuses = try doc.setArr(lite3.root, "statuses");
+    for (0..n) |i| {
+        const status = try doc.arrAppendObj(statuses);
+        try fillStatus(&doc, status, rand, i);
+        if (rand.uintLessThan(u8, 3) == 0) {
+            const rt = try doc.setObj(status, "retweeted_status");
+            try fillStatus(&doc, rt, rand, i + n);
+        }
+    }
+    const meta = try doc.setObj(lite3.root, "search_metadata");
+    try doc.setF64(meta, "completed_in", 0.087);
+    try doc.setI64(meta, "count", @intCast(n));
+    try doc.setStr(meta, "query", "%E4%B8%80");
+    return Document.init(allocator, doc.data());
+}
+
+fn fillStatus(doc: anytype, status: lite3.Offset, rand: std.Random, i: usize) !void {
+    var text: [160]u8 = undefined;
+    try doc.setStr(status, "created_at", "Sun Aug 31 00:29:15 +0000 2014");
+    try doc.setI64(status, "id", 505874924095815681 + @as(i64, @intCast(i)) * 7919);
+    try doc.setStr(status, "id_str", try std.fmt.bufPrint(&text, "{d}", .{505874924095815681 + i * 7919}));
+    const body = text[0..rand.intRangeAtMost(usize, 40, 140)];
+    for (body) |*ch| ch.* = "abcdefghijklmnopqrstuvwxyz      #@"[rand.uintLessThan(usize, 34)];
+    try doc.setStr(status, "text", body);
+    try doc.setStr(status, "source", "<a href=\"http://twitter.com/download/iphone\" rel=\"nofollow\">Twitter for iPhone</a>");
+    try doc.setBool(status, "truncated", false);
+    if (rand.boolean()) {
+        try doc.setI64(status, "in_reply_to_status_id", 505874000000000000 + @as(i64, rand.int(u32)));
+    } else {
+        try doc.setNull(status, "in_reply_to_status_id");
+    }
+    const user = try doc.setObj(status, "user");
+    try doc.setI64(user, "id", rand.intRangeAtMost(i64, 1, 3_000_000_000));
+    try doc.setStr(user, "name", try std.fmt.bufPrint(&text, "User {d}", .{rand.int(u16)}));
+    try doc.setStr(user, "screen_name", try std.fmt.bufPrint(&text, "user_{x}", .{rand.int(u32)}));
+    try doc.setStr(user, "location", "");
+    try doc.setStr(user, "description", "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore et dolore magna aliqua.");
+    try doc.setI64(user, "followers_count", rand.intRangeAtMost(i64, 0, 100_000));
+    try doc.setI64(user, "friends_count", rand.intRangeAtMost(i64, 0, 5_000));
+    try doc.setStr(user, "profile_image_url", "http://pbs.twimg.com/profile_images/000000000000000000/abcdefgh_normal.jpeg");
+    try doc.setBool(user, "verified", rand.uintLessThan(u8, 20) == 0);
+    const entities = try doc.setObj(status, "entities");
+    const hashtags = try doc.setArr(entities, "hashtags");
+    for (0..rand.uintLessThan(usize, 3)) |_| {
+        const tag = try doc.arrAppendObj(hashtags);
+        try doc.setStr(tag, "text", "lite3");
+    }
+    _ = try doc.setArr(entities, "urls");
+    try doc.setI64(status, "retweet_count", rand.intRangeAtMost(i64, 0, 100));
+    try doc.setI64(status, "favorite_count", rand.intRangeAtMost(i64, 0, 200));
+    try doc.setStr(status, "lang", "ja");
+}
+
+fn TwitterTasks(comptime Doc: type) type {
+    return struct {
+        doc: *const Doc,
+        find_id: i64,
+        partial: std.ArrayListUnmanaged(PartialTweet) = .empty,
+        user_ids: std.ArrayListUnmanaged(i64) = .empty,
+        allocator: std.mem.Allocator,
+
+        const Self = @This();
+
+        const PartialTweet = struct {
+            created_at: []const u8,
+            id: i64,
+            text: []const u8,
+            in_reply_to_status_id: i64,
+            user_id: i64,
+            screen_name: []const u8,
+            retweet_count: i64,
+            favorite_count: i64,
+        };
+
+        fn deinit(self: *Self) void {
+            self.partial.deinit(self.allocator);
+            self.user_ids.deinit(self.allocator);
+        }
+
+        /// Text and author of the most retweeted status.
+        fn topTweet(self: *Self) !usize {
+            const doc = self.doc;
+            const statuses = try doc.getArr(lite3.root, "statuses");
+            var best: i64 = -1;
+            var best_ofs = lite3.root;
+            var it = try doc.iterate(statuses);
+            while (try it.next()) |e| {
+                const retweets = try doc.getI64(e.val_offset, "retweet_count");
+                if (retweets > best) {
+                    best = retweets;
+                    best_ofs = e.val_offset;
+                }
+            }
+            const text = try doc.getStr(best_ofs, "text");
+            const screen_name = try doc.getStr(try doc.getObj(best_ofs, "user"), "screen_name");
+            return text.len + screen_name.len;
+        }
+
+        fn partialTweets(self: *Self) !usize {
+            const doc = self.doc;
+            self.partial.clearRetainingCapacity();
+            const statuses = try doc.getArr(lite3.root, "statuses");
+            var it = try doc.iterate(statuses);
+            while (try it.next()) |e| {
+                const s = e.val_offset;
+                const user = try doc.getObj(s, "user");
+                try self.partial.append(self.allocator, .{
+                    .created_at = try doc.getStr(s, "created_at"),
+                    .id = try doc.getI64(s, "id"),
+                    .text = try doc.getStr(s, "text"),
+                    .in_reply_to_status_id = if (try doc.getType(s, "in_reply_to_status_id") == .null) 0 else try doc.getI64(s, "in_reply_to_status_id"),
+                    .user_id = try doc.getI64(user, "id"),
+                    .screen_name = try doc.getStr(user, "screen_name"),
+                    .retweet_count = try doc.getI64(s, "retweet_count"),
+                    .favorite_count = try doc.getI64(s, "favorite_count"),
+                });
+            }
+            return self.partial.items.len;
+        }
+
+        fn findTweet(self: *Self) !usize {
+            const doc = self.doc;
+            const statuses = try doc.getArr(lite3.root, "statuses");
+            var it = try doc.iterate(statuses);
+            while (try it.next()) |e| {
+                if (try doc.getI64(e.val_offset, "id") == self.find_id) return (try doc.getStr(e.val_offset, "text")).len;
+            }
+            return error.NotFound;
+        }
+
+        fn distinctUserId(self: *Self) !usize {
+            const doc = self.doc;
+            self.user_ids.clearRetainingCapacity();
+            const statuses = try doc.getArr(lite3.root, "statuses");
+            var it = try doc.iterate(statuses);
+            while (try it.next()) |e| {
+                try self.user_ids.append(self.allocator, try doc.getI64(try doc.getObj(e.val_offset, "user"), "id"));
+                if (try doc.exists(e.val_offset, "retweeted_status")) {
+                    const rt = try doc.getObj(e.val_offset, "retweeted_status");
+                    try self.user_ids.append(self.allocator, try doc.getI64(try doc.getObj(rt, "user"), "id"));
+                }
+            }
+            const ids = self.user_ids.items;
+            std.mem.sort(i64, ids, {}, std.sort.asc(i64));
+            var n: usize = 0;
+            for (ids, 0..) |id, i| {
+                if (i == 0 or id != ids[n - 1]) {
+                    ids[n] = id;
+                    n += 1;
+                }
+            }
+            self.user_ids.shrinkRetainingCapacity(n);
+            return n;
+        }
+    };
+}
+
+fn benchTwitterWith(comptime Doc: type, allocator: std.mem.Allocator, label: []const u8, doc: *const Doc, find_id: i64) !void {
+    var tasks: TwitterTasks(Doc) = .{ .doc = doc, .find_id = find_id, .allocator = allocator };
+    defer tasks.deinit();
+    std.debug.print("  [{s}]\n", .{label});
+    var key: [64]u8 = undefined;
+    setGroup(try std.fmt.bufPrint(&key, "twitter/{s}", .{label}));
+    try runCase("top_tweet:", 10_000, &tasks, TwitterTasks(Doc).topTweet);
+    try runCase("partial_tweets:", 2_000, &tasks, TwitterTasks(Doc).partialTweets);
+    try runCase("find_tweet:", 10_000, &tasks, TwitterTasks(Doc).findTweet);
+    try runCase("distinct_user_id:", 2_000, &tasks, TwitterTasks(Doc).distinctUserId);
+}
+
+fn benchTwitter(allocator: std.mem.Allocator, path: ?[]const u8) !void {
+    var doc = if (path) |p| try jsonToDocument(allocator, p) else try generateTwitter(allocator, 100);
+    defer doc.deinit(allocator);
+    const statuses = try doc.view.getArr(lite3.root, "statuses");
+    const n = try doc.view.count(statuses);
+    const find_id = try doc.view.getI64(try doc.view.arrGetObj(statuses, n * 3 / 4), "id");
+    std.debug.print("  {s}: {d} statuses, {d} bytes\n", .{ path orelse "generated", n, doc.mem.len });
+    std.debug.print("  published C Buffer API (real twitter.json): top_tweet {d} ns, partial_tweets {d} ns, find_tweet {d} ns, distinct_user_id {d} ns\n", .{
+        published_twitter_ns.top_tweet,
+        published_twitter_ns.partial_tweets,
+        published_twitter_ns.find_tweet,
+        published_twitter_ns.distinct_user_id,
+    });
+    try benchTwitterWith(lite3.Buffer, allocator, "Buffer", &doc.buf, find_id);
+    try benchTwitterWith(lite3.ConstView, allocator, "ConstView", &doc.view, find_id);
+    try benchTwitterWith(lite3.Context, allocator, "Context", &doc.ctx, find_id);
+}
+
+/// The kostya generator's layout: {"coordinates": [{x, y, z, name, opts}], "info"}.
+fn generateCoordinates(allocator: std.mem.Allocator, n: usize) !Document {
+    var doc = try lite3.ManagedContext.init(allocator);
+    defer doc.deinit();
+    var prng = std.Random.DefaultPrng.init(0xc00d);
+    const rand = prng.random();
+    const coords = try doc.setArr(lite3.root, "coordinates");
+    var name: [16]u8 = undefined;
+    for (0..n) |_| {
+        const o = try doc.arrAppendObj(coords);
+        try doc.setF64(o, "x", rand.float(f64));
+        try doc.setF64(o, "y", rand.float(f64));
+        try doc.setF64(o, "z", rand.float(f64));
+        try doc.setStr(o, "name", try std.fmt.bufPrint(&name, "{x:0>6} {d}", .{ rand.int(u24), rand.uintLessThan(u16, 10000) }));
+        const opts = try doc.setObj(o, "opts");
+        const one = try doc.setArr(opts, "1");
+        try doc.arrAppendI64(one, 1);
+        try doc.arrAppendBool(one, true);
+    }
+    try doc.setStr(lite3.root, "info", "some info");
+    return Document.init(allocator, doc.data());
+}
+
+fn CoordinateTasks(comptime Doc: type) type {
+    return struct {
+        doc: *const Doc,
+
+        /// Average of every x, y and z.
+        fn sum(self: *const @This()) ![3]f64 {
+            const doc = self.doc;
+            const coords = try doc.getArr(lite3.root, "coordinates");
+            var acc: [3]f64 = .{ 0, 0, 0 };
+            var n: f64 = 0;
+            var it = try doc.iterate(coords);
+            while (try it.next()) |e| {
+                acc[0] += try doc.getF64(e.val_offset, "x");
+                acc[1] += try doc.getF64(e.val_offset, "y");
+                acc[2] += try doc.getF64(e.val_offset, "z");
+                n += 1;
+            }
+            return .{ acc[0] / n, acc[1] / n, acc[2] / n };
+        }
+    };
+}
+
+fn benchCoordinates(allocator: std.mem.Allocator, path: ?[]const u8) !void {
+    var doc = if (path) |p| try jsonToDocument(allocator, p) else try generateCoordinates(allocator, 100_000);
+    defer doc.deinit(allocator);
+    const n = try doc.view.count(try doc.view.getArr(lite3.root, "coordinates"));
+    std.debug.print("  {s}: {d} coordinates, {d} bytes (published C lite3: 0.027 s for 524288 coordinates)\n", .{ path orelse "generated", n, doc.mem.len });
+    try runCase("sum (Buffer):", 5, &CoordinateTasks(lite3.Buffer){ .doc = &doc.buf }, CoordinateTasks(lite3.Buffer).sum);
+    try runCase("sum (ConstView):", 5, &CoordinateTasks(lite3.ConstView){ .doc = &doc.view }, CoordinateTasks(lite3.ConstView).sum);
+    try runCase("sum (Context):", 5, &CoordinateTasks(lite3.Context){ .doc = &doc.ctx }, CoordinateTasks(lite3.Context).sum);
+}
+
+/// Sum a numeric field over every element of periodic_table.json.
+fn benchPeriodicTable(allocator: std.mem.Allocator) !void {
+    if (!lite3.json_enabled) {
+        std.debug.print("  periodic_table: disabled (-Djson=false)\n", .{});
+        return;
+    }
+    var doc = jsonToDocument(allocator, periodic_table_path) catch |err| switch (err) {
+        error.FileNotFound => {
+            std.debug.print("  periodic_table: skipped (run from the repository root)\n", .{});
+            return;
+        },
+        else => return err,
+    };
+    defer doc.deinit(allocator);
+    const Task = struct {
+        view: *const lite3.ConstView,
+        fn totalWeight(self: *const @This()) !f64 {
+            const v = self.view;
+            var total: f64 = 0;
+            var it = try v.iterate(try v.getArr(lite3.root, "data"));
+            while (try it.next()) |e| {
+                total += switch (try v.getType(e.val_offset, "atomic_weight")) {
+                    .f64_ => try v.getF64(e.val_offset, "atomic_weight"),
+                    .i64_ => @floatFromInt(try v.getI64(e.val_offset, "atomic_weight")),
+                    else => 0,
+                };
+            }
+            return total;
+        }
+    };
+    std.debug.print("  periodic_table.json: {d} bytes as Lite3\n", .{doc.mem.len});
+    try runCase("atomic_weight:", 10_000, &Task{ .view = &doc.view }, Task.totalWeight);
+}
+
+// ---------------------------------------------------------------------------
+// Scaling matrix (--matrix)
+//
+// Lookup/insert cost across object sizes, key lengths, key orders and
+// nesting depths. One object per configuration with i64 values; keys are
+// fixed-length, unique in their first four characters.
+// ---------------------------------------------------------------------------
+
+const matrix_sizes = [_]u64{ 1, 10, 100, 1_000, 10_000, 100_000, 1_000_000, 10_000_000 };
+const matrix_key_lens = [_]usize{ 4, 16, 64, 128 };
+const matrix_depths = [_]usize{ 1, 2, 4, 8, 16, 32 };
+const matrix_sample: usize = 100_000;
+/// Spread cold lookups over copies of the document totalling this much.
+const matrix_cold_bytes: usize = 256 * 1024 * 1024;
+
+const key_alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+fn matrixKey(out: []u8, index: u64) []const u8 {
+    for (out, 0..) |*ch, i| {
+        const digit = if (i < 4) index >> @intCast(6 * i) else index +% i;
+        ch.* = key_alphabet[@intCast(digit & 63)];
+    }
+    return out;
+}
+
+const Order = enum { sequential, random };
+
+const MatrixRow = struct {
+    stats: lite3.ConstView.TreeStats = .{},
+    bytes: usize = 0,
+    insert_ns: f64 = 0,
+    /// Per-trial insert times (ns/op); `insert_trials` of them are valid.
+    insert_samples: [NUM_TRIALS]f64 = @splat(0),
+    insert_trials: usize = 0,
+    insert_ops: u64 = 0,
+    lookups: u64 = 0,
+    hit_ns: f64 = 0,
+    miss_ns: f64 = 0,
+    cold_hit_ns: f64 = 0,
+};
+
+/// Keys `indices[i]` laid out back to back, `key_len` bytes each.
+fn materializeKeys(allocator: std.mem.Allocator, key_len: usize, indices: []const u64) ![]u8 {
+    const keys = try allocator.alloc(u8, indices.len * key_len);
+    for (indices, 0..) |idx, i| _ = matrixKey(keys[i * key_len ..][0..key_len], idx);
+    return keys;
+}
+
+fn timeLookups(bufs: []const lite3.Buffer, keys: []const u8, key_len: usize, expect_hit: bool) !f64 {
+    const n = keys.len / key_len;
+    var timer = try Timer.start();
+    var sink: i64 = 0;
+    for (0..n) |i| {
+        const key = keys[i * key_len ..][0..key_len];
+        const r = bufs[i % bufs.len].getI64(lite3.root, key);
+        if (r) |v| {
+            sink +%= v;
+        } else |err| {
+            if (expect_hit or err != lite3.Error.NotFound) return err;
+        }
+    }
+    std.mem.doNotOptimizeAway(&sink);
+    return nsPerOp(n, timer.read());
+}
+
+fn runMatrixConfig(allocator: std.mem.Allocator, n: u64, key_len: usize, order: Order) !MatrixRow {
+    var row: MatrixRow = .{};
+    var prng = std.Random.DefaultPrng.init(n *% 31 +% key_len);
+    const rand = prng.random();
+
+    const insert_order = try allocator.alloc(u64, n);
+    defer allocator.free(insert_order);
+    for (insert_order, 0..) |*v, i| v.* = i;
+    if (order == .random) rand.shuffle(u64, insert_order);
+
+    const cap = std.mem.alignForward(usize, 4096 + n * (key_len + 64) * 2, std.heap.page_size_min);
+    const mem = try std.heap.page_allocator.alignedAlloc(u8, .@"4", cap);
+    defer std.heap.page_allocator.free(mem);
+
+    // Insert: rebuild small objects enough times to get a stable figure.
+    const reps = @max(1, 200_000 / n);
+    const trials: usize = if (n >= 1_000_000) 1 else NUM_TRIALS;
+    var key: [128]u8 = undefined;
+    var insert_times: [NUM_TRIALS]u64 = @splat(std.math.maxInt(u64));
+    var buf: lite3.Buffer = undefined;
+    for (insert_times[0..trials]) |*t| {
+        var timer = try Timer.start();
+        for (0..reps) |_| {
+            buf = try lite3.Buffer.initObj(mem);
+            for (insert_order, 0..) |idx, i| try buf.setI64(lite3.root, matrixKey(key[0..key_len], idx), @intCast(i));
+        }
+        t.* = timer.read();
+    }
+    for (insert_times[0..trials], row.insert_samples[0..trials]) |t, *ns| ns.* = nsPerOp(reps * n, t);
+    row.insert_trials = trials;
+    row.insert_ops = reps * n;
+    std.mem.sort(u64, insert_times[0..trials], {}, std.sort.asc(u64));
+    row.insert_ns = nsPerOp(reps * n, insert_times[trials / 2]);
+
+    const doc = buf.data();
+    row.bytes = doc.len;
+    row.stats = try (try lite3.ConstView.init(doc)).treeStats(lite3.root);
+
+    // Lookup samples: hits follow the key order, misses are never-inserted keys.
+    const m: usize = @intCast(@min(n, matrix_sample));
+    const sample = try allocator.alloc(u64, m);
+    defer allocator.free(sample);
+    for (sample, 0..) |*v, i| v.* = switch (order) {
+        .sequential => i,
+        .random => rand.uintLessThan(u64, n),
+    };
+    const hit_keys = try materializeKeys(allocator, key_len, sample);
+    defer allocator.free(hit_keys);
+    for (sample, 0..) |*v, i| v.* = n + i;
+    const miss_keys = try materializeKeys(allocator, key_len, sample);
+    defer allocator.free(miss_keys);
+
+    const warm = [_]lite3.Buffer{buf};
+    _ = try timeLookups(&warm, hit_keys, key_len, true); // warmup
+    row.hit_ns = try timeLookups(&warm, hit_keys, key_len, true);
+    row.miss_ns = try timeLookups(&warm, miss_keys, key_len, false);
+
+    // Cold: consecutive lookups go to different copies, so each one starts
+    // from memory rather than cache.
+    const stride = std.mem.alignForward(usize, doc.len, 64);
+    const copies = std.math.clamp(matrix_cold_bytes / stride, 1, 4096);
+    const cold_mem = try std.heap.page_allocator.alignedAlloc(u8, .@"64", copies * stride);
+    defer std.heap.page_allocator.free(cold_mem);
+    const cold = try allocator.alloc(lite3.Buffer, copies);
+    defer allocator.free(cold);
+    for (cold, 0..) |*b, i| {
+        const slot: []align(4) u8 = @alignCast(cold_mem[i * stride ..][0..stride]);
+        @memcpy(slot[0..doc.len], doc);
+        b.* = try lite3.Buffer.fromSerialized(slot, doc.len);
+    }
+    row.cold_hit_ns = try timeLookups(cold, hit_keys, key_len, true);
+    row.lookups = m;
+    return row;
+}
+
+const depth_iterations: u64 = 100_000;
+
+/// Resolve a chain of `depth` nested objects and read the leaf.
+fn benchDepth(depth: usize) !struct { get_ns: f64, set_ns: f64 } {
+    var mem: [65536]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+    var ofs = lite3.root;
+    var key: [16]u8 = undefined;
+    for (0..depth) |_| {
+        // A few siblings per level so each level is a real lookup.
+        for (0..6) |j| try buf.setI64(ofs, matrixKey(&key, j), @intCast(j));
+        ofs = try buf.setObj(ofs, "child");
+    }
+    try buf.setI64(ofs, "leaf", 1);
+
+    const iterations = depth_iterations;
+    var timer = try Timer.start();
+    var sink: i64 = 0;
+    for (0..iterations) |_| {
+        var o = lite3.root;
+        for (0..depth) |_| o = try buf.getObj(o, "child");
+        sink +%= try buf.getI64(o, "leaf");
+    }
+    const get_ns = nsPerOp(iterations, timer.read());
+    std.mem.doNotOptimizeAway(&sink);
+
+    timer.reset();
+    for (0..iterations) |i| {
+        var o = lite3.root;
+        for (0..depth) |_| o = try buf.getObj(o, "child");
+        try buf.setI64(o, "leaf", @intCast(i));
+    }
+    return .{ .get_ns = get_ns, .set_ns = nsPerOp(iterations, timer.read()) };
+}
+
+fn runMatrix(allocator: std.mem.Allocator, max_keys: u64, mem_limit: usize) !void {
+    setGroup("matrix");
+    std.debug.print("\nScaling matrix (insert: setI64, lookup: getI64 on one object)\n", .{});
+    std.debug.print("{s:>10} {s:>4} {s:>10} {s:>6} {s:>9} {s:>5} {s:>9} {s:>9} {s:>9} {s:>9} {s:>9}\n", .{
+        "keys", "klen", "order", "height", "nodes", "fill", "B/entry", "insert", "hit", "miss", "cold hit",
+    });
+    for (matrix_sizes) |n| {
+        if (n > max_keys) break;
+        for (matrix_key_lens) |key_len| {
+            for ([_]Order{ .sequential, .random }) |order| {
+                std.debug.print("{d:>10} {d:>4} {s:>10} ", .{ n, key_len, @tagName(order) });
+                if (n * (key_len + 64) * 2 > mem_limit) {
+                    std.debug.print("skipped (over --mem-limit)\n", .{});
+                    continue;
+                }
+                const row = runMatrixConfig(allocator, n, key_len, order) catch |err| {
+                    std.debug.print("failed: {s}\n", .{@errorName(err)});
+                    continue;
+                };
+                std.debug.print("{d:>6} {d:>9} {d:>5.2} {d:>9.1} {d:>9.1} {d:>9.1} {d:>9.1} {d:>9.1}\n", .{
+                    row.stats.height,
+                    row.stats.nodes,
+                    row.stats.fill(),
+                    @as(f64, @floatFromInt(row.bytes)) / @as(f64, @floatFromInt(n)),
+                    row.insert_ns,
+                    row.hit_ns,
+                    row.miss_ns,
+                    row.cold_hit_ns,
+                });
+                recordMatrixRow(n, key_len, order, row);
+            }
+        }
+    }
+    std.debug.print("  (times in ns/op)\n", .{});
+
+    std.debug.print("\nNesting depth (getObj chain + getI64 / setI64 at the leaf)\n", .{});
+    std.debug.print("{s:>6} {s:>9} {s:>9}\n", .{ "depth", "get", "set" });
+    setGroup("depth");
+    var key: [32]u8 = undefined;
+    for (matrix_depths) |depth| {
+        const r = try benchDepth(depth);
+        std.debug.print("{d:>6} {d:>9.1} {d:>9.1}\n", .{ depth, r.get_ns, r.set_ns });
+        const get = [_]f64{r.get_ns};
+        const set = [_]f64{r.set_ns};
+        recordCase(try std.fmt.bufPrint(&key, "d{d}/get", .{depth}), "ns_per_op", depth_iterations, &get, null, null);
+        recordCase(try std.fmt.bufPrint(&key, "d{d}/set", .{depth}), "ns_per_op", depth_iterations, &set, null, null);
+    }
+}
+
+/// Record one matrix configuration as `matrix/<keys>/k<klen>/<order>/<op>`.
+/// Lookup figures are a single timed pass each.
+fn recordMatrixRow(n: u64, key_len: usize, order: Order, row: MatrixRow) void {
+    var key: [64]u8 = undefined;
+    const hit = [_]f64{row.hit_ns};
+    const miss = [_]f64{row.miss_ns};
+    const cold_hit = [_]f64{row.cold_hit_ns};
+    const ops = [_]struct { []const u8, u64, []const f64 }{
+        .{ "insert", row.insert_ops, row.insert_samples[0..row.insert_trials] },
+        .{ "hit", row.lookups, &hit },
+        .{ "miss", row.lookups, &miss },
+        .{ "cold_hit", row.lookups, &cold_hit },
+    };
+    for (ops) |op| {
+        const name = std.fmt.bufPrint(&key, "{d}/k{d}/{s}/{s}", .{ n, key_len, @tagName(order), op[0] }) catch unreachable;
+        recordCase(name, "ns_per_op", op[1], op[2], null, null);
+    }
+}
+
+/// Single-operation latency for the core calls, one histogram per call.
+const MicroOps = struct {
+    obj: lite3.Buffer,
+    arr: lite3.Buffer,
+    ctx: lite3.Context,
+
+    fn setI64(self: *MicroOps) !void {
+        try self.obj.setI64(lite3.root, "key", 42);
+    }
+
+    fn getI64(self: *MicroOps) !i64 {
+        return self.obj.getI64(lite3.root, "key");
+    }
+
+    fn setStr(self: *MicroOps) !void {
+        try self.obj.setStr(lite3.root, "str", "hello world benchmark string");
+    }
+
+    fn getStr(self: *MicroOps) ![]const u8 {
+        return self.obj.getStr(lite3.root, "str");
+    }
+
+    fn arrAppend(self: *MicroOps) !void {
+        try self.arr.arrAppendI64(lite3.root, 7);
+    }
+
+    fn ctxSet(self: *MicroOps) !void {
+        try self.ctx.setI64(lite3.root, "k", 1);
+    }
+};
+
+fn benchMicroLatency() !void {
+    const count: u64 = 100_000;
+    const obj_mem = try std.heap.page_allocator.alignedAlloc(u8, .@"4", 65536);
+    defer std.heap.page_allocator.free(obj_mem);
+    const arr_mem = try std.heap.page_allocator.alignedAlloc(u8, .@"4", 64 * 1024 * 1024);
+    defer std.heap.page_allocator.free(arr_mem);
+    var ops: MicroOps = .{
+        .obj = try lite3.Buffer.initObj(obj_mem),
+        .arr = try lite3.Buffer.initArr(arr_mem),
+        .ctx = try lite3.Context.init(),
+    };
+    defer ops.ctx.deinit();
+    try ops.ctx.resetObj();
+    try ops.setI64();
+    try ops.setStr();
+    std.debug.print("  (timer overhead {d} ns subtracted)\n", .{timer_overhead});
+    try benchLatency("set_i64", count, &ops, MicroOps.setI64);
+    try benchLatency("get_i64", count, &ops, MicroOps.getI64);
+    try benchLatency("set_str", count, &ops, MicroOps.setStr);
+    try benchLatency("get_str", count, &ops, MicroOps.getStr);
+    try benchLatency("arr_append", count, &ops, MicroOps.arrAppend);
+    try benchLatency("ctx_set", count, &ops, MicroOps.ctxSet);
+}
+
+// ---------------------------------------------------------------------------
+// Memory footprint
+//
+// Overwrites append and the space they replace is never reclaimed, so the
+// size a document reaches under updates matters as much as update speed.
+// "live" is the same content after a JSON round trip into a fresh context,
+// which is what a compaction pass could bring it back to.
+// ---------------------------------------------------------------------------
+
+const footprint_records = 200;
+const footprint_updates = 20_000;
+/// name, count, meta and meta's three fields.
+const footprint_entries_per_record = 6;
+
+const UpdateMix = enum { grow_strings, counters, replace_nested, mixed };
+
+const ContextKind = enum { context, managed, external };
+
+/// One of the growable contexts behind a common interface, counting how
+/// often its buffer was reallocated.
+fn FootprintDoc(comptime kind: ContextKind) type {
+    return struct {
+        doc: Doc,
+        allocator: std.mem.Allocator,
+        capacity: usize,
+        growths: usize = 0,
+
+        const Self = @This();
+        const Doc = switch (kind) {
+            .context => lite3.Context,
+            .managed => lite3.ManagedContext,
+            .external => lite3.ExternalContext,
+        };
+        const text = "x" ** 512;
+
+        fn init(allocator: std.mem.Allocator) !Self {
+            var doc = if (kind == .context) try lite3.Context.init() else try Doc.init(allocator);
+            errdefer if (kind == .external) doc.deinit(allocator) else doc.deinit();
+            try doc.resetObj();
+            return .{ .doc = doc, .allocator = allocator, .capacity = doc.capacity() };
+        }
+
+        fn deinit(self: *Self) void {
+            if (kind == .external) self.doc.deinit(self.allocator) else self.doc.deinit();
+        }
+
+        fn noteGrowth(self: *Self) void {
+            const cap = self.doc.capacity();
+            if (cap != self.capacity) self.growths += 1;
+            self.capacity = cap;
+        }
+
+        fn setI64(self: *Self, ofs: lite3.Offset, key: []const u8, value: i64) !void {
+            if (kind == .external) {
+                try self.doc.setI64(self.allocator, ofs, key, value);
+            } else {
+                try self.doc.setI64(ofs, key, value);
+            }
+            self.noteGrowth();
+        }
+
+        fn setStr(self: *Self, ofs: lite3.Offset, key: []const u8, value: []const u8) !void {
+            if (kind == .external) {
+                try self.doc.setStr(self.allocator, ofs, key, value);
+            } else {
+                try self.doc.setStr(ofs, key, value);
+            }
+            self.noteGrowth();
+        }
+
+        fn setObj(self: *Self, ofs: lite3.Offset, key: []const u8) !lite3.Offset {
+            const child = if (kind == .external)
+                try self.doc.setObj(self.allocator, ofs, key)
+            else
+                try self.doc.setObj(ofs, key);
+            self.noteGrowth();
+            return child;
+        }
+
+        fn fillMeta(self: *Self, record: lite3.Offset, i: usize) !void {
+            const meta = try self.setObj(record, "meta");
+            try self.setI64(meta, "version", @intCast(i));
+            try self.setStr(meta, "owner", "ingest-7");
+            try self.setI64(meta, "updated_at", 1_700_000_000 + @as(i64, @intCast(i)));
+        }
+
+        fn build(self: *Self) !void {
+            var key: [16]u8 = undefined;
+            for (0..footprint_records) |i| {
+                const record = try self.setObj(lite3.root, try std.fmt.bufPrint(&key, "r{d}", .{i}));
+                try self.setStr(record, "name", text[0..16]);
+                try self.setI64(record, "count", 0);
+                try self.fillMeta(record, i);
+            }
+        }
+
+        /// Apply `footprint_updates` random updates of `mix` to the records;
+        /// `.mixed` is 60% counters, 30% strings and 10% nested objects.
+        fn apply(self: *Self, mix: UpdateMix, rand: std.Random) !void {
+            var name_lens = [_]usize{16} ** footprint_records;
+            var key: [16]u8 = undefined;
+            for (0..footprint_updates) |_| {
+                const i = rand.uintLessThan(usize, footprint_records);
+                const record = try self.doc.getObj(lite3.root, try std.fmt.bufPrint(&key, "r{d}", .{i}));
+                const op: UpdateMix = if (mix != .mixed) mix else switch (rand.uintLessThan(u8, 10)) {
+                    0...5 => .counters,
+                    6...8 => .grow_strings,
+                    else => .replace_nested,
+                };
+                switch (op) {
+                    .grow_strings => {
+                        name_lens[i] = if (name_lens[i] >= 400) 16 else name_lens[i] + 16;
+                        try self.setStr(record, "name", text[0..name_lens[i]]);
+                    },
+                    .counters => try self.setI64(record, "count", try self.doc.getI64(record, "count") + 1),
+                    .replace_nested => try self.fillMeta(record, i),
+                    .mixed => unreachable,
+                }
+            }
+        }
+
+        /// Size of the same content decoded from JSON into a fresh context.
+        fn liveBytes(self: *const Self) !usize {
+            const json = try self.doc.jsonEncode(lite3.root);
+            defer json.deinit();
+            var fresh = try lite3.ManagedContext.init(self.allocator);
+            defer fresh.deinit();
+            try fresh.jsonDecode(json.slice());
+            return fresh.data().len;
+        }
+    };
+}
+
+fn footprintRow(comptime kind: ContextKind, allocator: std.mem.Allocator, mix: UpdateMix) !void {
+    var doc = try FootprintDoc(kind).init(allocator);
+    defer doc.deinit();
+    var prng = std.Random.DefaultPrng.init(0xb10a7);
+    try doc.build();
+    try doc.apply(mix, prng.random());
+    const used = doc.doc.data().len;
+    const live = try doc.liveBytes();
+    const entries = footprint_records * footprint_entries_per_record;
+    std.debug.print("  {s:<15} {s:<9} {d:>9} {d:>9} {d:>9} {d:>6.1}x {d:>8.1} {d:>7}\n", .{
+        @tagName(mix),
+        @tagName(kind),
+        used,
+        doc.capacity,
+        live,
+        @as(f64, @floatFromInt(used)) / @as(f64, @floatFromInt(live)),
+        @as(f64, @floatFromInt(used)) / @as(f64, @floatFromInt(entries)),
+        doc.growths,
+    });
+    // Deterministic, so every trial would report the same size.
+    var samples: [NUM_TRIALS]f64 = undefined;
+    @memset(&samples, @floatFromInt(used));
+    var key: [64]u8 = undefined;
+    recordCase(try std.fmt.bufPrint(&key, "{s}/{s}", .{ @tagName(mix), @tagName(kind) }), "bytes", footprint_updates, &samples, null, null);
+}
+
+fn benchFootprint(allocator: std.mem.Allocator) !void {
+    std.debug.print("  {d} records of {d} entries, {d} updates per mix; live = JSON round trip into a fresh context\n", .{
+        footprint_records,
+        footprint_entries_per_record,
+        footprint_updates,
+    });
+    std.debug.print("  {s:<15} {s:<9} {s:>9} {s:>9} {s:>9} {s:>7} {s:>8} {s:>7}\n", .{
+        "mix", "context", "used", "capacity", "live", "bloat", "B/entry", "growths",
+    });
+    for (std.enums.values(UpdateMix)) |mix| {
+        inline for (comptime std.enums.values(ContextKind)) |kind| try footprintRow(kind, allocator, mix);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Thread scaling
+//
+// Each worker repeats one operation a fixed number of times and the wall time
+// from releasing the workers to the last join gives aggregate throughput.
+// Building and encoding allocate through malloc (context API, yyjson) or a
+// Zig allocator, so flat curves there point at allocator contention; reads
+// compare one shared document against a private copy per thread.
+// ---------------------------------------------------------------------------
+
+const scaling_max_threads = 256;
+
+/// Per-thread state, aligned so that neighbouring threads never share a line.
+const ScalingSlot = struct {
+    arena: std.heap.ArenaAllocator align(std.atomic.cache_line),
+    message: lite3.Context,
+    mem: []align(4) u8,
+    view: lite3.ConstView,
+
+    fn init(allocator: std.mem.Allocator, bytes: []const u8, tid: usize) !ScalingSlot {
+        const mem = try allocator.alignedAlloc(u8, .@"4", bytes.len);
+        errdefer allocator.free(mem);
+        @memcpy(mem, bytes);
+        var message = try lite3.Context.init();
+        errdefer message.deinit();
+        try message.resetObj();
+        var prng = std.Random.DefaultPrng.init(tid);
+        try fillStatus(&message, lite3.root, prng.random(), tid);
+        return .{
+            .arena = .init(allocator),
+            .message = message,
+            .mem = mem,
+            .view = try lite3.ConstView.init(mem),
+        };
+    }
+
+    fn deinit(self: *ScalingSlot, allocator: std.mem.Allocator) void {
+        self.arena.deinit();
+        self.message.deinit();
+        allocator.free(self.mem);
+    }
+};
+
+const Scaling = struct {
+    allocator: std.mem.Allocator,
+    shared: *const Document,
+    /// One status as JSON, for the decode case.
+    json: []u8,
+    slots: []ScalingSlot,
+
+    fn init(allocator: std.mem.Allocator, shared: *const Document, threads: usize) !Scaling {
+        const slots = try allocator.alloc(ScalingSlot, threads);
+        var ready: usize = 0;
+        errdefer {
+            for (slots[0..ready]) |*slot| slot.deinit(allocator);
+            allocator.free(slots);
+        }
+        for (slots, 0..) |*slot, tid| {
+            slot.* = try ScalingSlot.init(allocator, shared.mem, tid);
+            ready += 1;
+        }
+        var json: []u8 = &.{};
+        if (lite3.json_enabled) {
+            const encoded = try slots[0].message.jsonEncode(lite3.root);
+            defer encoded.deinit();
+            json = try allocator.dupe(u8, encoded.slice());
+        }
+        return .{ .allocator = allocator, .shared = shared, .json = json, .slots = slots };
+    }
+
+    fn deinit(self: *Scaling) void {
+        for (self.slots) |*slot| slot.deinit(self.allocator);
+        self.allocator.free(self.slots);
+        self.allocator.free(self.json);
+    }
+
+    /// One status built in a fresh C context (malloc/realloc in the context API).
+    fn buildContext(self: *Scaling, tid: usize) !usize {
+        _ = self;
+        var ctx = try lite3.Context.init();
+        defer ctx.deinit();
+        try ctx.resetObj();
+        var prng = std.Random.DefaultPrng.init(tid);
+        try fillStatus(&ctx, lite3.root, prng.random(), tid);
+        return ctx.data().len;
+    }
+
+    /// The same through ManagedContext on the process-wide allocator.
+    fn buildManaged(self: *Scaling, tid: usize) !usize {
+        var doc = try lite3.ManagedContext.init(self.allocator);
+        defer doc.deinit();
+        var prng = std.Random.DefaultPrng.init(tid);
+        try fillStatus(&doc, lite3.root, prng.random(), tid);
+        return doc.data().len;
+    }
+
+    /// The same on a per-thread arena that is reset between messages.
+    fn buildArena(self: *Scaling, tid: usize) !usize {
+        const slot = &self.slots[tid];
+        _ = slot.arena.reset(.retain_capacity);
+        var doc = try lite3.ManagedContext.init(slot.arena.allocator());
+        defer doc.deinit();
+        var prng = std.Random.DefaultPrng.init(tid);
+        try fillStatus(&doc, lite3.root, prng.random(), tid);
+        return doc.data().len;
+    }
+
+    fn encodeJson(self: *Scaling, tid: usize) !usize {
+        const encoded = try self.slots[tid].message.jsonEncode(lite3.root);
+        defer encoded.deinit();
+        return encoded.slice().len;
+    }
+
+    fn decodeJson(self: *Scaling, tid: usize) !usize {
+        _ = tid;
+        var ctx = try lite3.Context.init();
+        defer ctx.deinit();
+        try ctx.jsonDecode(self.json);
+        return ctx.data().len;
+    }
+
+    fn readShared(self: *Scaling, tid: usize) !usize {
+        _ = tid;
+        var tasks: TwitterTasks(lite3.ConstView) = .{ .doc = &self.shared.view, .find_id = 0, .allocator = self.allocator };
+        return tasks.topTweet();
+    }
+
+    fn readPrivate(self: *Scaling, tid: usize) !usize {
+        var tasks: TwitterTasks(lite3.ConstView) = .{ .doc = &self.slots[tid].view, .find_id = 0, .allocator = self.allocator };
+        return tasks.topTweet();
+    }
+};
+
+/// Run `func(ctx, tid)` `ops` times on each of `threads` threads and return
+/// the wall time from releasing them to the last one finishing.
+fn runThreads(threads: usize, ops: u64, ctx: anytype, comptime func: anytype) !u64 {
+    const Worker = struct {
+        fn run(c: @TypeOf(ctx), tid: usize, n: u64, go: *std.Thread.ResetEvent, failed: *std.atomic.Value(bool)) void {
+            go.wait();
+            for (0..n) |_| {
+                const r = func(c, tid) catch {
+                    failed.store(true, .monotonic);
+                    return;
+                };
+                std.mem.doNotOptimizeAway(&r);
+            }
+        }
+    };
+    var go: std.Thread.ResetEvent = .{};
+    var failed = std.atomic.Value(bool).init(false);
+    var handles: [scaling_max_threads]std.Thread = undefined;
+    var spawned: usize = 0;
+    errdefer {
+        go.set();
+        for (handles[0..spawned]) |t| t.join();
+    }
+    for (0..threads) |tid| {
+        handles[tid] = try std.Thread.spawn(.{}, Worker.run, .{ ctx, tid, ops, &go, &failed });
+        spawned += 1;
+    }
+    var timer = try Timer.start();
+    go.set();
+    for (handles[0..spawned]) |t| t.join();
+    const elapsed = timer.read();
+    spawned = 0;
+    if (failed.load(.monotonic)) return error.WorkerFailed;
+    return elapsed;
+}
+
+/// Powers of two up to `max`, then `max` itself.
+fn nextThreadCount(n: usize, max: usize) usize {
+    return if (n < max and n * 2 > max) max else n * 2;
+}
+
+fn scaleCase(name: []const u8, ops: u64, max_threads: usize, ctx: anytype, comptime func: anytype) !void {
+    std.debug.print("  {s}\n", .{name});
+    var base: f64 = 0;
+    var threads: usize = 1;
+    while (threads <= max_threads) : (threads = nextThreadCount(threads, max_threads)) {
+        const total = ops * @as(u64, @intCast(threads));
+        _ = try runThreads(threads, @max(1, ops / 10), ctx, func); // warmup
+        var times: [NUM_TRIALS]u64 = undefined;
+        for (&times) |*t| t.* = try runThreads(threads, ops, ctx, func);
+        var samples: [NUM_TRIALS]f64 = undefined;
+        for (&samples, times) |*s, t| s.* = nsPerOp(total, t);
+        const rate = formatRate(total, medianOf(&times));
+        if (threads == 1) base = rate;
+        const speedup = rate / base;
+        std.debug.print("    {d:>3} threads {d:>12.0} ops/sec  {d:>11.0} per thread  x{d:.2} ({d:.0}% of linear)\n", .{
+            threads,
+            rate,
+            rate / @as(f64, @floatFromInt(threads)),
+            speedup,
+            speedup / @as(f64, @floatFromInt(threads)) * 100.0,
+        });
+        var key: [64]u8 = undefined;
+        recordCase(try std.fmt.bufPrint(&key, "{s}/t{d}", .{ name, threads }), "ns_per_op", total, &samples, null, null);
+    }
+}
+
+fn benchScaling(allocator: std.mem.Allocator, max_threads: usize) !void {
+    var doc = try generateTwitter(allocator, 100);
+    defer doc.deinit(allocator);
+    var scaling = try Scaling.init(allocator, &doc, max_threads);
+    defer scaling.deinit();
+    std.debug.print("  up to {d} threads on {d} CPUs; ops/sec summed over all threads\n", .{
+        max_threads,
+        std.Thread.getCpuCount() catch 1,
+    });
+    try scaleCase("build_context", 2_000, max_threads, &scaling, Scaling.buildContext);
+    try scaleCase("build_managed", 2_000, max_threads, &scaling, Scaling.buildManaged);
+    try scaleCase("build_arena", 2_000, max_threads, &scaling, Scaling.buildArena);
+    if (lite3.json_enabled) {
+        try scaleCase("encode_json", 2_000, max_threads, &scaling, Scaling.encodeJson);
+        try scaleCase("decode_json", 2_000, max_threads, &scaling, Scaling.decodeJson);
+    }
+    try scaleCase("read_shared", 2_000, max_threads, &scaling, Scaling.readShared);
+    try scaleCase("read_private", 2_000, max_threads, &scaling, Scaling.readPrivate);
+}
+
+const Args = struct {
+    twitter: ?[]const u8 = null,
+    kostya: ?[]const u8 = null,
+    matrix: bool = false,
+    threads: bool = false,
+    /// 0 means one per CPU.
+    max_threads: usize = 0,
+    counters: bool = true,
+    json: bool = false,
+    compare: ?[]const u8 = null,
+    threshold: f64 = 0.05,
+    max_keys: u64 = 10_000_000,
+    mem_limit: usize = 4 * 1024 * 1024 * 1024,
+
+    fn parse(args: []const [:0]u8) !Args {
+        var out: Args = .{};
+        var i: usize = 1;
+        while (i < args.len) : (i += 1) {
+            const arg = args[i];
+            if (std.mem.eql(u8, arg, "--twitter") and i + 1 < args.len) {
+                i += 1;
+                out.twitter = args[i];
+            } else if (std.mem.eql(u8, arg, "--kostya") and i + 1 < args.len) {
+                i += 1;
+                out.kostya = args[i];
+            } else if (std.mem.eql(u8, arg, "--matrix")) {
+                out.matrix = true;
+            } else if (std.mem.eql(u8, arg, "--threads")) {
+                out.threads = true;
+            } else if (std.mem.eql(u8, arg, "--max-threads") and i + 1 < args.len) {
+                i += 1;
+                out.max_threads = try std.fmt.parseInt(usize, args[i], 10);
+            } else if (std.mem.eql(u8, arg, "--no-counters")) {
+                out.counters = false;
+            } else if (std.mem.eql(u8, arg, "--json")) {
+                out.json = true;
+            } else if (std.mem.eql(u8, arg, "--compare") and i + 1 < args.len) {
+                i += 1;
+                out.compare = args[i];
+            } else if (std.mem.eql(u8, arg, "--threshold") and i + 1 < args.len) {
+                i += 1;
+                out.threshold = (try std.fmt.parseFloat(f64, args[i])) / 100.0;
+            } else if (std.mem.eql(u8, arg, "--max-keys") and i + 1 < args.len) {
+                i += 1;
+                out.max_keys = try std.fmt.parseInt(u64, args[i], 10);
+            } else if (std.mem.eql(u8, arg, "--mem-limit-mb") and i + 1 < args.len) {
+                i += 1;
+                out.mem_limit = (try std.fmt.parseInt(usize, args[i], 10)) * 1024 * 1024;
+            } else {
+                std.debug.print(
+                    \\usage: lite3-bench [--twitter twitter.json] [--kostya coordinates.json]
+                    \\                   [--matrix [--max-keys N] [--mem-limit-mb N]] [--no-counters]
+                    \\                   [--threads [--max-threads N]]
+                    \\                   [--json] [--compare baseline.json [--threshold PERCENT]]
+                    \\
+                , .{});
+                return error.InvalidArguments;
+            }
+        }
+        if (out.max_threads == 0) out.max_threads = std.Thread.getCpuCount() catch 1;
+        out.max_threads = @min(out.max_threads, scaling_max_threads);
+        return out;
+    }
+};
+
 pub fn main() !void {
+    const allocator = std.heap.smp_allocator;
+    const argv = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, argv);
+    const args = try Args.parse(argv);
+    if (args.matrix) {
+        try runMatrix(allocator, args.max_keys, args.mem_limit);
+    } else if (args.threads) {
+        std.debug.print("\nlite3-zig thread scaling ({d} trials each)\n", .{NUM_TRIALS});
+        std.debug.print("=========================================\n", .{});
+        section("Thread scaling", "threads");
+        try benchScaling(allocator, args.max_threads);
+    } else {
+        try runSuite(allocator, args);
+    }
+
+    std.debug.print("\nDone.\n", .{});
+
+    if (args.json) try writeJson();
+    if (args.compare) |path| {
+        if (try compareBaseline(allocator, path, args.threshold) != 0) std.process.exit(1);
+    }
+}
+
+fn runSuite(allocator: std.mem.Allocator, args: Args) !void {
     std.debug.print("\nlite3-zig benchmarks ({d} trials each)\n", .{NUM_TRIALS});
     std.debug.print("=========================================\n\n", .{});
+    if (args.counters) counters = Counters.open();
+    defer if (counters) |*c| c.close();
+    std.debug.print("Hardware counters: {s}\n", .{if (counters != null) "per op under each result" else "unavailable"});
+    try calibrateTimer();
 
-    std.debug.print("Set/Get:\n", .{});
+    section("Set/Get", "set_get");
     try benchSetGetI64();
     try benchSetGetStr();
 
-    std.debug.print("\nArray:\n", .{});
+    section("Array", "array");
     try benchArrayAppend();
 
-    std.debug.print("\nIteration:\n", .{});
+    section("Iteration", "iteration");
     try benchIterate();
 
-    std.debug.print("\nJSON:\n", .{});
+    section("JSON", "json");
     if (lite3.json_enabled) {
         try benchJsonRoundTrip();
     } else {
         std.debug.print("  disabled (-Djson=false)\n", .{});
     }
 
-    std.debug.print("\nBuffer vs Context:\n", .{});
+    section("Buffer vs Context", "buffer_vs_context");
     try benchContextVsBuffer();
 
-    std.debug.print("\nDone.\n", .{});
+    section("Latency (single operations)", "latency");
+    try benchMicroLatency();
+
+    section("Datasets (twitter tasks)", "twitter");
+    try benchTwitter(allocator, args.twitter);
+
+    section("Datasets (kostya coordinates)", "kostya");
+    try benchCoordinates(allocator, args.kostya);
+
+    section("Datasets (periodic table)", "periodic_table");
+    try benchPeriodicTable(allocator);
+
+    section("Compression (lz)", "lz");
+    try benchCompression(std.heap.page_allocator);
+
+    section("Memory footprint (update mixes)", "footprint");
+    if (lite3.json_enabled) {
+        try benchFootprint(allocator);
+    } else {
+        std.debug.print("  disabled (-Djson=false)\n", .{});
+    }
 }
@@ -152,6 +152,22 @@ pub const JsonString = struct {
     }
 };
 
+/// Options for the `jsonEncodeWithOptions` / `jsonDecodeWithOptions` family.
+pub const JsonOptions = struct {
+    /// Encode bytes as RFC 2397 data URIs (`"data:;base64,..."`) and decode
+    /// such strings back into bytes instead of strings.
+    bytes_data_uri: bool = false,
+    /// Pretty-print the encoded JSON. Ignored when decoding.
+    pretty: bool = false,
+
+    fn flags(self: JsonOptions) c_uint {
+        var f: c_uint = 0;
+        if (self.bytes_data_uri) f |= c.SHIM_LITE3_JSON_BYTES_DATA_URI;
+        if (self.pretty) f |= c.SHIM_LITE3_JSON_PRETTY;
+        return f;
+    }
+};
+
 // ---------------------------------------------------------------------------
 // Iterator (shared by Buffer and Context)
 // ---------------------------------------------------------------------------
@@ -238,12 +254,30 @@ fn SharedMethods(comptime Self: type) type {
             if (!is_ctx) self.len = saved;
         }
 
+        /// Report the bytes a write is about to change to the attached delta
+        /// tracker (Buffer only). `key` is null for appends.
+        inline fn noteWrite(self: *Self, ofs: Offset, key: ?[]const u8) Error!void {
+            if (!is_ctx) {
+                if (self.delta) |t| {
+                    if (key) |k| try t.noteSet(self, ofs, k) else try t.noteAppend(self, ofs);
+                }
+            }
+        }
+
+        /// Report a successful write to the attached op log (Buffer only).
+        inline fn logOp(self: *Self, ofs: Offset, key: ?[]const u8, value: Value) Error!void {
+            if (!is_ctx) {
+                if (self.oplog) |log| try log.record(self, ofs, key, value);
+            }
+        }
+
         // --- Set operations ---
 
         /// Set a null value for the given key.
         pub fn setNull(self: *Self, ofs: Offset, key: []const u8) Error!void {
             try ensureUsable(self);
             var kz = try toKeyZ(key);
+            try noteWrite(self, ofs, key);
             const saved = saveLen(self);
             const ret = if (is_ctx)
                 c.shim_lite3_ctx_set_null(self.raw(), @intFromEnum(ofs), &kz)
@@ -253,12 +287,14 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
+            try logOp(self, ofs, key, .null);
         }
 
         /// Set a boolean value for the given key.
         pub fn setBool(self: *Self, ofs: Offset, key: []const u8, value: bool) Error!void {
             try ensureUsable(self);
             var kz = try toKeyZ(key);
+            try noteWrite(self, ofs, key);
             const saved = saveLen(self);
             const ret = if (is_ctx)
                 c.shim_lite3_ctx_set_bool(self.raw(), @intFromEnum(ofs), &kz, value)
@@ -268,12 +304,14 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
+            try logOp(self, ofs, key, .{ .bool_ = value });
         }
 
         /// Set an i64 value for the given key.
         pub fn setI64(self: *Self, ofs: Offset, key: []const u8, value: i64) Error!void {
             try ensureUsable(self);
             var kz = try toKeyZ(key);
+            try noteWrite(self, ofs, key);
             const saved = saveLen(self);
             const ret = if (is_ctx)
                 c.shim_lite3_ctx_set_i64(self.raw(), @intFromEnum(ofs), &kz, value)
@@ -283,12 +321,14 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
+            try logOp(self, ofs, key, .{ .i64_ = value });
         }
 
         /// Set an f64 value for the given key.
         pub fn setF64(self: *Self, ofs: Offset, key: []const u8, value: f64) Error!void {
             try ensureUsable(self);
             var kz = try toKeyZ(key);
+            try noteWrite(self, ofs, key);
             const saved = saveLen(self);
             const ret = if (is_ctx)
                 c.shim_lite3_ctx_set_f64(self.raw(), @intFromEnum(ofs), &kz, value)
@@ -298,12 +338,14 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
+            try logOp(self, ofs, key, .{ .f64_ = value });
         }
 
         /// Set a string value for the given key.
         pub fn setStr(self: *Self, ofs: Offset, key: []const u8, value: []const u8) Error!void {
             try ensureUsable(self);
             var kz = try toKeyZ(key);
+            try noteWrite(self, ofs, key);
             const saved = saveLen(self);
             const ret = if (is_ctx)
                 c.shim_lite3_ctx_set_str(self.raw(), @intFromEnum(ofs), &kz, value.ptr, value.len)
@@ -313,12 +355,14 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
+            try logOp(self, ofs, key, .{ .string = value });
         }
 
         /// Set a bytes value for the given key.
         pub fn setBytes(self: *Self, ofs: Offset, key: []const u8, value: []const u8) Error!void {
             try ensureUsable(self);
             var kz = try toKeyZ(key);
+            try noteWrite(self, ofs, key);
             const saved = saveLen(self);
             const ret = if (is_ctx)
                 c.shim_lite3_ctx_set_bytes(self.raw(), @intFromEnum(ofs), &kz, value.ptr, value.len)
@@ -328,12 +372,14 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
+            try logOp(self, ofs, key, .{ .bytes = value });
         }
 
         /// Set a nested object for the given key. Returns the offset of the new object.
         pub fn setObj(self: *Self, ofs: Offset, key: []const u8) Error!Offset {
             try ensureUsable(self);
             var kz = try toKeyZ(key);
+            try noteWrite(self, ofs, key);
             const saved = saveLen(self);
             var out_ofs: usize = 0;
             const ret = if (is_ctx)
@@ -344,13 +390,16 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
-            return @enumFromInt(out_ofs);
+            const new_ofs: Offset = @enumFromInt(out_ofs);
+            try logOp(self, ofs, key, .{ .object = new_ofs });
+            return new_ofs;
         }
 
         /// Set a nested array for the given key. Returns the offset of the new array.
         pub fn setArr(self: *Self, ofs: Offset, key: []const u8) Error!Offset {
             try ensureUsable(self);
             var kz = try toKeyZ(key);
+            try noteWrite(self, ofs, key);
             const saved = saveLen(self);
             var out_ofs: usize = 0;
             const ret = if (is_ctx)
@@ -361,7 +410,9 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
-            return @enumFromInt(out_ofs);
+            const new_ofs: Offset = @enumFromInt(out_ofs);
+            try logOp(self, ofs, key, .{ .array = new_ofs });
+            return new_ofs;
         }
 
         // --- Get operations ---
@@ -517,6 +568,7 @@ fn SharedMethods(comptime Self: type) type {
         /// Append a null value to an array.
         pub fn arrAppendNull(self: *Self, ofs: Offset) Error!void {
             try ensureUsable(self);
+            try noteWrite(self, ofs, null);
             const saved = saveLen(self);
             const ret = if (is_ctx)
                 c.shim_lite3_ctx_arr_append_null(self.raw(), @intFromEnum(ofs))
@@ -526,11 +578,13 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
+            try logOp(self, ofs, null, .null);
         }
 
         /// Append a boolean value to an array.
         pub fn arrAppendBool(self: *Self, ofs: Offset, value: bool) Error!void {
             try ensureUsable(self);
+            try noteWrite(self, ofs, null);
             const saved = saveLen(self);
             const ret = if (is_ctx)
                 c.shim_lite3_ctx_arr_append_bool(self.raw(), @intFromEnum(ofs), value)
@@ -540,11 +594,13 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
+            try logOp(self, ofs, null, .{ .bool_ = value });
         }
 
         /// Append an i64 value to an array.
         pub fn arrAppendI64(self: *Self, ofs: Offset, value: i64) Error!void {
             try ensureUsable(self);
+            try noteWrite(self, ofs, null);
             const saved = saveLen(self);
             const ret = if (is_ctx)
                 c.shim_lite3_ctx_arr_append_i64(self.raw(), @intFromEnum(ofs), value)
@@ -554,11 +610,13 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
+            try logOp(self, ofs, null, .{ .i64_ = value });
         }
 
         /// Append an f64 value to an array.
         pub fn arrAppendF64(self: *Self, ofs: Offset, value: f64) Error!void {
             try ensureUsable(self);
+            try noteWrite(self, ofs, null);
             const saved = saveLen(self);
             const ret = if (is_ctx)
                 c.shim_lite3_ctx_arr_append_f64(self.raw(), @intFromEnum(ofs), value)
@@ -568,11 +626,13 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
+            try logOp(self, ofs, null, .{ .f64_ = value });
         }
 
         /// Append a string value to an array.
         pub fn arrAppendStr(self: *Self, ofs: Offset, value: []const u8) Error!void {
             try ensureUsable(self);
+            try noteWrite(self, ofs, null);
             const saved = saveLen(self);
             const ret = if (is_ctx)
                 c.shim_lite3_ctx_arr_append_str(self.raw(), @intFromEnum(ofs), value.ptr, value.len)
@@ -582,11 +642,13 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
+            try logOp(self, ofs, null, .{ .string = value });
         }
 
         /// Append a bytes value to an array.
         pub fn arrAppendBytes(self: *Self, ofs: Offset, value: []const u8) Error!void {
             try ensureUsable(self);
+            try noteWrite(self, ofs, null);
             const saved = saveLen(self);
             const ret = if (is_ctx)
                 c.shim_lite3_ctx_arr_append_bytes(self.raw(), @intFromEnum(ofs), value.ptr, value.len)
@@ -596,11 +658,13 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
+            try logOp(self, ofs, null, .{ .bytes = value });
         }
 
         /// Append a nested object to an array. Returns the offset of the new object.
         pub fn arrAppendObj(self: *Self, ofs: Offset) Error!Offset {
             try ensureUsable(self);
+            try noteWrite(self, ofs, null);
             const saved = saveLen(self);
             var out_ofs: usize = 0;
             const ret = if (is_ctx)
@@ -611,12 +675,15 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
-            return @enumFromInt(out_ofs);
+            const new_ofs: Offset = @enumFromInt(out_ofs);
+            try logOp(self, ofs, null, .{ .object = new_ofs });
+            return new_ofs;
         }
 
         /// Append a nested array to an array. Returns the offset of the new array.
         pub fn arrAppendArr(self: *Self, ofs: Offset) Error!Offset {
             try ensureUsable(self);
+            try noteWrite(self, ofs, null);
             const saved = saveLen(self);
             var out_ofs: usize = 0;
             const ret = if (is_ctx)
@@ -627,7 +694,66 @@ fn SharedMethods(comptime Self: type) type {
                 restoreLen(self, saved);
                 return translateError(ret);
             }
-            return @enumFromInt(out_ofs);
+            const new_ofs: Offset = @enumFromInt(out_ofs);
+            try logOp(self, ofs, null, .{ .array = new_ofs });
+            return new_ofs;
+        }
+
+        // --- Reserve-and-fill operations ---
+
+        /// Set `key` to a bytes value of `len` bytes and return the payload
+        /// slice inside the buffer for the caller to fill in place (e.g. with
+        /// `read()` or a decompressor). The contents are uninitialized.
+        /// WARNING: The slice is invalidated by any subsequent mutation.
+        pub fn setBytesReserve(self: *Self, ofs: Offset, key: []const u8, len: usize) Error![]u8 {
+            return reserveLenPrefixed(self, ofs, key, .bytes, len);
+        }
+
+        /// Like `setBytesReserve`, for a string of `len` bytes. The NUL
+        /// terminator is written; the caller must not write NUL bytes.
+        pub fn setStrReserve(self: *Self, ofs: Offset, key: []const u8, len: usize) Error![]u8 {
+            return reserveLenPrefixed(self, ofs, key, .string, len);
+        }
+
+        /// Append a bytes value of `len` bytes to an array and return its
+        /// payload slice. See `setBytesReserve`.
+        pub fn arrAppendBytesReserve(self: *Self, ofs: Offset, len: usize) Error![]u8 {
+            return reserveLenPrefixed(self, ofs, null, .bytes, len);
+        }
+
+        /// Append a string of `len` bytes to an array and return its payload
+        /// slice. See `setStrReserve`.
+        pub fn arrAppendStrReserve(self: *Self, ofs: Offset, len: usize) Error![]u8 {
+            return reserveLenPrefixed(self, ofs, null, .string, len);
+        }
+
+        fn reserveLenPrefixed(self: *Self, ofs: Offset, key: ?[]const u8, t: Type, len: usize) Error![]u8 {
+            try ensureUsable(self);
+            const stored = if (t == .string) len +| 1 else len;
+            const n = std.math.cast(u32, stored) orelse return Error.InvalidArgument;
+            const payload_len = @as(usize, 4) + stored;
+            try noteWrite(self, ofs, key);
+            var val_ofs: usize = 0;
+            const saved = saveLen(self);
+            const ret = if (key) |k| blk: {
+                var kz = try toKeyZ(k);
+                const kd = KeyData.of(k);
+                break :blk if (is_ctx)
+                    c.shim_lite3_ctx_set_val_kd(self.raw(), @intFromEnum(ofs), &kz, kd.hash, kd.size, @intFromEnum(t), payload_len, &val_ofs)
+                else
+                    c.shim_lite3_set_val_kd(self.buf, &self.len, @intFromEnum(ofs), self.capacity, &kz, kd.hash, kd.size, @intFromEnum(t), payload_len, &val_ofs);
+            } else if (is_ctx)
+                c.shim_lite3_ctx_arr_append_val(self.raw(), @intFromEnum(ofs), @intFromEnum(t), payload_len, &val_ofs)
+            else
+                c.shim_lite3_arr_append_val(self.buf, &self.len, @intFromEnum(ofs), self.capacity, @intFromEnum(t), payload_len, &val_ofs);
+            if (ret < 0) {
+                restoreLen(self, saved);
+                return translateError(ret);
+            }
+            const base: [*]u8 = if (is_ctx) @constCast(self.bufPtr()) else self.buf;
+            std.mem.writeInt(u32, base[val_ofs + 1 ..][0..4], n, .little);
+            if (t == .string) base[val_ofs + 5 + len] = 0;
+            return base[val_ofs + 5 ..][0..len];
         }
 
         // --- Array get operations ---
@@ -822,6 +948,20 @@ fn SharedMethods(comptime Self: type) type {
             return translateErrno();
         }
 
+        /// Encode the buffer contents as a JSON string using `opts`.
+        /// The returned `JsonString` is allocated by the C library and must be freed with `.deinit()`.
+        pub fn jsonEncodeWithOptions(self: *const Self, ofs: Offset, opts: JsonOptions) Error!JsonString {
+            try ensureUsable(self);
+            if (!json_enabled) return Error.InvalidArgument;
+            const buf_ptr: [*]const u8 = if (is_ctx) c.shim_lite3_ctx_buf(self.raw()) else self.buf;
+            const buf_len: usize = if (is_ctx) c.shim_lite3_ctx_buflen(self.raw()) else self.len;
+            var out_len: usize = 0;
+            std.c._errno().* = 0;
+            const ptr: ?[*]u8 = @ptrCast(c.shim_lite3_json_enc_opts(buf_ptr, buf_len, @intFromEnum(ofs), opts.flags(), &out_len));
+            if (ptr) |p| return JsonString{ .ptr = p, .len = out_len };
+            return translateErrno();
+        }
+
         /// Get the value at the given key as a tagged union.
         /// WARNING: String and bytes slices point into the buffer; see getStr safety notes.
         pub fn getValue(self: *const Self, ofs: Offset, key: []const u8) Error!Value {
@@ -854,6 +994,10 @@ pub const Buffer = struct {
     buf: [*]u8,
     len: usize,
     capacity: usize,
+    /// Optional change feed; see `OpLog`.
+    oplog: ?*OpLog = null,
+    /// Optional write tracker; see `DeltaTracker`.
+    delta: ?*DeltaTracker = null,
 
     // Import shared methods
     pub const setNull = SharedMethods(Buffer).setNull;
@@ -883,6 +1027,10 @@ pub const Buffer = struct {
     pub const arrAppendBytes = SharedMethods(Buffer).arrAppendBytes;
     pub const arrAppendObj = SharedMethods(Buffer).arrAppendObj;
     pub const arrAppendArr = SharedMethods(Buffer).arrAppendArr;
+    pub const setBytesReserve = SharedMethods(Buffer).setBytesReserve;
+    pub const setStrReserve = SharedMethods(Buffer).setStrReserve;
+    pub const arrAppendBytesReserve = SharedMethods(Buffer).arrAppendBytesReserve;
+    pub const arrAppendStrReserve = SharedMethods(Buffer).arrAppendStrReserve;
     pub const arrGetBool = SharedMethods(Buffer).arrGetBool;
     pub const arrGetI64 = SharedMethods(Buffer).arrGetI64;
     pub const arrGetF64 = SharedMethods(Buffer).arrGetF64;
@@ -897,6 +1045,7 @@ pub const Buffer = struct {
     pub const iterate = SharedMethods(Buffer).iterate;
     pub const jsonEncode = SharedMethods(Buffer).jsonEncode;
     pub const jsonEncodePretty = SharedMethods(Buffer).jsonEncodePretty;
+    pub const jsonEncodeWithOptions = SharedMethods(Buffer).jsonEncodeWithOptions;
     pub const getValue = SharedMethods(Buffer).getValue;
 
     // Buffer-specific methods
@@ -955,6 +1104,19 @@ pub const Buffer = struct {
         };
     }
 
+    /// Decode a JSON string into a buffer using `opts`, reinitializing it.
+    pub fn jsonDecodeWithOptions(mem: []align(4) u8, json: []const u8, opts: JsonOptions) Error!Buffer {
+        if (!json_enabled) return Error.InvalidArgument;
+        var buflen: usize = 0;
+        const ret = c.shim_lite3_json_dec_opts(mem.ptr, &buflen, mem.len, json.ptr, json.len, opts.flags());
+        if (ret < 0) return translateError(ret);
+        return Buffer{
+            .buf = mem.ptr,
+            .len = buflen,
+            .capacity = mem.len,
+        };
+    }
+
     /// Encode the buffer contents as JSON into a caller-supplied buffer.
     /// Returns the number of bytes written.
     pub fn jsonEncodeBuf(self: *const Buffer, ofs: Offset, out: []u8) Error!usize {
@@ -1017,6 +1179,10 @@ pub const Context = struct {
     pub const arrAppendBytes = SharedMethods(Context).arrAppendBytes;
     pub const arrAppendObj = SharedMethods(Context).arrAppendObj;
     pub const arrAppendArr = SharedMethods(Context).arrAppendArr;
+    pub const setBytesReserve = SharedMethods(Context).setBytesReserve;
+    pub const setStrReserve = SharedMethods(Context).setStrReserve;
+    pub const arrAppendBytesReserve = SharedMethods(Context).arrAppendBytesReserve;
+    pub const arrAppendStrReserve = SharedMethods(Context).arrAppendStrReserve;
     pub const arrGetBool = SharedMethods(Context).arrGetBool;
     pub const arrGetI64 = SharedMethods(Context).arrGetI64;
     pub const arrGetF64 = SharedMethods(Context).arrGetF64;
@@ -1031,6 +1197,7 @@ pub const Context = struct {
     pub const iterate = SharedMethods(Context).iterate;
     pub const jsonEncode = SharedMethods(Context).jsonEncode;
     pub const jsonEncodePretty = SharedMethods(Context).jsonEncodePretty;
+    pub const jsonEncodeWithOptions = SharedMethods(Context).jsonEncodeWithOptions;
     pub const getValue = SharedMethods(Context).getValue;
 
     // Context-specific methods
@@ -1081,6 +1248,13 @@ pub const Context = struct {
         return buf[0..buflen];
     }
 
+    /// Return the current backing capacity in bytes; it grows as writes
+    /// need more space.
+    pub fn capacity(self: *const Context) usize {
+        if (self.ctx == null) return 0;
+        return c.shim_lite3_ctx_bufsz(self.raw());
+    }
+
     /// Reset the context root value to an object.
     pub fn resetObj(self: *Context) Error!void {
         try self.ensureAlive();
@@ -1103,6 +1277,14 @@ pub const Context = struct {
         if (ret < 0) return translateError(ret);
     }
 
+    /// Decode a JSON string into this context using `opts`.
+    pub fn jsonDecodeWithOptions(self: *Context, json: []const u8, opts: JsonOptions) Error!void {
+        if (!json_enabled) return Error.InvalidArgument;
+        try self.ensureAlive();
+        const ret = c.shim_lite3_ctx_json_dec_opts(self.raw(), json.ptr, json.len, opts.flags());
+        if (ret < 0) return translateError(ret);
+    }
+
     /// Import data from an existing buffer into this context.
     pub fn importFromBuf(self: *Context, buf: []const u8) Error!void {
         try self.ensureAlive();
@@ -1191,6 +1373,23 @@ pub const ManagedContext = struct {
         }
     }
 
+    /// Replace the buffer wholesale, keeping any attached op log and delta
+    /// tracker. Offsets the log has cached no longer apply.
+    fn replaceInner(self: *ManagedContext, b: Buffer) void {
+        const log = self.inner.oplog;
+        const delta = self.inner.delta;
+        self.inner = b;
+        self.inner.oplog = log;
+        self.inner.delta = delta;
+        if (log) |l| l.forgetPaths();
+    }
+
+    /// Mark the whole checkpointed prefix as changed before the buffer is
+    /// rewritten wholesale.
+    fn noteReplace(self: *ManagedContext) Error!void {
+        if (self.inner.delta) |t| try t.noteRange(0, t.base_len);
+    }
+
     /// Initialize a new managed context with default capacity.
     pub fn init(allocator: std.mem.Allocator) Error!ManagedContext {
         return initWithCapacity(allocator, default_capacity);
@@ -1243,42 +1442,84 @@ pub const ManagedContext = struct {
         return self.innerBufConst().capacity;
     }
 
+    /// Ensure at least `additional` bytes are available past the current length,
+    /// so that subsequent writes of that size do not reallocate.
+    pub fn reserve(self: *ManagedContext, additional: usize) Error!void {
+        try self.ensureAlive();
+        const required = std.math.add(usize, self.inner.len, additional) catch return Error.InvalidArgument;
+        try self.ensureCapacity(required);
+    }
+
+    /// Attach (or with null, detach) an op log that records every set and
+    /// append made through this context; see `OpLog`.
+    pub fn setOpLog(self: *ManagedContext, log: ?*OpLog) void {
+        self.inner.oplog = log;
+    }
+
+    /// Attach (or with null, detach) a delta tracker that notes every write
+    /// made through this context; see `DeltaTracker`.
+    pub fn setDeltaTracker(self: *ManagedContext, tracker: ?*DeltaTracker) void {
+        self.inner.delta = tracker;
+    }
+
     /// Reset the root value to an object.
     pub fn resetObj(self: *ManagedContext) Error!void {
         try self.ensureAlive();
-        self.inner = try Buffer.initObj(self.storageSlice());
+        try self.noteReplace();
+        self.replaceInner(try Buffer.initObj(self.storageSlice()));
     }
 
     /// Reset the root value to an array.
     pub fn resetArr(self: *ManagedContext) Error!void {
         try self.ensureAlive();
-        self.inner = try Buffer.initArr(self.storageSlice());
+        try self.noteReplace();
+        self.replaceInner(try Buffer.initArr(self.storageSlice()));
     }
 
     /// Replace contents with an existing Lite3 buffer.
     pub fn importFromBuf(self: *ManagedContext, src: []const u8) Error!void {
         if (src.len == 0) return Error.InvalidArgument;
         try self.ensureCapacity(src.len);
+        try self.noteReplace();
         const mem = self.storageSlice();
         @memcpy(mem[0..src.len], src);
-        self.inner.buf = mem.ptr;
-        self.inner.len = src.len;
-        self.inner.capacity = mem.len;
+        self.replaceInner(.{ .buf = mem.ptr, .len = src.len, .capacity = mem.len });
     }
 
     /// Decode JSON into the managed buffer, growing as needed.
     pub fn jsonDecode(self: *ManagedContext, json: []const u8) Error!void {
         if (!json_enabled) return Error.InvalidArgument;
         try self.ensureAlive();
+        try self.noteReplace();
         while (true) {
             const mem = self.storageSlice();
-            self.inner = Buffer.jsonDecode(mem, json) catch |err| switch (err) {
+            const decoded = Buffer.jsonDecode(mem, json) catch |err| switch (err) {
+                Error.NoBufferSpace => {
+                    try self.grow();
+                    continue;
+                },
+                else => return err,
+            };
+            self.replaceInner(decoded);
+            return;
+        }
+    }
+
+    /// Decode JSON into the managed buffer using `opts`, growing as needed.
+    pub fn jsonDecodeWithOptions(self: *ManagedContext, json: []const u8, opts: JsonOptions) Error!void {
+        if (!json_enabled) return Error.InvalidArgument;
+        try self.ensureAlive();
+        try self.noteReplace();
+        while (true) {
+            const mem = self.storageSlice();
+            const decoded = Buffer.jsonDecodeWithOptions(mem, json, opts) catch |err| switch (err) {
                 Error.NoBufferSpace => {
                     try self.grow();
                     continue;
                 },
                 else => return err,
             };
+            self.replaceInner(decoded);
             return;
         }
     }
@@ -1341,6 +1582,22 @@ pub const ManagedContext = struct {
         return self.callWithGrowth(Buffer.arrAppendBytes, .{ self.innerBuf(), ofs, value });
     }
 
+    pub fn setBytesReserve(self: *ManagedContext, ofs: Offset, key: []const u8, len: usize) Error![]u8 {
+        return self.callWithGrowth(Buffer.setBytesReserve, .{ self.innerBuf(), ofs, key, len });
+    }
+
+    pub fn setStrReserve(self: *ManagedContext, ofs: Offset, key: []const u8, len: usize) Error![]u8 {
+        return self.callWithGrowth(Buffer.setStrReserve, .{ self.innerBuf(), ofs, key, len });
+    }
+
+    pub fn arrAppendBytesReserve(self: *ManagedContext, ofs: Offset, len: usize) Error![]u8 {
+        return self.callWithGrowth(Buffer.arrAppendBytesReserve, .{ self.innerBuf(), ofs, len });
+    }
+
+    pub fn arrAppendStrReserve(self: *ManagedContext, ofs: Offset, len: usize) Error![]u8 {
+        return self.callWithGrowth(Buffer.arrAppendStrReserve, .{ self.innerBuf(), ofs, len });
+    }
+
     pub fn arrAppendObj(self: *ManagedContext, ofs: Offset) Error!Offset {
         return self.callWithGrowth(Buffer.arrAppendObj, .{ self.innerBuf(), ofs });
     }
@@ -1451,6 +1708,10 @@ pub const ManagedContext = struct {
         return self.innerBufConst().jsonEncodePretty(ofs);
     }
 
+    pub fn jsonEncodeWithOptions(self: *const ManagedContext, ofs: Offset, opts: JsonOptions) Error!JsonString {
+        return self.innerBufConst().jsonEncodeWithOptions(ofs, opts);
+    }
+
     pub fn jsonEncodeBuf(self: *const ManagedContext, ofs: Offset, out: []u8) Error!usize {
         return self.innerBufConst().jsonEncodeBuf(ofs, out);
     }
@@ -1637,6 +1898,23 @@ pub const ExternalContext = struct {
         }
     }
 
+    /// Decode JSON into the external buffer using `opts`, growing as needed.
+    pub fn jsonDecodeWithOptions(self: *ExternalContext, allocator: std.mem.Allocator, json: []const u8, opts: JsonOptions) Error!void {
+        if (!json_enabled) return Error.InvalidArgument;
+        try self.ensureAlive();
+        while (true) {
+            const mem = self.storageSlice();
+            self.inner = Buffer.jsonDecodeWithOptions(mem, json, opts) catch |err| switch (err) {
+                Error.NoBufferSpace => {
+                    try self.grow(allocator);
+                    continue;
+                },
+                else => return err,
+            };
+            return;
+        }
+    }
+
     // --- Mutating operations (auto-grow on NoBufferSpace) ---
 
     pub fn setNull(self: *ExternalContext, allocator: std.mem.Allocator, ofs: Offset, key: []const u8) Error!void {
@@ -1695,6 +1973,22 @@ pub const ExternalContext = struct {
         return self.callWithGrowth(allocator, Buffer.arrAppendBytes, .{ self.innerBuf(), ofs, value });
     }
 
+    pub fn setBytesReserve(self: *ExternalContext, allocator: std.mem.Allocator, ofs: Offset, key: []const u8, len: usize) Error![]u8 {
+        return self.callWithGrowth(allocator, Buffer.setBytesReserve, .{ self.innerBuf(), ofs, key, len });
+    }
+
+    pub fn setStrReserve(self: *ExternalContext, allocator: std.mem.Allocator, ofs: Offset, key: []const u8, len: usize) Error![]u8 {
+        return self.callWithGrowth(allocator, Buffer.setStrReserve, .{ self.innerBuf(), ofs, key, len });
+    }
+
+    pub fn arrAppendBytesReserve(self: *ExternalContext, allocator: std.mem.Allocator, ofs: Offset, len: usize) Error![]u8 {
+        return self.callWithGrowth(allocator, Buffer.arrAppendBytesReserve, .{ self.innerBuf(), ofs, len });
+    }
+
+    pub fn arrAppendStrReserve(self: *ExternalContext, allocator: std.mem.Allocator, ofs: Offset, len: usize) Error![]u8 {
+        return self.callWithGrowth(allocator, Buffer.arrAppendStrReserve, .{ self.innerBuf(), ofs, len });
+    }
+
     pub fn arrAppendObj(self: *ExternalContext, allocator: std.mem.Allocator, ofs: Offset) Error!Offset {
         return self.callWithGrowth(allocator, Buffer.arrAppendObj, .{ self.innerBuf(), ofs });
     }
@@ -1805,6 +2099,10 @@ pub const ExternalContext = struct {
         return self.innerBufConst().jsonEncodePretty(ofs);
     }
 
+    pub fn jsonEncodeWithOptions(self: *const ExternalContext, ofs: Offset, opts: JsonOptions) Error!JsonString {
+        return self.innerBufConst().jsonEncodeWithOptions(ofs, opts);
+    }
+
     pub fn jsonEncodeBuf(self: *const ExternalContext, ofs: Offset, out: []u8) Error!usize {
         return self.innerBufConst().jsonEncodeBuf(ofs, out);
     }
@@ -1813,3 +2111,3799 @@ pub const ExternalContext = struct {
         return self.innerBufConst().getValue(ofs, key);
     }
 };
+
+// ---------------------------------------------------------------------------
+// Precomputed keys and raw value slots
+// ---------------------------------------------------------------------------
+
+/// DJB2 hash and NUL-inclusive size of a key, identical to `lite3_get_key_data()`.
+/// Evaluate with a comptime-known key to move hashing out of the hot path.
+pub const KeyData = struct {
+    hash: u32,
+    size: u32,
+
+    pub fn of(key: []const u8) KeyData {
+        var h: u32 = 5381;
+        for (key) |ch| h = h *% 33 +% ch;
+        return .{ .hash = h, .size = @intCast(key.len + 1) };
+    }
+};
+
+/// Size in bytes of a Lite3 B-tree node (object/array header).
+const node_size: usize = 96;
+/// Maximum number of keys in a node before it splits.
+const node_key_count_max: usize = 7;
+/// Minimum number of keys left in each half after a split.
+const node_key_count_min: usize = 3;
+
+/// Raw value slot access with precomputed key data. Returned offsets point at
+/// the value's type byte; the payload follows immediately (for objects and
+/// arrays the offset is the node itself).
+const raw_slot = struct {
+    fn get(b: *const Buffer, ofs: Offset, key_z: [*:0]const u8, kd: KeyData) Error!usize {
+        var val_ofs: usize = 0;
+        const ret = c.shim_lite3_get_val_kd(b.buf, b.len, @intFromEnum(ofs), key_z, kd.hash, kd.size, &val_ofs);
+        if (ret < 0) return translateError(ret);
+        return val_ofs;
+    }
+
+    fn arrGet(b: *const Buffer, ofs: Offset, index: u32) Error!usize {
+        var val_ofs: usize = 0;
+        const ret = c.shim_lite3_arr_get_val(b.buf, b.len, @intFromEnum(ofs), index, &val_ofs);
+        if (ret < 0) return translateError(ret);
+        return val_ofs;
+    }
+
+    fn set(b: *Buffer, ofs: Offset, key_z: [*:0]const u8, kd: KeyData, t: Type, payload_len: usize) Error!usize {
+        if (b.delta) |tracker| try tracker.footprint(b.*, ofs, key_z, kd.hash, kd.size);
+        var val_ofs: usize = 0;
+        const saved = b.len;
+        const ret = c.shim_lite3_set_val_kd(b.buf, &b.len, @intFromEnum(ofs), b.capacity, key_z, kd.hash, kd.size, @intFromEnum(t), payload_len, &val_ofs);
+        if (ret < 0) {
+            b.len = saved;
+            return translateError(ret);
+        }
+        return val_ofs;
+    }
+
+    fn arrAppend(b: *Buffer, ofs: Offset, t: Type, payload_len: usize) Error!usize {
+        if (b.delta) |tracker| try tracker.noteAppend(b, ofs);
+        var val_ofs: usize = 0;
+        const saved = b.len;
+        const ret = c.shim_lite3_arr_append_val(b.buf, &b.len, @intFromEnum(ofs), b.capacity, @intFromEnum(t), payload_len, &val_ofs);
+        if (ret < 0) {
+            b.len = saved;
+            return translateError(ret);
+        }
+        return val_ofs;
+    }
+
+    /// Read the string or bytes payload at `val_ofs` (type already checked).
+    /// A length prefix that runs past the buffer, or a string without its
+    /// terminator, is `CorruptData`.
+    fn lenPrefixed(b: *const Buffer, val_ofs: usize, t: Type) Error![]const u8 {
+        if (val_ofs >= b.len or b.len - val_ofs < 5) return Error.CorruptData;
+        const n = std.mem.readInt(u32, b.buf[val_ofs + 1 ..][0..4], .little);
+        if (n > b.len - val_ofs - 5) return Error.CorruptData;
+        if (t == .string and n == 0) return Error.CorruptData;
+        const len = if (t == .string) n - 1 else n;
+        return b.buf[val_ofs + 5 ..][0..len];
+    }
+
+    /// Generation of the container node at `ofs`, or 0 if it is out of bounds.
+    fn genOf(b: *const Buffer, ofs: Offset) u32 {
+        const o = @intFromEnum(ofs);
+        if (o >= b.len or b.len - o < node_size) return 0;
+        return std.mem.readInt(u32, b.buf[o..][0..4], .little) >> 8;
+    }
+
+    /// Whether a value whose fixed-size part fits in the buffer sits at
+    /// `val_ofs`, directly after the entry for `key` (allowing for the up to
+    /// 3 bytes of alignment padding before node-sized values).
+    fn entryEndsAt(b: *const Buffer, val_ofs: usize, key: [:0]const u8) bool {
+        if (val_ofs >= b.len) return false;
+        const fixed: usize = switch (typeAt(b, val_ofs)) {
+            .null => 0,
+            .bool_ => 1,
+            .i64_, .f64_ => 8,
+            .bytes, .string => 4,
+            .object, .array => node_size - 1,
+            .invalid => return false,
+        };
+        if (b.len - val_ofs - 1 < fixed) return false;
+        for (0..4) |pad| {
+            if (val_ofs < key.len + 1 + pad) return false;
+            const start = val_ofs - pad - key.len - 1;
+            if (std.mem.eql(u8, b.buf[start..][0..key.len], key) and b.buf[start + key.len] == 0) return true;
+        }
+        return false;
+    }
+
+    fn typeAt(b: *const Buffer, val_ofs: usize) Type {
+        const t = b.buf[val_ofs];
+        return if (t < Type.max_valid) @enumFromInt(t) else .invalid;
+    }
+};
+
+/// Borrow a read-only `Buffer` view over any container type.
+fn constBufferOf(src: anytype) Buffer {
+    return switch (@TypeOf(src)) {
+        *Buffer, *const Buffer => src.*,
+        *ManagedContext, *const ManagedContext, *ExternalContext, *const ExternalContext => src.inner,
+        *Context, *const Context => blk: {
+            const d = src.data();
+            break :blk .{ .buf = @constCast(d.ptr), .len = d.len, .capacity = d.len };
+        },
+        else => @compileError("expected a pointer to Buffer, Context, ManagedContext or ExternalContext, found " ++ @typeName(@TypeOf(src))),
+    };
+}
+
+// ---------------------------------------------------------------------------
+// Comptime struct serialization
+// ---------------------------------------------------------------------------
+
+/// Serialize `value` into `mctx`, replacing its contents with an object whose
+/// keys are the field names of `T`.
+///
+/// Field mapping: bool, integers (must fit i64), floats (stored as f64),
+/// enums (tag name as string), `[]const u8` (string), `[N]u8` (bytes), other
+/// slices and arrays (Lite3 arrays), nested structs (objects) and optionals
+/// (null). Key hashes are computed at compile time and the buffer is reserved
+/// once up front via `serializedSize`.
+pub fn serialize(comptime T: type, value: T, mctx: *ManagedContext) Error!void {
+    if (@typeInfo(T) != .@"struct") @compileError("lite3.serialize expects a struct, found " ++ @typeName(T));
+    try mctx.resetObj();
+    try mctx.reserve(serializedSize(T, value) - node_size);
+    try serdes.writeFields(T, mctx, root, value);
+}
+
+/// Upper bound on the bytes `serialize` produces for `value`: entries are
+/// counted exactly, plus worst-case allowances for node splits and for the
+/// alignment padding lite3 inserts before nodes and node-sized payloads.
+pub fn serializedSize(comptime T: type, value: T) usize {
+    if (@typeInfo(T) != .@"struct") @compileError("lite3.serializedSize expects a struct, found " ++ @typeName(T));
+    return node_size + serdes.containerSize(T, value);
+}
+
+/// Deserialize the object at `ofs` into a `T`. Strings are borrowed from the
+/// buffer and are invalidated by any mutation. Missing keys fall back to the
+/// field's default value, then to `null` for optionals, else `Error.NotFound`.
+/// Types that need allocation (slices of non-`u8`) require `deserializeAlloc`.
+///
+/// `src` is a pointer to a `Buffer`, `Context`, `ManagedContext` or `ExternalContext`.
+pub fn deserialize(comptime T: type, src: anytype, ofs: Offset) Error!T {
+    if (comptime serdes.needsAlloc(T)) @compileError(@typeName(T) ++ " contains slices that must be allocated; use lite3.deserializeAlloc");
+    const b = constBufferOf(src);
+    return serdes.readRoot(T, null, &b, ofs);
+}
+
+/// Like `deserialize`, but allocates slices of non-`u8` element types with
+/// `allocator`. Strings are still borrowed from the buffer. An arena is the
+/// intended allocator; on error, partially built slices are not freed.
+pub fn deserializeAlloc(comptime T: type, allocator: std.mem.Allocator, src: anytype, ofs: Offset) Error!T {
+    const b = constBufferOf(src);
+    return serdes.readRoot(T, allocator, &b, ofs);
+}
+
+const serdes = struct {
+    // --- Sizing ---
+
+    fn keyTagSize(key_size: usize) usize {
+        if (key_size == 0) return 0;
+        if (key_size < 64) return 1;
+        if (key_size < 16384) return 2;
+        return 4;
+    }
+
+    /// Bytes for a string or bytes value with an `n`-byte payload. lite3
+    /// aligns any value whose payload is exactly node-sized like a node.
+    fn lenPrefixedSize(n: usize) usize {
+        const payload = 4 + n;
+        return if (payload == node_size - 1) payload + 3 else payload;
+    }
+
+    /// Bytes appended for one entry with the given key size (0 for arrays).
+    fn entrySize(key_size: usize, comptime V: type, value: V) usize {
+        const head = keyTagSize(key_size) + key_size + 1;
+        return head + switch (@typeInfo(V)) {
+            .optional => |o| if (value) |v| return entrySize(key_size, o.child, v) else 0,
+            .bool => 1,
+            .int, .float => 8,
+            .@"enum" => lenPrefixedSize(@tagName(value).len + 1),
+            .pointer => |p| if (p.child == u8) lenPrefixedSize(value.len + 1) else node_size - 1 + 3 + containerSize(V, value),
+            .array => |a| if (a.child == u8) lenPrefixedSize(a.len) else node_size - 1 + 3 + containerSize(V, value),
+            .@"struct" => node_size - 1 + 3 + containerSize(V, value),
+            else => @compileError("lite3.serialize: unsupported type " ++ @typeName(V)),
+        };
+    }
+
+    /// Bytes appended for the entries of a container plus its node splits.
+    fn containerSize(comptime V: type, value: V) usize {
+        var total: usize = 0;
+        var n: usize = 0;
+        switch (@typeInfo(V)) {
+            .@"struct" => |s| inline for (s.fields) |f| {
+                total += entrySize(f.name.len + 1, f.type, @field(value, f.name));
+                n += 1;
+            },
+            .pointer => |p| for (value) |elem| {
+                total += entrySize(0, p.child, elem);
+                n += 1;
+            },
+            .array => |a| for (value) |elem| {
+                total += entrySize(0, a.child, elem);
+                n += 1;
+            },
+            else => unreachable,
+        }
+        // Every node but the container's own holds >= node_key_count_min keys
+        // after a split; each new node may also need alignment padding.
+        if (n > node_key_count_max) total += (n / node_key_count_min + 1) * (node_size + 3);
+        return total;
+    }
+
+    // --- Writing ---
+
+    fn slot(mctx: *ManagedContext, ofs: Offset, comptime key: ?[:0]const u8, t: Type, payload_len: usize) Error!usize {
+        if (key) |k| {
+            const kd = comptime KeyData.of(k);
+            return mctx.callWithGrowth(raw_slot.set, .{ mctx.innerBuf(), ofs, k.ptr, kd, t, payload_len });
+        }
+        return mctx.callWithGrowth(raw_slot.arrAppend, .{ mctx.innerBuf(), ofs, t, payload_len });
+    }
+
+    fn writeLenPrefixed(mctx: *ManagedContext, ofs: Offset, comptime key: ?[:0]const u8, t: Type, bytes: []const u8) Error!void {
+        const stored_len = if (t == .string) bytes.len + 1 else bytes.len;
+        const n = std.math.cast(u32, stored_len) orelse return Error.InvalidArgument;
+        const v = try slot(mctx, ofs, key, t, 4 + stored_len);
+        const out = mctx.inner.buf[v + 1 ..];
+        std.mem.writeInt(u32, out[0..4], n, .little);
+        @memcpy(out[4..][0..bytes.len], bytes);
+        if (t == .string) out[4 + bytes.len] = 0;
+    }
+
+    fn writeFields(comptime T: type, mctx: *ManagedContext, ofs: Offset, value: T) Error!void {
+        inline for (@typeInfo(T).@"struct".fields) |f| {
+            try writeValue(f.type, mctx, ofs, f.name, @field(value, f.name));
+        }
+    }
+
+    fn writeValue(comptime V: type, mctx: *ManagedContext, ofs: Offset, comptime key: ?[:0]const u8, value: V) Error!void {
+        switch (@typeInfo(V)) {
+            .optional => |o| {
+                if (value) |v| return writeValue(o.child, mctx, ofs, key, v);
+                _ = try slot(mctx, ofs, key, .null, 0);
+            },
+            .bool => {
+                const v = try slot(mctx, ofs, key, .bool_, 1);
+                mctx.inner.buf[v + 1] = @intFromBool(value);
+            },
+            .int => {
+                const i = std.math.cast(i64, value) orelse return Error.InvalidArgument;
+                const v = try slot(mctx, ofs, key, .i64_, 8);
+                std.mem.writeInt(i64, mctx.inner.buf[v + 1 ..][0..8], i, .little);
+            },
+            .float => {
+                const f: f64 = @floatCast(value);
+                const v = try slot(mctx, ofs, key, .f64_, 8);
+                std.mem.writeInt(u64, mctx.inner.buf[v + 1 ..][0..8], @bitCast(f), .little);
+            },
+            .@"enum" => |e| {
+                if (!e.is_exhaustive) @compileError("lite3.serialize: non-exhaustive enum " ++ @typeName(V));
+                try writeLenPrefixed(mctx, ofs, key, .string, @tagName(value));
+            },
+            .pointer => |p| {
+                if (p.size != .slice) @compileError("lite3.serialize: only slices are supported, found " ++ @typeName(V));
+                if (p.child == u8) return writeLenPrefixed(mctx, ofs, key, .string, value);
+                const arr: Offset = @enumFromInt(try slot(mctx, ofs, key, .array, 0));
+                for (value) |elem| try writeValue(p.child, mctx, arr, null, elem);
+            },
+            .array => |a| {
+                if (a.child == u8) return writeLenPrefixed(mctx, ofs, key, .bytes, &value);
+                const arr: Offset = @enumFromInt(try slot(mctx, ofs, key, .array, 0));
+                for (value) |elem| try writeValue(a.child, mctx, arr, null, elem);
+            },
+            .@"struct" => {
+                const obj: Offset = @enumFromInt(try slot(mctx, ofs, key, .object, 0));
+                try writeFields(V, mctx, obj, value);
+            },
+            else => @compileError("lite3.serialize: unsupported type " ++ @typeName(V)),
+        }
+    }
+
+    // --- Reading ---
+
+    fn needsAlloc(comptime V: type) bool {
+        return switch (@typeInfo(V)) {
+            .optional => |o| needsAlloc(o.child),
+            .pointer => |p| p.child != u8 or needsAlloc(p.child),
+            .array => |a| needsAlloc(a.child),
+            .@"struct" => |s| blk: {
+                inline for (s.fields) |f| {
+                    if (needsAlloc(f.type)) break :blk true;
+                }
+                break :blk false;
+            },
+            else => false,
+        };
+    }
+
+    fn readRoot(comptime T: type, allocator: ?std.mem.Allocator, b: *const Buffer, ofs: Offset) Error!T {
+        if (@typeInfo(T) != .@"struct") @compileError("lite3.deserialize expects a struct, found " ++ @typeName(T));
+        const o = @intFromEnum(ofs);
+        if (b.len < node_size or o > b.len - node_size) return Error.InvalidArgument;
+        return readValue(T, allocator, b, o);
+    }
+
+    fn expect(b: *const Buffer, val_ofs: usize, t: Type) Error!void {
+        if (raw_slot.typeAt(b, val_ofs) != t) return Error.InvalidArgument;
+    }
+
+    fn readValue(comptime V: type, allocator: ?std.mem.Allocator, b: *const Buffer, val_ofs: usize) Error!V {
+        const t = raw_slot.typeAt(b, val_ofs);
+        switch (@typeInfo(V)) {
+            .optional => |o| {
+                if (t == .null) return null;
+                return try readValue(o.child, allocator, b, val_ofs);
+            },
+            .bool => {
+                try expect(b, val_ofs, .bool_);
+                return b.buf[val_ofs + 1] != 0;
+            },
+            .int => {
+                try expect(b, val_ofs, .i64_);
+                const i = std.mem.readInt(i64, b.buf[val_ofs + 1 ..][0..8], .little);
+                return std.math.cast(V, i) orelse return Error.InvalidArgument;
+            },
+            .float => switch (t) {
+                .f64_ => return @floatCast(@as(f64, @bitCast(std.mem.readInt(u64, b.buf[val_ofs + 1 ..][0..8], .little)))),
+                .i64_ => return @floatFromInt(std.mem.readInt(i64, b.buf[val_ofs + 1 ..][0..8], .little)),
+                else => return Error.InvalidArgument,
+            },
+            .@"enum" => {
+                try expect(b, val_ofs, .string);
+                return std.meta.stringToEnum(V, try raw_slot.lenPrefixed(b, val_ofs, .string)) orelse return Error.InvalidArgument;
+            },
+            .pointer => |p| {
+                if (p.size != .slice or !p.is_const or p.sentinel_ptr != null)
+                    @compileError("lite3.deserialize: only []const T slices are supported, found " ++ @typeName(V));
+                if (p.child == u8) {
+                    if (t != .string and t != .bytes) return Error.InvalidArgument;
+                    return try raw_slot.lenPrefixed(b, val_ofs, t);
+                }
+                try expect(b, val_ofs, .array);
+                const arr: Offset = @enumFromInt(val_ofs);
+                const n = try b.count(arr);
+                const out = allocator.?.alloc(p.child, n) catch return Error.OutOfMemory;
+                try readElems(p.child, allocator, b, arr, out);
+                return out;
+            },
+            .array => |a| {
+                var out: V = undefined;
+                if (a.child == u8) {
+                    try expect(b, val_ofs, .bytes);
+                    const bytes = try raw_slot.lenPrefixed(b, val_ofs, .bytes);
+                    if (bytes.len != a.len) return Error.InvalidArgument;
+                    @memcpy(&out, bytes);
+                    return out;
+                }
+                try expect(b, val_ofs, .array);
+                const arr: Offset = @enumFromInt(val_ofs);
+                if (try b.count(arr) != a.len) return Error.InvalidArgument;
+                try readElems(a.child, allocator, b, arr, &out);
+                return out;
+            },
+            .@"struct" => |s| {
+                try expect(b, val_ofs, .object);
+                const obj: Offset = @enumFromInt(val_ofs);
+                var out: V = undefined;
+                inline for (s.fields) |f| {
+                    const key_z: [:0]const u8 = f.name;
+                    const kd = comptime KeyData.of(f.name);
+                    if (raw_slot.get(b, obj, key_z.ptr, kd)) |field_ofs| {
+                        @field(out, f.name) = try readValue(f.type, allocator, b, field_ofs);
+                    } else |err| switch (err) {
+                        Error.NotFound => @field(out, f.name) = try missingField(f),
+                        else => return err,
+                    }
+                }
+                return out;
+            },
+            else => @compileError("lite3.deserialize: unsupported type " ++ @typeName(V)),
+        }
+    }
+
+    /// Value of a struct field whose key is absent from the object.
+    fn missingField(comptime f: std.builtin.Type.StructField) Error!f.type {
+        if (comptime f.defaultValue()) |d| return d;
+        if (@typeInfo(f.type) == .optional) return null;
+        return Error.NotFound;
+    }
+
+    fn readElems(comptime E: type, allocator: ?std.mem.Allocator, b: *const Buffer, arr: Offset, out: []E) Error!void {
+        var it = try b.iterate(arr);
+        var i: usize = 0;
+        while (try it.next()) |entry| : (i += 1) {
+            if (i >= out.len) return Error.CorruptData;
+            out[i] = try readValue(E, allocator, b, @intFromEnum(entry.val_offset));
+        }
+        if (i != out.len) return Error.CorruptData;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Typed views
+// ---------------------------------------------------------------------------
+
+/// A typed, read-only view of the object at `ofs` whose keys are the field
+/// names of `T`. Each field's value offset is resolved on first access (with a
+/// comptime key hash) and cached, so repeated `get` calls skip the B-tree
+/// descent.
+///
+/// The cache is dropped whenever the buffer's length or base pointer, or the
+/// object's generation (bumped by every write to it), changes. Each hit also
+/// re-checks that the offset is in bounds and that the field's key is stored
+/// right before it, so a same-length reset, import or decode never reads
+/// through a stale offset.
+///
+/// `src` is a pointer to a `Buffer`, `ManagedContext` or `ExternalContext`.
+/// Field types follow the same mapping as `deserialize`.
+pub fn View(comptime T: type) type {
+    const fields = switch (@typeInfo(T)) {
+        .@"struct" => |s| s.fields,
+        else => @compileError("lite3.View expects a struct, found " ++ @typeName(T)),
+    };
+    return struct {
+        const Self = @This();
+
+        pub const Field = std.meta.FieldEnum(T);
+
+        buf: *const Buffer,
+        ofs: Offset,
+        seen_ptr: [*]const u8,
+        seen_len: usize,
+        seen_gen: u32,
+        /// Cached value offsets; 0 means unresolved (no value lives at offset 0).
+        slots: [fields.len]usize = @splat(0),
+
+        pub fn init(src: anytype, ofs: Offset) Self {
+            const b = bufferPtrOf(src);
+            return .{ .buf = b, .ofs = ofs, .seen_ptr = b.buf, .seen_len = b.len, .seen_gen = raw_slot.genOf(b, ofs) };
+        }
+
+        /// Forget all cached offsets.
+        pub fn invalidate(self: *Self) void {
+            self.slots = @splat(0);
+            self.seen_ptr = self.buf.buf;
+            self.seen_len = self.buf.len;
+            self.seen_gen = raw_slot.genOf(self.buf, self.ofs);
+        }
+
+        /// Offset of `field`'s value (its type byte), resolving it if needed.
+        pub fn offsetOf(self: *Self, comptime field: Field) Error!usize {
+            if (self.buf.buf != self.seen_ptr or self.buf.len != self.seen_len or
+                raw_slot.genOf(self.buf, self.ofs) != self.seen_gen) self.invalidate();
+            const i = @intFromEnum(field);
+            const name: [:0]const u8 = fields[i].name;
+            if (self.slots[i] != 0) {
+                if (raw_slot.entryEndsAt(self.buf, self.slots[i], name)) return self.slots[i];
+                self.invalidate();
+            }
+            const val_ofs = try raw_slot.get(self.buf, self.ofs, name.ptr, comptime KeyData.of(name));
+            self.slots[i] = val_ofs;
+            return val_ofs;
+        }
+
+        /// Read `field`. Missing keys fall back like `deserialize`.
+        pub fn get(self: *Self, comptime field: Field) Error!@FieldType(T, @tagName(field)) {
+            const F = @FieldType(T, @tagName(field));
+            if (comptime serdes.needsAlloc(F)) @compileError("lite3.View: field " ++ @tagName(field) ++ " needs allocation; use lite3.deserializeAlloc");
+            const val_ofs = self.offsetOf(field) catch |err| switch (err) {
+                Error.NotFound => return serdes.missingField(fields[@intFromEnum(field)]),
+                else => return err,
+            };
+            return serdes.readValue(F, null, self.buf, val_ofs);
+        }
+
+        /// A view of a nested struct field, sharing this view's buffer.
+        pub fn child(self: *Self, comptime field: Field) Error!View(@FieldType(T, @tagName(field))) {
+            const F = @FieldType(T, @tagName(field));
+            const val_ofs = try self.offsetOf(field);
+            if (raw_slot.typeAt(self.buf, val_ofs) != .object) return Error.InvalidArgument;
+            return View(F).init(self.buf, @enumFromInt(val_ofs));
+        }
+    };
+}
+
+/// Stable `*const Buffer` for containers whose inner buffer is a Zig value.
+/// `Context` is excluded: its buffer lives behind the C context.
+fn bufferPtrOf(src: anytype) *const Buffer {
+    return switch (@TypeOf(src)) {
+        *Buffer, *const Buffer => src,
+        *ManagedContext, *const ManagedContext, *ExternalContext, *const ExternalContext => &src.inner,
+        else => @compileError("expected a pointer to Buffer, ManagedContext or ExternalContext, found " ++ @typeName(@TypeOf(src))),
+    };
+}
+
+// ---------------------------------------------------------------------------
+// Shapes and inline lookup caches
+// ---------------------------------------------------------------------------
+
+/// Structural fingerprint of the object or array at `ofs`: its container type
+/// plus the key count and key hashes of every node, depth first. Documents
+/// built from the same keys in the same order share a shape, so the value can
+/// be used to bucket messages before processing them.
+///
+/// This walks every node, so it costs more than a single lookup; see
+/// `InlineCache` for per-lookup caching.
+pub fn shape(src: anytype, ofs: Offset) Error!u64 {
+    const b = constBufferOf(src);
+    var out: u64 = 0;
+    const ret = c.shim_lite3_shape(b.buf, b.len, @intFromEnum(ofs), &out);
+    if (ret < 0) return translateError(ret);
+    return out;
+}
+
+/// A per-call-site inline cache for lookups of `key`. It remembers the path
+/// of child indices and the slot where `key` was last found; on the next
+/// lookup (typically in another document of the same shape) it replays that
+/// path and only verifies the slot's hash and key bytes, falling back to a
+/// full descent and refilling the cache on a miss. Results are always exact.
+///
+/// Keep one cache per call site, e.g. as a field of the processing state:
+///
+///     var price_ic: lite3.InlineCache("price") = .{};
+///     const p = try price_ic.get(f64, &buf, lite3.root);
+pub fn InlineCache(comptime key: [:0]const u8) type {
+    const kd = comptime KeyData.of(key);
+    return struct {
+        const Self = @This();
+
+        raw: c.shim_lite3_ic = .{ .hash = 0, .depth = c.SHIM_LITE3_IC_EMPTY, .slot = 0, .path = @splat(0) },
+        hits: u64 = 0,
+        misses: u64 = 0,
+
+        /// Offset of the value (its type byte) for `key` in the object at `ofs`.
+        pub fn offsetIn(self: *Self, src: anytype, ofs: Offset) Error!usize {
+            const b = constBufferOf(src);
+            var val_ofs: usize = 0;
+            const ret = c.shim_lite3_ic_get_val(b.buf, b.len, @intFromEnum(ofs), key.ptr, kd.hash, kd.size, &self.raw, &val_ofs);
+            if (ret < 0) return translateError(ret);
+            if (ret == 1) self.hits += 1 else self.misses += 1;
+            return val_ofs;
+        }
+
+        /// Read the value for `key` as `V`, using the `deserialize` type mapping.
+        pub fn get(self: *Self, comptime V: type, src: anytype, ofs: Offset) Error!V {
+            if (comptime serdes.needsAlloc(V)) @compileError("lite3.InlineCache: " ++ @typeName(V) ++ " needs allocation");
+            const b = constBufferOf(src);
+            const val_ofs = try self.offsetIn(&b, ofs);
+            return serdes.readValue(V, null, &b, val_ofs);
+        }
+    };
+}
+
+// ---------------------------------------------------------------------------
+// Cursors
+// ---------------------------------------------------------------------------
+
+/// A positioned cursor over the object at `ofs` for localized read/modify
+/// patterns (e.g. updating several sibling fields of a deep object). It
+/// remembers the last node path walked from `ofs`; the next lookup starts at
+/// the deepest node whose hash range contains the key, instead of at `ofs`.
+///
+/// Overwrites that fit in place keep the path. Any other mutation of the
+/// object bumps its generation and the cursor silently starts over; results
+/// never depend on the cursor being current.
+///
+/// Setters accept a `*Buffer` or `*ManagedContext`; getters also accept
+/// `Context` and `ExternalContext` pointers.
+pub const Cursor = struct {
+    ofs: Offset,
+    raw: c.shim_lite3_cursor,
+
+    pub fn init(ofs: Offset) Cursor {
+        var raw = std.mem.zeroes(c.shim_lite3_cursor);
+        raw.depth = c.SHIM_LITE3_IC_EMPTY;
+        return .{ .ofs = ofs, .raw = raw };
+    }
+
+    /// Offset of the value (its type byte) for `key`.
+    pub fn offsetOf(self: *Cursor, src: anytype, key: []const u8) Error!usize {
+        const kz = try SharedMethods(Buffer).toKeyZ(key);
+        const kd = KeyData.of(key);
+        const b = constBufferOf(src);
+        var val_ofs: usize = 0;
+        const ret = c.shim_lite3_cursor_get_val(b.buf, b.len, @intFromEnum(self.ofs), &kz, kd.hash, kd.size, &self.raw, &val_ofs);
+        if (ret < 0) return translateError(ret);
+        return val_ofs;
+    }
+
+    /// Read the value for `key` as `V`, using the `deserialize` type mapping.
+    pub fn get(self: *Cursor, comptime V: type, src: anytype, key: []const u8) Error!V {
+        if (comptime serdes.needsAlloc(V)) @compileError("lite3.Cursor: " ++ @typeName(V) ++ " needs allocation");
+        const b = constBufferOf(src);
+        const val_ofs = try self.offsetOf(&b, key);
+        return serdes.readValue(V, null, &b, val_ofs);
+    }
+
+    pub fn setNull(self: *Cursor, dst: anytype, key: []const u8) Error!void {
+        _ = try self.slot(dst, key, .null, 0);
+    }
+
+    pub fn setBool(self: *Cursor, dst: anytype, key: []const u8, value: bool) Error!void {
+        const v = try self.slot(dst, key, .bool_, 1);
+        mutBufferOf(dst).buf[v + 1] = @intFromBool(value);
+    }
+
+    pub fn setI64(self: *Cursor, dst: anytype, key: []const u8, value: i64) Error!void {
+        const v = try self.slot(dst, key, .i64_, 8);
+        std.mem.writeInt(i64, mutBufferOf(dst).buf[v + 1 ..][0..8], value, .little);
+    }
+
+    pub fn setF64(self: *Cursor, dst: anytype, key: []const u8, value: f64) Error!void {
+        const v = try self.slot(dst, key, .f64_, 8);
+        std.mem.writeInt(u64, mutBufferOf(dst).buf[v + 1 ..][0..8], @bitCast(value), .little);
+    }
+
+    pub fn setStr(self: *Cursor, dst: anytype, key: []const u8, value: []const u8) Error!void {
+        if (std.mem.indexOfScalar(u8, value, 0) != null) return Error.InvalidArgument;
+        const n = std.math.cast(u32, value.len + 1) orelse return Error.InvalidArgument;
+        const v = try self.slot(dst, key, .string, 4 + value.len + 1);
+        const out = mutBufferOf(dst).buf[v + 1 ..];
+        std.mem.writeInt(u32, out[0..4], n, .little);
+        @memcpy(out[4..][0..value.len], value);
+        out[4 + value.len] = 0;
+    }
+
+    fn slot(self: *Cursor, dst: anytype, key: []const u8, t: Type, payload_len: usize) Error!usize {
+        const kz = try SharedMethods(Buffer).toKeyZ(key);
+        const key_z: [*:0]const u8 = @ptrCast(&kz);
+        const kd = KeyData.of(key);
+        return switch (@TypeOf(dst)) {
+            *Buffer => setRaw(dst, self, key_z, kd, t, payload_len),
+            *ManagedContext => dst.callWithGrowth(setRaw, .{ dst.innerBuf(), self, key_z, kd, t, payload_len }),
+            else => @compileError("lite3.Cursor: expected *Buffer or *ManagedContext, found " ++ @typeName(@TypeOf(dst))),
+        };
+    }
+
+    fn setRaw(b: *Buffer, self: *Cursor, key_z: [*:0]const u8, kd: KeyData, t: Type, payload_len: usize) Error!usize {
+        if (b.delta) |tracker| try tracker.footprint(b.*, self.ofs, key_z, kd.hash, kd.size);
+        var val_ofs: usize = 0;
+        const saved = b.len;
+        const ret = c.shim_lite3_cursor_set_val(b.buf, &b.len, @intFromEnum(self.ofs), b.capacity, key_z, kd.hash, kd.size, @intFromEnum(t), payload_len, &self.raw, &val_ofs);
+        if (ret < 0) {
+            b.len = saved;
+            return translateError(ret);
+        }
+        return val_ofs;
+    }
+
+};
+
+/// Mutable `*Buffer` behind a `*Buffer` or `*ManagedContext`.
+fn mutBufferOf(dst: anytype) *Buffer {
+    return switch (@TypeOf(dst)) {
+        *Buffer => dst,
+        *ManagedContext => dst.innerBuf(),
+        else => @compileError("expected *Buffer or *ManagedContext, found " ++ @typeName(@TypeOf(dst))),
+    };
+}
+
+// ---------------------------------------------------------------------------
+// ConstView (read-only, any alignment)
+// ---------------------------------------------------------------------------
+
+/// A read-only view over serialized Lite3 bytes at any alignment, e.g. a
+/// message sitting after a frame header in a network buffer. Unlike
+/// `Buffer.fromSerialized`, nothing is copied: node fields are read with
+/// unaligned little-endian loads by a Zig port of the lite3 lookup path.
+///
+/// Offsets are relative to the start of `bytes` and interchangeable with
+/// those of a `Buffer` holding the same bytes. Structural damage (node or
+/// value out of bounds) is reported as `Error.CorruptData`.
+pub const ConstView = struct {
+    bytes: []const u8,
+
+    const hashes_ofs: usize = 4;
+    const size_kc_ofs: usize = 32;
+    const kv_ofs_ofs: usize = 36;
+    const child_ofs_ofs: usize = 64;
+    const key_count_mask: u32 = 0x7;
+    const size_shift: u5 = 6;
+    const tree_height_max: usize = 9;
+    const hash_probe_max: u32 = 128;
+    const max_key_len: usize = 255;
+
+    /// Wrap `bytes`, which must start with an object or array root node.
+    pub fn init(bytes: []const u8) Error!ConstView {
+        if (bytes.len < node_size or bytes.len > std.math.maxInt(u32)) return Error.InvalidArgument;
+        const t = bytes[0];
+        if (t != @intFromEnum(Type.object) and t != @intFromEnum(Type.array)) return Error.InvalidArgument;
+        return .{ .bytes = bytes };
+    }
+
+    /// Type of the root container (`.object` or `.array`). Re-reads the
+    /// root byte, which a shared slot may have rewritten since `init`.
+    pub fn rootType(self: *const ConstView) Error!Type {
+        const t = try self.typeAt(0);
+        if (t != .object and t != .array) return Error.CorruptData;
+        return t;
+    }
+
+    /// The viewed bytes.
+    pub fn data(self: *const ConstView) []const u8 {
+        return self.bytes;
+    }
+
+    // --- Raw node access ---
+
+    inline fn u32At(self: *const ConstView, pos: usize) u32 {
+        return std.mem.readInt(u32, self.bytes[pos..][0..4], .little);
+    }
+
+    fn nodeAt(self: *const ConstView, ofs: usize) Error!usize {
+        if (ofs > self.bytes.len - node_size or ofs & 3 != 0) return Error.CorruptData;
+        return ofs;
+    }
+
+    inline fn keyCount(self: *const ConstView, node: usize) u32 {
+        return self.u32At(node + size_kc_ofs) & key_count_mask;
+    }
+
+    inline fn hashAt(self: *const ConstView, node: usize, i: usize) u32 {
+        return self.u32At(node + hashes_ofs + 4 * i);
+    }
+
+    inline fn kvAt(self: *const ConstView, node: usize, i: usize) usize {
+        return self.u32At(node + kv_ofs_ofs + 4 * i);
+    }
+
+    inline fn childAt(self: *const ConstView, node: usize, i: usize) usize {
+        return self.u32At(node + child_ofs_ofs + 4 * i);
+    }
+
+    /// Validate a container offset as the C `_lite3_verify_*_get` helpers do.
+    fn container(self: *const ConstView, ofs: Offset, t: Type) Error!usize {
+        const o = @intFromEnum(ofs);
+        if (o > self.bytes.len - node_size) return Error.InvalidArgument;
+        if (self.bytes[o] != @intFromEnum(t)) return Error.InvalidArgument;
+        if (o & 3 != 0) return Error.CorruptData;
+        return o;
+    }
+
+    /// Parse the key entry at `kv`; returns the key (without NUL) and value offset.
+    fn keyEntry(self: *const ConstView, kv: usize) Error!struct { key: []const u8, val: usize } {
+        if (kv > self.bytes.len -| 4 or self.bytes.len < 4) return Error.CorruptData;
+        const tag_size: usize = (self.bytes[kv] & 0x3) + 1;
+        var raw: u32 = 0;
+        for (0..tag_size) |i| raw |= @as(u32, self.bytes[kv + i]) << @intCast(8 * i);
+        const key_size: usize = raw >> 2;
+        const start = kv + tag_size;
+        if (key_size == 0 or key_size > self.bytes.len - start) return Error.CorruptData;
+        return .{ .key = self.bytes[start..][0 .. key_size - 1], .val = start + key_size };
+    }
+
+    /// Bounds-check the value at `val`, as the C `_verify_val` does.
+    fn checkVal(self: *const ConstView, val: usize) Error!void {
+        if (val >= self.bytes.len) return Error.CorruptData;
+        const t = self.bytes[val];
+        if (t >= Type.max_valid) return Error.InvalidArgument;
+        const payload: usize = switch (@as(Type, @enumFromInt(t))) {
+            .null => 0,
+            .bool_ => 1,
+            .i64_, .f64_ => 8,
+            .bytes, .string => 4,
+            .object, .array => node_size - 1,
+            .invalid => unreachable,
+        };
+        const avail = self.bytes.len - val - 1;
+        if (payload > avail) return Error.CorruptData;
+        if (t == @intFromEnum(Type.bytes) or t == @intFromEnum(Type.string)) {
+            if (self.u32At(val + 1) > avail - 4) return Error.CorruptData;
+        }
+    }
+
+    /// End of the value at `val`. Reads the type and length once.
+    fn valueEnd(self: *const ConstView, val: usize) Error!usize {
+        const payload: usize = switch (try self.typeAt(val)) {
+            .null => 0,
+            .bool_ => 1,
+            .i64_, .f64_ => 8,
+            .bytes, .string => 4 + @as(usize, std.mem.readInt(u32, (try self.span(val + 1, 4))[0..4], .little)),
+            .object, .array => node_size - 1,
+            .invalid => return Error.CorruptData,
+        };
+        _ = try self.span(val + 1, payload);
+        return val + 1 + payload;
+    }
+
+    /// B-tree descent mirroring `lite3_get_impl`; `key == null` for arrays.
+    fn lookup(self: *const ConstView, top: usize, key: ?[]const u8, kd: KeyData) Error!usize {
+        const attempts: u32 = if (key != null) hash_probe_max else 1;
+        var attempt: u32 = 0;
+        probe: while (attempt < attempts) : (attempt += 1) {
+            const hash = kd.hash +% attempt *% attempt;
+            var node = top;
+            var walks: usize = 0;
+            while (true) {
+                const kc = self.keyCount(node);
+                var i: usize = 0;
+                while (i < kc and self.hashAt(node, i) < hash) i += 1;
+                if (i < kc and self.hashAt(node, i) == hash) {
+                    const kv = self.kvAt(node, i);
+                    const val = if (key) |k| blk: {
+                        const e = try self.keyEntry(kv);
+                        if (!std.mem.eql(u8, e.key, k) or self.bytes[e.val - 1] != 0) continue :probe;
+                        break :blk e.val;
+                    } else kv;
+                    try self.checkVal(val);
+                    return val;
+                }
+                const child = self.childAt(node, 0);
+                if (child == 0) return Error.NotFound;
+                walks += 1;
+                if (walks > tree_height_max) return Error.CorruptData;
+                node = try self.nodeAt(self.childAt(node, i));
+            }
+        }
+        return Error.InvalidArgument;
+    }
+
+    fn find(self: *const ConstView, ofs: Offset, key: []const u8) Error!usize {
+        if (key.len > max_key_len or std.mem.indexOfScalar(u8, key, 0) != null) return Error.InvalidArgument;
+        const top = try self.container(ofs, .object);
+        return self.lookup(top, key, KeyData.of(key));
+    }
+
+    fn findIndex(self: *const ConstView, ofs: Offset, index: u32) Error!usize {
+        const top = try self.container(ofs, .array);
+        if (index >= self.u32At(top + size_kc_ofs) >> size_shift) return Error.InvalidArgument;
+        return self.lookup(top, null, .{ .hash = index, .size = 0 });
+    }
+
+    // --- Typed value decoding ---
+    //
+    // The bytes may change underneath a reader (`SharedSubscriber` reads a
+    // slot the publisher can overwrite, then checks its sequence), so each
+    // decoder reads every type byte and length once and bounds-checks it,
+    // independently of `checkVal`.
+
+    /// `n` bytes at `start`, or `CorruptData` if they run past the end.
+    fn span(self: *const ConstView, start: usize, n: usize) Error![]const u8 {
+        if (start > self.bytes.len or n > self.bytes.len - start) return Error.CorruptData;
+        return self.bytes[start..][0..n];
+    }
+
+    fn typeAt(self: *const ConstView, val: usize) Error!Type {
+        if (val >= self.bytes.len) return Error.CorruptData;
+        const t = self.bytes[val];
+        if (t >= Type.max_valid) return Error.CorruptData;
+        return @enumFromInt(t);
+    }
+
+    fn expectType(self: *const ConstView, val: usize, t: Type) Error!void {
+        if (val >= self.bytes.len) return Error.CorruptData;
+        if (self.bytes[val] != @intFromEnum(t)) return Error.InvalidArgument;
+    }
+
+    fn boolAt(self: *const ConstView, val: usize) Error!bool {
+        try self.expectType(val, .bool_);
+        return (try self.span(val + 1, 1))[0] != 0;
+    }
+
+    fn i64At(self: *const ConstView, val: usize) Error!i64 {
+        try self.expectType(val, .i64_);
+        return std.mem.readInt(i64, (try self.span(val + 1, 8))[0..8], .little);
+    }
+
+    fn f64At(self: *const ConstView, val: usize) Error!f64 {
+        try self.expectType(val, .f64_);
+        return @bitCast(std.mem.readInt(u64, (try self.span(val + 1, 8))[0..8], .little));
+    }
+
+    fn strAt(self: *const ConstView, val: usize) Error![]const u8 {
+        try self.expectType(val, .string);
+        const n = std.mem.readInt(u32, (try self.span(val + 1, 4))[0..4], .little);
+        if (n == 0) return Error.CorruptData;
+        return (try self.span(val + 5, n))[0 .. n - 1];
+    }
+
+    fn bytesAt(self: *const ConstView, val: usize) Error![]const u8 {
+        try self.expectType(val, .bytes);
+        const n = std.mem.readInt(u32, (try self.span(val + 1, 4))[0..4], .little);
+        return self.span(val + 5, n);
+    }
+
+    fn containerAt(self: *const ConstView, val: usize, t: Type) Error!Offset {
+        try self.expectType(val, t);
+        return @enumFromInt(try self.nodeAt(val));
+    }
+
+    fn valueAt(self: *const ConstView, val: usize) Error!Value {
+        return switch (try self.typeAt(val)) {
+            .null => .null,
+            .bool_ => .{ .bool_ = try self.boolAt(val) },
+            .i64_ => .{ .i64_ = try self.i64At(val) },
+            .f64_ => .{ .f64_ = try self.f64At(val) },
+            .string => .{ .string = try self.strAt(val) },
+            .bytes => .{ .bytes = try self.bytesAt(val) },
+            .object => .{ .object = try self.containerAt(val, .object) },
+            .array => .{ .array = try self.containerAt(val, .array) },
+            .invalid => Error.CorruptData,
+        };
+    }
+
+    fn copyInto(src: []const u8, dest: []u8) Error![]const u8 {
+        if (src.len > dest.len) return Error.NoBufferSpace;
+        @memcpy(dest[0..src.len], src);
+        return dest[0..src.len];
+    }
+
+    // --- Object access ---
+
+    pub fn getType(self: *const ConstView, ofs: Offset, key: []const u8) Error!Type {
+        return self.typeAt(try self.find(ofs, key));
+    }
+
+    pub fn exists(self: *const ConstView, ofs: Offset, key: []const u8) Error!bool {
+        _ = self.find(ofs, key) catch |err| switch (err) {
+            Error.NotFound => return false,
+            else => return err,
+        };
+        return true;
+    }
+
+    pub fn getBool(self: *const ConstView, ofs: Offset, key: []const u8) Error!bool {
+        return self.boolAt(try self.find(ofs, key));
+    }
+
+    pub fn getI64(self: *const ConstView, ofs: Offset, key: []const u8) Error!i64 {
+        return self.i64At(try self.find(ofs, key));
+    }
+
+    pub fn getF64(self: *const ConstView, ofs: Offset, key: []const u8) Error!f64 {
+        return self.f64At(try self.find(ofs, key));
+    }
+
+    pub fn getStr(self: *const ConstView, ofs: Offset, key: []const u8) Error![]const u8 {
+        return self.strAt(try self.find(ofs, key));
+    }
+
+    pub fn getBytes(self: *const ConstView, ofs: Offset, key: []const u8) Error![]const u8 {
+        return self.bytesAt(try self.find(ofs, key));
+    }
+
+    pub fn getObj(self: *const ConstView, ofs: Offset, key: []const u8) Error!Offset {
+        return self.containerAt(try self.find(ofs, key), .object);
+    }
+
+    pub fn getArr(self: *const ConstView, ofs: Offset, key: []const u8) Error!Offset {
+        return self.containerAt(try self.find(ofs, key), .array);
+    }
+
+    pub fn getStrCopy(self: *const ConstView, ofs: Offset, key: []const u8, dest: []u8) Error![]const u8 {
+        return copyInto(try self.getStr(ofs, key), dest);
+    }
+
+    pub fn getBytesCopy(self: *const ConstView, ofs: Offset, key: []const u8, dest: []u8) Error![]const u8 {
+        return copyInto(try self.getBytes(ofs, key), dest);
+    }
+
+    pub fn getValue(self: *const ConstView, ofs: Offset, key: []const u8) Error!Value {
+        return self.valueAt(try self.find(ofs, key));
+    }
+
+    // --- Array access ---
+
+    pub fn arrGetType(self: *const ConstView, ofs: Offset, index: u32) Error!Type {
+        return self.typeAt(try self.findIndex(ofs, index));
+    }
+
+    pub fn arrGetBool(self: *const ConstView, ofs: Offset, index: u32) Error!bool {
+        return self.boolAt(try self.findIndex(ofs, index));
+    }
+
+    pub fn arrGetI64(self: *const ConstView, ofs: Offset, index: u32) Error!i64 {
+        return self.i64At(try self.findIndex(ofs, index));
+    }
+
+    pub fn arrGetF64(self: *const ConstView, ofs: Offset, index: u32) Error!f64 {
+        return self.f64At(try self.findIndex(ofs, index));
+    }
+
+    pub fn arrGetStr(self: *const ConstView, ofs: Offset, index: u32) Error![]const u8 {
+        return self.strAt(try self.findIndex(ofs, index));
+    }
+
+    pub fn arrGetBytes(self: *const ConstView, ofs: Offset, index: u32) Error![]const u8 {
+        return self.bytesAt(try self.findIndex(ofs, index));
+    }
+
+    pub fn arrGetObj(self: *const ConstView, ofs: Offset, index: u32) Error!Offset {
+        return self.containerAt(try self.findIndex(ofs, index), .object);
+    }
+
+    pub fn arrGetArr(self: *const ConstView, ofs: Offset, index: u32) Error!Offset {
+        return self.containerAt(try self.findIndex(ofs, index), .array);
+    }
+
+    pub fn arrGetStrCopy(self: *const ConstView, ofs: Offset, index: u32, dest: []u8) Error![]const u8 {
+        return copyInto(try self.arrGetStr(ofs, index), dest);
+    }
+
+    pub fn arrGetBytesCopy(self: *const ConstView, ofs: Offset, index: u32, dest: []u8) Error![]const u8 {
+        return copyInto(try self.arrGetBytes(ofs, index), dest);
+    }
+
+    // --- Containers ---
+
+    /// Number of entries in the object or array at `ofs`.
+    pub fn count(self: *const ConstView, ofs: Offset) Error!u32 {
+        const o = @intFromEnum(ofs);
+        if (o > self.bytes.len - node_size) return Error.InvalidArgument;
+        const t = self.bytes[o];
+        if (t != @intFromEnum(Type.object) and t != @intFromEnum(Type.array)) return Error.InvalidArgument;
+        return self.u32At(o + size_kc_ofs) >> size_shift;
+    }
+
+    /// Shape of the B-tree behind one container; nested containers are
+    /// separate trees and are not counted.
+    pub const TreeStats = struct {
+        /// Levels from the container's root node down to the leaves.
+        height: u32 = 0,
+        nodes: u32 = 0,
+        entries: u32 = 0,
+
+        /// Fraction of key slots in use across all nodes.
+        pub fn fill(self: TreeStats) f64 {
+            if (self.nodes == 0) return 0;
+            return @as(f64, @floatFromInt(self.entries)) / @as(f64, @floatFromInt(@as(usize, self.nodes) * node_key_count_max));
+        }
+    };
+
+    /// Walk every node of the object or array at `ofs`.
+    pub fn treeStats(self: *const ConstView, ofs: Offset) Error!TreeStats {
+        const o = @intFromEnum(ofs);
+        if (o > self.bytes.len - node_size) return Error.InvalidArgument;
+        const t = self.bytes[o];
+        if (t != @intFromEnum(Type.object) and t != @intFromEnum(Type.array)) return Error.InvalidArgument;
+        var stats: TreeStats = .{};
+        try self.walkNodes(try self.nodeAt(o), 1, &stats);
+        return stats;
+    }
+
+    fn walkNodes(self: *const ConstView, node: usize, depth: u32, stats: *TreeStats) Error!void {
+        if (depth > tree_height_max + 1) return Error.CorruptData;
+        const kc = self.keyCount(node);
+        stats.nodes += 1;
+        stats.entries += kc;
+        stats.height = @max(stats.height, depth);
+        if (self.childAt(node, 0) == 0) return;
+        for (0..kc + 1) |i| try self.walkNodes(try self.nodeAt(self.childAt(node, i)), depth + 1, stats);
+    }
+
+    /// Iterate the entries of the object or array at `ofs` in storage order
+    /// (the same order as `Buffer.iterate`).
+    pub fn iterate(self: *const ConstView, ofs: Offset) Error!ConstIterator {
+        const o = @intFromEnum(ofs);
+        if (o > self.bytes.len - node_size) return Error.InvalidArgument;
+        const t = self.bytes[o];
+        if (t != @intFromEnum(Type.object) and t != @intFromEnum(Type.array)) return Error.InvalidArgument;
+        var it = ConstIterator{ .view = self.*, .is_object = t == @intFromEnum(Type.object) };
+        try it.push(try self.nodeAt(o));
+        return it;
+    }
+
+    /// In-order B-tree walk over a `ConstView` container.
+    pub const ConstIterator = struct {
+        view: ConstView,
+        is_object: bool,
+        stack: [tree_height_max + 1]Frame = undefined,
+        depth: usize = 0,
+
+        const Frame = struct { node: usize, next: usize };
+
+        /// Push `node` and its leftmost descendants.
+        fn push(self: *ConstIterator, node: usize) Error!void {
+            var n = node;
+            while (true) {
+                if (self.depth == self.stack.len) return Error.CorruptData;
+                self.stack[self.depth] = .{ .node = n, .next = 0 };
+                self.depth += 1;
+                const child = self.view.childAt(n, 0);
+                if (child == 0) return;
+                n = try self.view.nodeAt(child);
+            }
+        }
+
+        pub fn next(self: *ConstIterator) Error!?Iterator.Entry {
+            while (self.depth > 0) {
+                const top = &self.stack[self.depth - 1];
+                if (top.next >= self.view.keyCount(top.node)) {
+                    self.depth -= 1;
+                    continue;
+                }
+                const i = top.next;
+                top.next += 1;
+                const node = top.node;
+                const kv = self.view.kvAt(node, i);
+                var entry: Iterator.Entry = .{ .key = null, .val_offset = @enumFromInt(kv) };
+                if (self.is_object) {
+                    const e = try self.view.keyEntry(kv);
+                    entry = .{ .key = e.key, .val_offset = @enumFromInt(e.val) };
+                }
+                try self.view.checkVal(@intFromEnum(entry.val_offset));
+                if (self.view.childAt(node, 0) != 0) try self.push(try self.view.nodeAt(self.view.childAt(node, i + 1)));
+                return entry;
+            }
+            return null;
+        }
+    };
+};
+
+// ---------------------------------------------------------------------------
+// External blob references (scatter-gather output)
+// ---------------------------------------------------------------------------
+
+/// Builds messages whose large bytes values are supplied at send time
+/// instead of being copied into the buffer. `setBytes`/`arrAppendBytes`
+/// reserve the value slot (length prefix included) and record the caller's
+/// reference id; `gather` then produces an iovec list for `writev`/`sendmsg`
+/// that interleaves the buffer segments with the caller's blob memory. The
+/// bytes on the wire are an ordinary Lite3 message, so readers are unchanged.
+///
+/// The reserved slots are never written or read, so their memory is not
+/// touched until sent (large allocations typically stay unfaulted). Reading
+/// such a value locally before it is filled returns unspecified bytes. If a
+/// key holding an external blob is overwritten before `gather`, its stale
+/// slot is sent as zeros.
+///
+/// Containers: anything with `setBytesReserve`/`arrAppendBytesReserve` and
+/// `data()` (`Buffer`, `Context`, `ManagedContext`).
+pub const ExternalBlobs = struct {
+    refs: std.ArrayListUnmanaged(Ref) = .empty,
+    /// Owned copies of the keys in `refs`.
+    keys: std.ArrayListUnmanaged(u8) = .empty,
+
+    pub const Ref = struct {
+        /// Caller-defined reference id; `gather` resolves it by index.
+        id: usize,
+        /// Container holding the value.
+        container: Offset,
+        /// Key range in `keys`, or null for array elements.
+        key: ?struct { start: usize, len: usize },
+        /// Element index when `key` is null.
+        index: u32 = 0,
+        /// Offset of the first payload byte in the message.
+        payload_ofs: usize,
+        len: usize,
+    };
+
+    const zeros = [_]u8{0} ** 4096;
+
+    /// What a reservation holds at `gather` time: the reserved bytes value
+    /// (`live`), or `stale` with the number of leading payload bytes that
+    /// belong to a value written over it in place (0 if the value moved).
+    const Status = union(enum) { live, stale: usize };
+
+    pub fn deinit(self: *ExternalBlobs, allocator: std.mem.Allocator) void {
+        self.refs.deinit(allocator);
+        self.keys.deinit(allocator);
+        self.* = .{};
+    }
+
+    /// Forget all references (e.g. before building the next message).
+    pub fn clear(self: *ExternalBlobs) void {
+        self.refs.clearRetainingCapacity();
+        self.keys.clearRetainingCapacity();
+    }
+
+    /// Set `key` to an external bytes value of `len` bytes resolved from `id`.
+    pub fn setBytes(self: *ExternalBlobs, allocator: std.mem.Allocator, dst: anytype, ofs: Offset, key: []const u8, len: usize, id: usize) Error!void {
+        self.refs.ensureUnusedCapacity(allocator, 1) catch return Error.OutOfMemory;
+        self.keys.ensureUnusedCapacity(allocator, key.len) catch return Error.OutOfMemory;
+        const payload = try dst.setBytesReserve(ofs, key, len);
+        const payload_ofs = @intFromPtr(payload.ptr) - @intFromPtr(dst.data().ptr);
+        self.dropOverwritten(payload_ofs, len);
+        const start = self.keys.items.len;
+        self.keys.appendSliceAssumeCapacity(key);
+        self.refs.appendAssumeCapacity(.{
+            .id = id,
+            .container = ofs,
+            .key = .{ .start = start, .len = key.len },
+            .payload_ofs = payload_ofs,
+            .len = len,
+        });
+    }
+
+    /// Append an external bytes value of `len` bytes resolved from `id`.
+    pub fn arrAppendBytes(self: *ExternalBlobs, allocator: std.mem.Allocator, dst: anytype, ofs: Offset, len: usize, id: usize) Error!void {
+        self.refs.ensureUnusedCapacity(allocator, 1) catch return Error.OutOfMemory;
+        const index = try dst.count(ofs);
+        const payload = try dst.arrAppendBytesReserve(ofs, len);
+        const payload_ofs = @intFromPtr(payload.ptr) - @intFromPtr(dst.data().ptr);
+        self.dropOverwritten(payload_ofs, len);
+        self.refs.appendAssumeCapacity(.{
+            .id = id,
+            .container = ofs,
+            .key = null,
+            .index = index,
+            .payload_ofs = payload_ofs,
+            .len = len,
+        });
+    }
+
+    /// Forget earlier reservations that a new one at `payload_ofs` was
+    /// written over in place, e.g. when an attachment is replaced by a
+    /// smaller one. Their bytes now belong to the new reservation.
+    fn dropOverwritten(self: *ExternalBlobs, payload_ofs: usize, len: usize) void {
+        var i: usize = 0;
+        while (i < self.refs.items.len) {
+            const r = self.refs.items[i];
+            const overlaps = r.payload_ofs == payload_ofs or
+                (r.payload_ofs < payload_ofs + len and payload_ofs < r.payload_ofs + r.len);
+            if (overlaps) _ = self.refs.swapRemove(i) else i += 1;
+        }
+    }
+
+    /// Build the iovec list for `msg` (the container's `data()`), resolving
+    /// each reference id as an index into `blobs`. Each blob's length must
+    /// equal the length it was reserved with. A reservation whose value was
+    /// replaced is sent as zeros, apart from the bytes of a value written
+    /// over it in place. The returned slice is owned by the caller.
+    pub fn gather(
+        self: *const ExternalBlobs,
+        allocator: std.mem.Allocator,
+        msg: []const u8,
+        blobs: []const []const u8,
+    ) Error![]std.posix.iovec_const {
+        const sorted = allocator.dupe(Ref, self.refs.items) catch return Error.OutOfMemory;
+        defer allocator.free(sorted);
+        std.mem.sortUnstable(Ref, sorted, {}, struct {
+            fn lessThan(_: void, a: Ref, b: Ref) bool {
+                return a.payload_ofs < b.payload_ofs;
+            }
+        }.lessThan);
+
+        const view = try ConstView.init(msg);
+        var out: std.ArrayListUnmanaged(std.posix.iovec_const) = .empty;
+        errdefer out.deinit(allocator);
+        var pos: usize = 0;
+        for (sorted) |r| {
+            if (r.payload_ofs < pos or r.len > msg.len - r.payload_ofs) return Error.InvalidArgument;
+            try appendSegment(&out, allocator, msg[pos..r.payload_ofs]);
+            switch (try self.status(&view, r)) {
+                .live => {
+                    if (r.id >= blobs.len or blobs[r.id].len != r.len) return Error.InvalidArgument;
+                    try appendSegment(&out, allocator, blobs[r.id]);
+                },
+                .stale => |kept| {
+                    try appendSegment(&out, allocator, msg[r.payload_ofs..][0..kept]);
+                    var left = r.len - kept;
+                    while (left > 0) {
+                        const n = @min(left, zeros.len);
+                        try appendSegment(&out, allocator, zeros[0..n]);
+                        left -= n;
+                    }
+                },
+            }
+            pos = r.payload_ofs + r.len;
+        }
+        try appendSegment(&out, allocator, msg[pos..]);
+        return out.toOwnedSlice(allocator) catch return Error.OutOfMemory;
+    }
+
+    /// Compare `r` with the current value of its key or element. lite3
+    /// overwrites in place whenever the new value fits, so the offset alone
+    /// does not show that the reservation survived: it must also still be a
+    /// bytes value of the reserved length. (A plain `setBytes` of exactly the
+    /// reserved length is indistinguishable from the reservation.)
+    fn status(self: *const ExternalBlobs, view: *const ConstView, r: Ref) Error!Status {
+        const found = if (r.key) |k|
+            view.find(r.container, self.keys.items[k.start..][0..k.len])
+        else
+            view.findIndex(r.container, r.index);
+        const val = found catch |err| switch (err) {
+            Error.NotFound, Error.InvalidArgument => return .{ .stale = 0 },
+            else => return err,
+        };
+        // The payload follows the type byte and the 4-byte length.
+        if (val + 5 != r.payload_ofs) return .{ .stale = 0 };
+        const end = try view.valueEnd(val);
+        if (try view.typeAt(val) == .bytes and end - r.payload_ofs == r.len) return .live;
+        return .{ .stale = @min(r.len, end -| r.payload_ofs) };
+    }
+
+    fn appendSegment(out: *std.ArrayListUnmanaged(std.posix.iovec_const), allocator: std.mem.Allocator, seg: []const u8) Error!void {
+        if (seg.len == 0) return;
+        out.append(allocator, .{ .base = seg.ptr, .len = seg.len }) catch return Error.OutOfMemory;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Slack capacity for rewritten strings and bytes
+// ---------------------------------------------------------------------------
+
+/// Writes string/bytes values into slots with spare capacity so that later
+/// rewrites that still fit happen in place instead of appending a new entry.
+///
+/// The wire format is unchanged: the length prefix holds the actual length
+/// and the slack after it is zeroed and ignored by readers. Slot capacities
+/// are tracked here, on the writer side, keyed by value offset; a value
+/// written by any other path simply gets a fresh slot on its next rewrite.
+/// Call `clear()` after resetting or re-importing the target buffer.
+///
+/// Targets: `*Buffer` or `*ManagedContext`.
+pub const Slack = struct {
+    policy: Policy = .{ .round_up = 16 },
+    /// Value offset -> payload capacity (length prefix included).
+    slots: std.AutoHashMapUnmanaged(usize, u32) = .empty,
+
+    pub const Policy = union(enum) {
+        /// No slack; capacity equals the current payload size.
+        none,
+        /// Round the payload capacity up to a multiple of this power of two.
+        round_up: u32,
+        /// Reserve this many bytes beyond the current payload size.
+        extra: u32,
+    };
+
+    pub fn deinit(self: *Slack, allocator: std.mem.Allocator) void {
+        self.slots.deinit(allocator);
+        self.* = .{ .policy = self.policy };
+    }
+
+    /// Forget all tracked slots.
+    pub fn clear(self: *Slack) void {
+        self.slots.clearRetainingCapacity();
+    }
+
+    /// Set a string, sizing a new slot by `policy`.
+    pub fn setStr(self: *Slack, allocator: std.mem.Allocator, dst: anytype, ofs: Offset, key: []const u8, value: []const u8) Error!void {
+        return self.write(allocator, dst, ofs, key, .string, value, 0);
+    }
+
+    /// Set a bytes value, sizing a new slot by `policy`.
+    pub fn setBytes(self: *Slack, allocator: std.mem.Allocator, dst: anytype, ofs: Offset, key: []const u8, value: []const u8) Error!void {
+        return self.write(allocator, dst, ofs, key, .bytes, value, 0);
+    }
+
+    /// Set a string; a new slot holds at least `capacity` content bytes.
+    pub fn setStrWithCapacity(self: *Slack, allocator: std.mem.Allocator, dst: anytype, ofs: Offset, key: []const u8, value: []const u8, capacity: usize) Error!void {
+        return self.write(allocator, dst, ofs, key, .string, value, capacity +| 5);
+    }
+
+    /// Set a bytes value; a new slot holds at least `capacity` content bytes.
+    pub fn setBytesWithCapacity(self: *Slack, allocator: std.mem.Allocator, dst: anytype, ofs: Offset, key: []const u8, value: []const u8, capacity: usize) Error!void {
+        return self.write(allocator, dst, ofs, key, .bytes, value, capacity +| 4);
+    }
+
+    fn capacityFor(self: *const Slack, need: usize) usize {
+        return switch (self.policy) {
+            .none => need,
+            .round_up => |r| if (r > 1 and std.math.isPowerOfTwo(r)) std.mem.alignForward(usize, need, r) else need,
+            .extra => |e| need +| e,
+        };
+    }
+
+    fn write(self: *Slack, allocator: std.mem.Allocator, dst: anytype, ofs: Offset, key: []const u8, t: Type, value: []const u8, min_capacity: usize) Error!void {
+        const kz = try SharedMethods(Buffer).toKeyZ(key);
+        const key_z: [*:0]const u8 = @ptrCast(&kz);
+        const kd = KeyData.of(key);
+        const stored = value.len + @intFromBool(t == .string);
+        const n = std.math.cast(u32, stored) orelse return Error.InvalidArgument;
+        const need = 4 + stored;
+        self.slots.ensureUnusedCapacity(allocator, 1) catch return Error.OutOfMemory;
+
+        const b = mutBufferOf(dst);
+        var old: ?usize = null;
+        if (raw_slot.get(b, ofs, key_z, kd)) |v| {
+            const cur = b.buf[v];
+            const reusable = cur == @intFromEnum(Type.string) or cur == @intFromEnum(Type.bytes);
+            if (self.slots.get(v)) |cap| {
+                if (reusable and need <= cap) {
+                    if (b.delta) |tracker| {
+                        try tracker.noteRange(@intFromEnum(ofs), node_size);
+                        try tracker.noteRange(v, 1 + @as(usize, cap));
+                    }
+                    const ret = c.shim_lite3_bump_gen(b.buf, b.len, @intFromEnum(ofs));
+                    if (ret < 0) return translateError(ret);
+                    fill(b.buf[v..], t, n, value);
+                    @memset(b.buf[v + 1 + need .. v + 1 + cap], 0);
+                    return;
+                }
+            }
+            old = v;
+        } else |err| switch (err) {
+            Error.NotFound => {},
+            else => return err,
+        }
+
+        const cap = @max(self.capacityFor(need), min_capacity);
+        const cap32 = std.math.cast(u32, cap) orelse return Error.InvalidArgument;
+        const v = switch (@TypeOf(dst)) {
+            *Buffer => try raw_slot.set(dst, ofs, key_z, kd, t, cap),
+            *ManagedContext => try dst.callWithGrowth(raw_slot.set, .{ dst.innerBuf(), ofs, key_z, kd, t, cap }),
+            else => unreachable,
+        };
+        fill(b.buf[v..], t, n, value);
+        @memset(b.buf[v + 1 + need .. v + 1 + cap], 0);
+        if (old) |o| _ = self.slots.remove(o);
+        self.slots.putAssumeCapacity(v, cap32);
+    }
+
+    /// Write type byte, length prefix, content and (for strings) the NUL.
+    fn fill(out: [*]u8, t: Type, n: u32, value: []const u8) void {
+        out[0] = @intFromEnum(t);
+        std.mem.writeInt(u32, out[1..5], n, .little);
+        @memcpy(out[5..][0..value.len], value);
+        if (t == .string) out[5 + value.len] = 0;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Memory-mapped documents
+// ---------------------------------------------------------------------------
+
+/// A read-only document backed by a private file mapping.
+///
+/// `open` maps the file without reading it: the mapping is advised
+/// `MADV_RANDOM` so faults do not pull in readahead, and only the first
+/// page (the root node) is advised `MADV_WILLNEED` and its type checked at
+/// open. Lookups go through
+/// `view`, which validates each node as it is reached, so a point lookup
+/// pages in just the nodes on its root-to-leaf path plus the value.
+///
+/// The file must not be truncated while mapped.
+pub const MappedDocument = struct {
+    /// Read API over the mapping.
+    view: ConstView,
+    mem: []align(std.heap.page_size_min) u8,
+
+    pub const OpenError = std.fs.File.OpenError || std.fs.File.StatError || std.posix.MMapError || Error;
+
+    /// Map `path`, relative to the current working directory.
+    pub fn open(path: []const u8) OpenError!MappedDocument {
+        return openAt(std.fs.cwd(), path);
+    }
+
+    /// Map `sub_path`, relative to `dir`.
+    pub fn openAt(dir: std.fs.Dir, sub_path: []const u8) OpenError!MappedDocument {
+        const file = try dir.openFile(sub_path, .{});
+        defer file.close(); // the mapping keeps its own reference
+        return fromFile(file);
+    }
+
+    /// Map an already-open file. The caller keeps ownership of `file`.
+    pub fn fromFile(file: std.fs.File) OpenError!MappedDocument {
+        const size = (try file.stat()).size;
+        if (size < node_size or size > std.math.maxInt(u32)) return Error.InvalidArgument;
+        const len: usize = @intCast(size);
+        const mem = try std.posix.mmap(null, len, std.posix.PROT.READ, .{ .TYPE = .PRIVATE }, file.handle, 0);
+        // Advice is only a hint; failures are harmless.
+        std.posix.madvise(mem.ptr, mem.len, std.posix.MADV.RANDOM) catch {};
+        std.posix.madvise(mem.ptr, @min(mem.len, std.heap.pageSize()), std.posix.MADV.WILLNEED) catch {};
+        // The root byte is on the page just advised; checking it keeps the
+        // rest of the mapping untouched.
+        const view = ConstView.init(mem) catch |err| {
+            std.posix.munmap(mem);
+            return err;
+        };
+        return .{ .view = view, .mem = mem };
+    }
+
+    pub fn close(self: *MappedDocument) void {
+        std.posix.munmap(self.mem);
+        self.* = undefined;
+    }
+
+    /// Re-check the root node; `fromFile` already checked its type.
+    pub fn validate(self: *const MappedDocument) Error!void {
+        _ = try ConstView.init(self.mem);
+    }
+
+    /// Hint that `[start, start + len)` will be read soon, e.g. before a
+    /// full iteration of a large subtree.
+    pub fn willNeed(self: *const MappedDocument, start: usize, len: usize) void {
+        const page = std.heap.pageSize();
+        const lo = std.mem.alignBackward(usize, @min(start, self.mem.len), page);
+        const hi = @min(self.mem.len, start +| len);
+        if (hi <= lo) return;
+        std.posix.madvise(@alignCast(self.mem.ptr + lo), hi - lo, std.posix.MADV.WILLNEED) catch {};
+    }
+
+    /// The mapped bytes.
+    pub fn data(self: *const MappedDocument) []const u8 {
+        return self.mem;
+    }
+};
+
+/// A document stored in a shared, writable file mapping.
+///
+/// File layout: a `header_size`-byte header (magic, version, committed
+/// `buflen`, sync epoch) followed by the Lite3 buffer. Writes go straight
+/// to the mapping; the file is grown with `ftruncate` + `mremap` when a
+/// write runs out of space. `sync()` makes the current state durable in
+/// three ordered steps: bytes appended since the last sync, then the
+/// already-committed prefix (in-place node and value updates), then the
+/// header's `buflen` and epoch. `open` trusts only the committed `buflen`.
+///
+/// The kernel may write back dirty pages of a shared mapping at any time,
+/// so in-place updates can reach the file before `sync()`. Each write
+/// therefore first appends the committed bytes it can change (its write
+/// footprint, as in `DeltaTracker`) to an undo journal at
+/// `<path>-journal` and `fdatasync`s it. `open` copies the pre-images back
+/// when the journal belongs to the committed epoch, so a crash at any point
+/// leaves the state of the last completed `sync()`. Writes that touch
+/// already-synced bytes cost one journal `fdatasync` each.
+pub const PersistentDocument = struct {
+    file: std.fs.File,
+    journal: std.fs.File,
+    map: []align(std.heap.page_size_min) u8,
+    inner: Buffer,
+    synced_len: usize,
+    epoch: u64,
+    journal_len: u64,
+    journal_prev: u64,
+
+    pub const header_size: usize = 64;
+    const header_magic = "L3PD".*;
+    const header_version: u32 = 1;
+    const buflen_ofs: usize = 8;
+    const epoch_ofs: usize = 16;
+    const max_file_size: usize = header_size + std.math.maxInt(u32);
+
+    // Journal: magic, 4 zero bytes, epoch; then records of
+    // {prev record position, start, len, crc32c} followed by `len` pre-image
+    // bytes. The CRC covers the epoch, the record header and the bytes, so
+    // torn or leftover records from an older epoch end the scan.
+    const journal_magic = "L3UJ".*;
+    const journal_header_size: usize = 16;
+    const journal_record_size: usize = 24;
+
+    pub const SyncError = std.posix.MSyncError || std.fs.File.PWriteError || std.fs.File.SetEndPosError;
+    pub const OpenError = std.fs.File.OpenError || std.fs.File.StatError || std.fs.File.PReadError ||
+        std.posix.MMapError || SyncError || Error;
+
+    /// Open or create `path`, relative to the current working directory.
+    /// A new or empty file is initialized with an empty object root.
+    pub fn open(path: []const u8) OpenError!PersistentDocument {
+        return openAt(std.fs.cwd(), path);
+    }
+
+    /// Open or create `sub_path`, relative to `dir`.
+    pub fn openAt(dir: std.fs.Dir, sub_path: []const u8) OpenError!PersistentDocument {
+        const file = try dir.createFile(sub_path, .{ .read = true, .truncate = false });
+        errdefer file.close();
+
+        var size = (try file.stat()).size;
+        const fresh = size == 0;
+        if (fresh) {
+            size = std.mem.alignForward(usize, header_size + ManagedContext.default_capacity, std.heap.pageSize());
+            try file.setEndPos(size);
+        }
+        if (size < header_size + node_size or size > max_file_size) return Error.CorruptData;
+
+        const map = try std.posix.mmap(null, @intCast(size), std.posix.PROT.READ | std.posix.PROT.WRITE, .{ .TYPE = .SHARED }, file.handle, 0);
+        errdefer std.posix.munmap(map);
+
+        var buflen: u64 = 0;
+        if (fresh) {
+            @memset(map[0..header_size], 0);
+            map[0..4].* = header_magic;
+            std.mem.writeInt(u32, map[4..8], header_version, .little);
+        } else {
+            if (!std.mem.eql(u8, map[0..4], &header_magic)) return Error.CorruptData;
+            if (std.mem.readInt(u32, map[4..8], .little) != header_version) return Error.CorruptData;
+            buflen = std.mem.readInt(u64, map[buflen_ofs..][0..8], .little);
+            if (buflen < node_size or buflen > map.len - header_size) return Error.CorruptData;
+        }
+
+        var name_buf: [std.fs.max_path_bytes]u8 = undefined;
+        const journal_path = std.fmt.bufPrint(&name_buf, "{s}-journal", .{sub_path}) catch return error.NameTooLong;
+        const journal = try dir.createFile(journal_path, .{ .read = true, .truncate = false });
+        errdefer journal.close();
+
+        var self: PersistentDocument = .{
+            .file = file,
+            .journal = journal,
+            .map = map,
+            .inner = undefined,
+            .synced_len = 0,
+            .epoch = std.mem.readInt(u64, map[epoch_ofs..][0..8], .little),
+            .journal_len = journal_header_size,
+            .journal_prev = 0,
+        };
+        if (fresh) {
+            self.inner = try Buffer.initObj(self.region());
+            try self.sync();
+        } else {
+            const r = self.region();
+            self.inner = .{ .buf = r.ptr, .len = @intCast(buflen), .capacity = r.len };
+            self.synced_len = self.inner.len;
+            try self.recover();
+            try self.resetJournal();
+        }
+        return self;
+    }
+
+    /// Unmap and close. Changes since the last `sync()` may reach the file,
+    /// but the next `open` rolls them back.
+    pub fn close(self: *PersistentDocument) void {
+        std.posix.munmap(self.map);
+        self.journal.close();
+        self.file.close();
+        self.* = undefined;
+    }
+
+    inline fn region(self: *PersistentDocument) []align(4) u8 {
+        return self.map[header_size..];
+    }
+
+    /// Flush `[start, start + len)` of the mapping, widened to whole pages.
+    fn flush(self: *PersistentDocument, start: usize, len: usize) SyncError!void {
+        if (len == 0) return;
+        const lo = std.mem.alignBackward(usize, start, std.heap.pageSize());
+        const hi = @min(self.map.len, start + len);
+        try std.posix.msync(@alignCast(self.map[lo..hi]), std.posix.MSF.SYNC);
+    }
+
+    /// Make the current buffer durable; see the type comment for ordering.
+    pub fn sync(self: *PersistentDocument) SyncError!void {
+        const len = self.inner.len;
+        // 1. Appended data, so nothing committed below can point at lost bytes.
+        if (len > self.synced_len) try self.flush(header_size + self.synced_len, len - self.synced_len);
+        // 2. In-place updates inside the committed prefix.
+        try self.flush(header_size, @min(self.synced_len, len));
+        // 3. Commit the new length. Bumping the epoch retires the journal.
+        std.mem.writeInt(u64, self.map[buflen_ofs..][0..8], len, .little);
+        std.mem.writeInt(u64, self.map[epoch_ofs..][0..8], self.epoch + 1, .little);
+        try self.flush(0, header_size);
+        self.synced_len = len;
+        self.epoch += 1;
+        try self.resetJournal();
+    }
+
+    /// Start an empty journal for the current epoch. Not synced here: the
+    /// first record's `fdatasync` persists it, and until then the old
+    /// journal's epoch no longer matches the header.
+    fn resetJournal(self: *PersistentDocument) SyncError!void {
+        var jh = [_]u8{0} ** journal_header_size;
+        jh[0..4].* = journal_magic;
+        std.mem.writeInt(u64, jh[8..16], self.epoch, .little);
+        try self.journal.pwriteAll(&jh, 0);
+        try self.journal.setEndPos(journal_header_size);
+        self.journal_len = journal_header_size;
+        self.journal_prev = 0;
+    }
+
+    fn journalCrc(epoch: u64, record_header: []const u8, bytes: []const u8) u32 {
+        var e: [8]u8 = undefined;
+        std.mem.writeInt(u64, &e, epoch, .little);
+        return crc32c.update(crc32c.update(crc32c.checksum(&e), record_header), bytes);
+    }
+
+    /// Append the pre-image of the committed part of `[start, start + len)`.
+    /// Returns whether a record was written.
+    fn journalRange(self: *PersistentDocument, start: usize, len: usize) Error!bool {
+        if (start >= self.synced_len or len == 0) return false;
+        const pre = self.inner.buf[start..][0..@min(len, self.synced_len - start)];
+        var hdr: [journal_record_size]u8 = undefined;
+        std.mem.writeInt(u64, hdr[0..8], self.journal_prev, .little);
+        std.mem.writeInt(u64, hdr[8..16], start, .little);
+        std.mem.writeInt(u32, hdr[16..20], @intCast(pre.len), .little);
+        std.mem.writeInt(u32, hdr[20..24], journalCrc(self.epoch, hdr[0..20], pre), .little);
+        self.journal.pwriteAll(&hdr, self.journal_len) catch return Error.Unexpected;
+        self.journal.pwriteAll(pre, self.journal_len + hdr.len) catch return Error.Unexpected;
+        self.journal_prev = self.journal_len;
+        self.journal_len += hdr.len + pre.len;
+        return true;
+    }
+
+    /// Journal the footprint of a write (see `shim_lite3_write_footprint`)
+    /// and make it durable before the write touches the mapping.
+    fn journalWrite(self: *PersistentDocument, ofs: Offset, key: ?[*:0]const u8, hash: u32, size: u32) Error!void {
+        var starts: [DeltaTracker.footprint_max]usize = undefined;
+        var lens: [DeltaTracker.footprint_max]usize = undefined;
+        const ret = c.shim_lite3_write_footprint(self.inner.buf, self.inner.len, @intFromEnum(ofs), key, hash, size, &starts, &lens, DeltaTracker.footprint_max);
+        var wrote = false;
+        if (ret < 0) {
+            // Pathological probe chains: journal the whole committed prefix.
+            const err = translateError(ret);
+            if (err != Error.NoBufferSpace) return err;
+            wrote = try self.journalRange(0, self.synced_len);
+        } else {
+            for (starts[0..@intCast(ret)], lens[0..@intCast(ret)]) |s, l| wrote = (try self.journalRange(s, l)) or wrote;
+        }
+        if (wrote) std.posix.fdatasync(self.journal.handle) catch return Error.Unexpected;
+    }
+
+    fn journalSet(self: *PersistentDocument, ofs: Offset, key: []const u8) Error!void {
+        const kz = try SharedMethods(Buffer).toKeyZ(key);
+        const kd = KeyData.of(key);
+        return self.journalWrite(ofs, @ptrCast(&kz), kd.hash, kd.size);
+    }
+
+    fn journalAppend(self: *PersistentDocument, ofs: Offset) Error!void {
+        return self.journalWrite(ofs, null, try self.inner.count(ofs), 0);
+    }
+
+    /// Undo unsynced in-place writes recorded in a journal of the committed
+    /// epoch. Records are validated front to back, then applied back to
+    /// front so the oldest pre-image of each byte wins.
+    fn recover(self: *PersistentDocument) OpenError!void {
+        var jh: [journal_header_size]u8 = undefined;
+        if ((try self.journal.preadAll(&jh, 0)) < jh.len) return;
+        if (!std.mem.eql(u8, jh[0..4], &journal_magic)) return;
+        if (std.mem.readInt(u64, jh[8..16], .little) != self.epoch) return;
+
+        var hdr: [journal_record_size]u8 = undefined;
+        var chunk: [4096]u8 = undefined;
+        var pos: u64 = journal_header_size;
+        var last: ?u64 = null;
+        scan: while (true) {
+            if ((try self.journal.preadAll(&hdr, pos)) < hdr.len) break;
+            const start = std.mem.readInt(u64, hdr[8..16], .little);
+            const n = std.mem.readInt(u32, hdr[16..20], .little);
+            if (std.mem.readInt(u64, hdr[0..8], .little) != (last orelse 0)) break;
+            if (start > self.synced_len or n > self.synced_len - start) break;
+            var crc = journalCrc(self.epoch, hdr[0..20], "");
+            var done: usize = 0;
+            while (done < n) {
+                const want = @min(chunk.len, n - done);
+                if ((try self.journal.preadAll(chunk[0..want], pos + hdr.len + done)) < want) break :scan;
+                crc = crc32c.update(crc, chunk[0..want]);
+                done += want;
+            }
+            if (crc != std.mem.readInt(u32, hdr[20..24], .little)) break;
+            last = pos;
+            pos += hdr.len + n;
+        }
+
+        var cur = last orelse return;
+        while (true) {
+            _ = try self.journal.preadAll(&hdr, cur);
+            const start: usize = @intCast(std.mem.readInt(u64, hdr[8..16], .little));
+            const n = std.mem.readInt(u32, hdr[16..20], .little);
+            _ = try self.journal.preadAll(self.inner.buf[start..][0..n], cur + hdr.len);
+            if (cur == journal_header_size) break;
+            cur = std.mem.readInt(u64, hdr[0..8], .little);
+        }
+        try self.flush(header_size, self.synced_len);
+    }
+
+    fn grow(self: *PersistentDocument) Error!void {
+        if (self.map.len >= max_file_size) return Error.NoBufferSpace;
+        const new_size = @min(max_file_size, std.mem.alignForward(usize, self.map.len * 2, std.heap.pageSize()));
+        self.file.setEndPos(new_size) catch return Error.NoBufferSpace;
+        const map = if (builtin.os.tag == .linux)
+            std.posix.mremap(self.map.ptr, self.map.len, new_size, .{ .MAYMOVE = true }, null) catch return Error.OutOfMemory
+        else blk: {
+            const m = std.posix.mmap(null, new_size, std.posix.PROT.READ | std.posix.PROT.WRITE, .{ .TYPE = .SHARED }, self.file.handle, 0) catch return Error.OutOfMemory;
+            std.posix.munmap(self.map);
+            break :blk m;
+        };
+        self.map = map;
+        const r = self.region();
+        self.inner.buf = r.ptr;
+        self.inner.capacity = r.len;
+    }
+
+    fn callWithGrowth(self: *PersistentDocument, comptime func: anytype, args: anytype) @TypeOf(@call(.auto, func, args)) {
+        while (true) {
+            return @call(.auto, func, args) catch |err| switch (err) {
+                Error.NoBufferSpace => {
+                    try self.grow();
+                    continue;
+                },
+                else => return err,
+            };
+        }
+    }
+
+    /// Read access to the live buffer. Invalidated by writes that grow the file.
+    pub fn buffer(self: *const PersistentDocument) *const Buffer {
+        return &self.inner;
+    }
+
+    /// Return the current used bytes.
+    pub fn data(self: *const PersistentDocument) []const u8 {
+        return self.inner.data();
+    }
+
+    // --- Mutating operations (journal, then grow the file on NoBufferSpace) ---
+
+    pub fn setNull(self: *PersistentDocument, ofs: Offset, key: []const u8) Error!void {
+        try self.journalSet(ofs, key);
+        return self.callWithGrowth(Buffer.setNull, .{ &self.inner, ofs, key });
+    }
+
+    pub fn setBool(self: *PersistentDocument, ofs: Offset, key: []const u8, value: bool) Error!void {
+        try self.journalSet(ofs, key);
+        return self.callWithGrowth(Buffer.setBool, .{ &self.inner, ofs, key, value });
+    }
+
+    pub fn setI64(self: *PersistentDocument, ofs: Offset, key: []const u8, value: i64) Error!void {
+        try self.journalSet(ofs, key);
+        return self.callWithGrowth(Buffer.setI64, .{ &self.inner, ofs, key, value });
+    }
+
+    pub fn setF64(self: *PersistentDocument, ofs: Offset, key: []const u8, value: f64) Error!void {
+        try self.journalSet(ofs, key);
+        return self.callWithGrowth(Buffer.setF64, .{ &self.inner, ofs, key, value });
+    }
+
+    pub fn setStr(self: *PersistentDocument, ofs: Offset, key: []const u8, value: []const u8) Error!void {
+        try self.journalSet(ofs, key);
+        return self.callWithGrowth(Buffer.setStr, .{ &self.inner, ofs, key, value });
+    }
+
+    pub fn setBytes(self: *PersistentDocument, ofs: Offset, key: []const u8, value: []const u8) Error!void {
+        try self.journalSet(ofs, key);
+        return self.callWithGrowth(Buffer.setBytes, .{ &self.inner, ofs, key, value });
+    }
+
+    pub fn setObj(self: *PersistentDocument, ofs: Offset, key: []const u8) Error!Offset {
+        try self.journalSet(ofs, key);
+        return self.callWithGrowth(Buffer.setObj, .{ &self.inner, ofs, key });
+    }
+
+    pub fn setArr(self: *PersistentDocument, ofs: Offset, key: []const u8) Error!Offset {
+        try self.journalSet(ofs, key);
+        return self.callWithGrowth(Buffer.setArr, .{ &self.inner, ofs, key });
+    }
+
+    pub fn arrAppendNull(self: *PersistentDocument, ofs: Offset) Error!void {
+        try self.journalAppend(ofs);
+        return self.callWithGrowth(Buffer.arrAppendNull, .{ &self.inner, ofs });
+    }
+
+    pub fn arrAppendBool(self: *PersistentDocument, ofs: Offset, value: bool) Error!void {
+        try self.journalAppend(ofs);
+        return self.callWithGrowth(Buffer.arrAppendBool, .{ &self.inner, ofs, value });
+    }
+
+    pub fn arrAppendI64(self: *PersistentDocument, ofs: Offset, value: i64) Error!void {
+        try self.journalAppend(ofs);
+        return self.callWithGrowth(Buffer.arrAppendI64, .{ &self.inner, ofs, value });
+    }
+
+    pub fn arrAppendF64(self: *PersistentDocument, ofs: Offset, value: f64) Error!void {
+        try self.journalAppend(ofs);
+        return self.callWithGrowth(Buffer.arrAppendF64, .{ &self.inner, ofs, value });
+    }
+
+    pub fn arrAppendStr(self: *PersistentDocument, ofs: Offset, value: []const u8) Error!void {
+        try self.journalAppend(ofs);
+        return self.callWithGrowth(Buffer.arrAppendStr, .{ &self.inner, ofs, value });
+    }
+
+    pub fn arrAppendBytes(self: *PersistentDocument, ofs: Offset, value: []const u8) Error!void {
+        try self.journalAppend(ofs);
+        return self.callWithGrowth(Buffer.arrAppendBytes, .{ &self.inner, ofs, value });
+    }
+
+    pub fn arrAppendObj(self: *PersistentDocument, ofs: Offset) Error!Offset {
+        try self.journalAppend(ofs);
+        return self.callWithGrowth(Buffer.arrAppendObj, .{ &self.inner, ofs });
+    }
+
+    pub fn arrAppendArr(self: *PersistentDocument, ofs: Offset) Error!Offset {
+        try self.journalAppend(ofs);
+        return self.callWithGrowth(Buffer.arrAppendArr, .{ &self.inner, ofs });
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Checksums
+// ---------------------------------------------------------------------------
+
+/// CRC-32C (Castagnoli), as used by iSCSI, ext4 and SCTP.
+///
+/// Uses the SSE4.2 `crc32` or ARMv8 `crc32c*` instructions when the CPU
+/// has them and slicing-by-8 tables otherwise. Builds for a baseline target
+/// check the running CPU once (CPUID, or `AT_HWCAP` on Linux/AArch64), like
+/// the base64 codec does.
+pub const crc32c = struct {
+    const poly: u32 = 0x82f63b78; // reflected 0x1EDC6F41
+
+    /// The target guarantees the CRC instructions.
+    const hw_static = switch (builtin.cpu.arch) {
+        .x86_64 => std.Target.x86.featureSetHas(builtin.cpu.features, .sse4_2),
+        .aarch64 => std.Target.aarch64.featureSetHas(builtin.cpu.features, .crc),
+        else => false,
+    };
+    /// The running CPU may still have them.
+    const hw_probe = !hw_static and switch (builtin.cpu.arch) {
+        .x86_64 => true,
+        .aarch64 => builtin.os.tag == .linux,
+        else => false,
+    };
+
+    const hw_unknown: u8 = 0;
+    const hw_absent: u8 = 1;
+    const hw_present: u8 = 2;
+    /// Idempotent lazy init: concurrent first callers store the same value.
+    var hw_state = std.atomic.Value(u8).init(hw_unknown);
+
+    inline fn hwAvailable() bool {
+        if (hw_static) return true;
+        if (!hw_probe) return false;
+        var state = hw_state.load(.monotonic);
+        if (state == hw_unknown) {
+            state = if (detectHw()) hw_present else hw_absent;
+            hw_state.store(state, .monotonic);
+        }
+        return state == hw_present;
+    }
+
+    fn detectHw() bool {
+        switch (builtin.cpu.arch) {
+            .x86_64 => {
+                var eax: u32 = undefined;
+                var ebx: u32 = undefined;
+                var ecx: u32 = undefined;
+                var edx: u32 = undefined;
+                asm volatile ("cpuid"
+                    : [_] "={eax}" (eax),
+                      [_] "={ebx}" (ebx),
+                      [_] "={ecx}" (ecx),
+                      [_] "={edx}" (edx),
+                    : [_] "{eax}" (@as(u32, 1)),
+                      [_] "{ecx}" (@as(u32, 0)),
+                );
+                return ecx & (1 << 20) != 0; // SSE4.2
+            },
+            // HWCAP_CRC32
+            .aarch64 => return if (builtin.os.tag == .linux) std.os.linux.getauxval(std.elf.AT_HWCAP) & (1 << 7) != 0 else false,
+            else => return false,
+        }
+    }
+
+    /// Bytes per stream in one round of the three-stream loop.
+    const stream_block: usize = 4096;
+    /// x^(8 * stream_block) mod P: moves a CRC past one stream block.
+    const stream_shift: u32 = blk: {
+        @setEvalBranchQuota(10000);
+        break :blk x2nModP(stream_block, 3);
+    };
+
+    const tables: [8][256]u32 = blk: {
+        @setEvalBranchQuota(20000);
+        var t: [8][256]u32 = undefined;
+        for (0..256) |i| {
+            var crc: u32 = @intCast(i);
+            for (0..8) |_| crc = if (crc & 1 != 0) (crc >> 1) ^ poly else crc >> 1;
+            t[0][i] = crc;
+        }
+        for (0..256) |i| {
+            for (1..8) |k| t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+        }
+        break :blk t;
+    };
+
+    /// Continue a checksum over `bytes`; start from 0.
+    /// `update(update(0, a), b) == checksum(a ++ b)`.
+    pub fn update(crc: u32, bytes: []const u8) u32 {
+        if (hwAvailable()) return updateHw(crc, bytes);
+        var c = ~crc;
+        var p = bytes;
+        while (p.len >= 8) : (p = p[8..]) c = slice8(c, std.mem.readInt(u64, p[0..8], .little));
+        for (p) |b| c = (c >> 8) ^ tables[0][(c ^ b) & 0xff];
+        return ~c;
+    }
+
+    /// A single crc32 chain is bound by the instruction's latency (3 cycles
+    /// per 8 bytes on x86). Large inputs instead run three independent
+    /// chains over adjacent blocks and shift the partial CRCs together.
+    fn updateHw(crc: u32, bytes: []const u8) u32 {
+        var c = ~crc;
+        var p = bytes;
+        while (p.len >= 3 * stream_block) : (p = p[3 * stream_block ..]) {
+            var c0 = c;
+            var c1: u32 = 0xffffffff;
+            var c2: u32 = 0xffffffff;
+            var i: usize = 0;
+            while (i < stream_block) : (i += 8) {
+                c0 = hw64(c0, std.mem.readInt(u64, p[i..][0..8], .little));
+                c1 = hw64(c1, std.mem.readInt(u64, p[stream_block + i ..][0..8], .little));
+                c2 = hw64(c2, std.mem.readInt(u64, p[2 * stream_block + i ..][0..8], .little));
+            }
+            // As in `combine`, on the finalized CRCs of each block.
+            const ab = multModP(stream_shift, ~c0) ^ ~c1;
+            c = ~(multModP(stream_shift, ab) ^ ~c2);
+        }
+        while (p.len >= 8) : (p = p[8..]) c = hw64(c, std.mem.readInt(u64, p[0..8], .little));
+        for (p) |b| c = hw8(c, b);
+        return ~c;
+    }
+
+    /// Checksum of `bytes`.
+    pub fn checksum(bytes: []const u8) u32 {
+        return update(0, bytes);
+    }
+
+    inline fn slice8(c: u32, v: u64) u32 {
+        const x = v ^ c;
+        return tables[7][x & 0xff] ^ tables[6][(x >> 8) & 0xff] ^
+            tables[5][(x >> 16) & 0xff] ^ tables[4][(x >> 24) & 0xff] ^
+            tables[3][(x >> 32) & 0xff] ^ tables[2][(x >> 40) & 0xff] ^
+            tables[1][(x >> 48) & 0xff] ^ tables[0][x >> 56];
+    }
+
+    inline fn hw64(c: u32, v: u64) u32 {
+        return switch (builtin.cpu.arch) {
+            .x86_64 => @truncate(asm ("crc32q %[v], %[c]"
+                : [c] "=r" (-> u64),
+                : [v] "r" (v),
+                  [in] "0" (@as(u64, c)),
+            )),
+            .aarch64 => asm (".arch_extension crc\n\tcrc32cx %[out:w], %[in:w], %[v:x]"
+                : [out] "=r" (-> u32),
+                : [in] "r" (c),
+                  [v] "r" (v),
+            ),
+            else => unreachable,
+        };
+    }
+
+    inline fn hw8(c: u32, b: u8) u32 {
+        return switch (builtin.cpu.arch) {
+            .x86_64 => asm ("crc32b %[b], %[c]"
+                : [c] "=r" (-> u32),
+                : [b] "r" (b),
+                  [in] "0" (c),
+            ),
+            .aarch64 => asm (".arch_extension crc\n\tcrc32cb %[out:w], %[in:w], %[b:w]"
+                : [out] "=r" (-> u32),
+                : [in] "r" (c),
+                  [b] "r" (@as(u32, b)),
+            ),
+            else => unreachable,
+        };
+    }
+
+    // --- Combining (GF(2) arithmetic modulo the polynomial, as in zlib) ---
+
+    /// a * b mod P, both in reflected bit order.
+    fn multModP(a: u32, b_in: u32) u32 {
+        var b = b_in;
+        var m: u32 = 1 << 31;
+        var p: u32 = 0;
+        while (true) {
+            if (a & m != 0) {
+                p ^= b;
+                if (a & (m - 1) == 0) break;
+            }
+            m >>= 1;
+            b = if (b & 1 != 0) (b >> 1) ^ poly else b >> 1;
+        }
+        return p;
+    }
+
+    /// x^(2^k) mod P for k = 0..31.
+    const x2n_table: [32]u32 = blk: {
+        @setEvalBranchQuota(100000);
+        var t: [32]u32 = undefined;
+        var p: u32 = 1 << 30; // x^1
+        t[0] = p;
+        for (1..32) |k| {
+            p = multModP(p, p);
+            t[k] = p;
+        }
+        break :blk t;
+    };
+
+    /// x^(n * 2^k) mod P.
+    fn x2nModP(n_in: u64, k_in: u32) u32 {
+        var n = n_in;
+        var k = k_in;
+        var p: u32 = 1 << 31; // x^0
+        while (n != 0) : ({
+            n >>= 1;
+            k += 1;
+        }) {
+            if (n & 1 != 0) p = multModP(x2n_table[k & 31], p);
+        }
+        return p;
+    }
+
+    /// Checksum of `a ++ b` from `checksum(a)`, `checksum(b)` and `b.len`.
+    pub fn combine(crc_a: u32, crc_b: u32, len_b: u64) u32 {
+        return multModP(x2nModP(len_b, 3), crc_a) ^ crc_b;
+    }
+
+    /// Checksum of a growing, partly rewritten buffer (a Lite3 message).
+    ///
+    /// Every set also rewrites nodes inside the already-checksummed prefix,
+    /// so "only hash the appended bytes" is not enough. Instead this keeps
+    /// a CRC per `block_size` block: `checksum` rehashes blocks marked with
+    /// `invalidate` (or `invalidateTracked`), new blocks and the partial
+    /// tail, then folds the block CRCs with `combine`.
+    pub const Incremental = struct {
+        crcs: std.ArrayListUnmanaged(u32) = .empty,
+        stale: std.ArrayListUnmanaged(bool) = .empty,
+
+        pub const block_size: usize = 4096;
+        const block_op: u32 = x2nModP(block_size, 3);
+
+        pub fn deinit(self: *Incremental, allocator: std.mem.Allocator) void {
+            self.crcs.deinit(allocator);
+            self.stale.deinit(allocator);
+            self.* = .{};
+        }
+
+        /// Mark `[start, start + len)` as rewritten in place.
+        pub fn invalidate(self: *Incremental, start: usize, len: usize) void {
+            if (len == 0) return;
+            const first = start / block_size;
+            const last = @min(self.stale.items.len, (start +| (len - 1)) / block_size + 1);
+            if (first < last) @memset(self.stale.items[first..last], true);
+        }
+
+        /// Invalidate every range a `DeltaTracker` noted since its checkpoint.
+        pub fn invalidateTracked(self: *Incremental, tracker: *const DeltaTracker) void {
+            for (tracker.ranges.items) |r| self.invalidate(r.start, r.end - r.start);
+        }
+
+        /// Checksum of `bytes`, which must be the same buffer as in earlier
+        /// calls with every in-place change since then invalidated.
+        pub fn checksum(self: *Incremental, allocator: std.mem.Allocator, bytes: []const u8) Error!u32 {
+            const full = bytes.len / block_size;
+            if (full < self.crcs.items.len) {
+                self.crcs.shrinkRetainingCapacity(full);
+                self.stale.shrinkRetainingCapacity(full);
+            }
+            const old = self.crcs.items.len;
+            self.crcs.resize(allocator, full) catch return Error.OutOfMemory;
+            self.stale.resize(allocator, full) catch return Error.OutOfMemory;
+            @memset(self.stale.items[old..], true);
+
+            var crc: u32 = 0;
+            for (self.crcs.items, self.stale.items, 0..) |*block_crc, *stale, i| {
+                if (stale.*) {
+                    block_crc.* = crc32c.checksum(bytes[i * block_size ..][0..block_size]);
+                    stale.* = false;
+                }
+                crc = multModP(block_op, crc) ^ block_crc.*;
+            }
+            return update(crc, bytes[full * block_size ..]);
+        }
+    };
+};
+
+// ---------------------------------------------------------------------------
+// Compression
+// ---------------------------------------------------------------------------
+
+/// Byte-oriented LZ77 codec (LZ4-style sequences, no entropy stage).
+///
+/// A block is a series of sequences:
+///
+///   token u8     high nibble literal count, low nibble match length - 4
+///                (15 in either means extension bytes follow)
+///   ext          literal count - 15 as 255-runs plus a final byte < 255
+///   literals
+///   offset u16   little-endian match distance, 1...65535
+///   ext          match length - 19, as above
+///
+/// The last sequence ends with its literals. Lite3 messages compress well
+/// with this alone: node headers and keys repeat, zeroed padding becomes
+/// distance-1 runs, and the encoder tries the previous distance before the
+/// hash table, which catches repeated records at a fixed stride.
+pub const lz = struct {
+    pub const min_match: usize = 4;
+    pub const max_offset: usize = 65535;
+    const hash_bits = 14;
+
+    /// Largest compressed size for `len` input bytes.
+    pub fn compressBound(len: usize) usize {
+        return len + len / 255 + 16;
+    }
+
+    /// Compress `src` into `dst` and return the compressed length.
+    /// `NoBufferSpace` if `dst` is smaller than needed; `compressBound`
+    /// always suffices.
+    pub fn compress(dst: []u8, src: []const u8) Error!usize {
+        if (src.len > std.math.maxInt(u32)) return Error.InvalidArgument;
+        var table: [1 << hash_bits]u32 = @splat(0);
+        var out: usize = 0;
+        var anchor: usize = 0;
+        var i: usize = 0;
+        var rep: usize = 0;
+        if (src.len >= min_match) {
+            const last = src.len - min_match;
+            while (i <= last) {
+                const seq = read32(src, i);
+                const h = hash(seq);
+                const prev: usize = table[h];
+                table[h] = @intCast(i);
+                var cand: usize = undefined;
+                if (rep != 0 and rep <= i and read32(src, i - rep) == seq) {
+                    cand = i - rep;
+                } else if (prev < i and i - prev <= max_offset and read32(src, prev) == seq) {
+                    cand = prev;
+                } else {
+                    // Skip faster through data that does not match.
+                    i += 1 + ((i - anchor) >> 6);
+                    continue;
+                }
+                var len = min_match + matchLen(src, cand + min_match, i + min_match);
+                while (i > anchor and cand > 0 and src[i - 1] == src[cand - 1]) {
+                    i -= 1;
+                    cand -= 1;
+                    len += 1;
+                }
+                try emit(dst, &out, src[anchor..i], i - cand, len);
+                rep = i - cand;
+                i += len;
+                anchor = i;
+                if (i >= 2 and i + 2 <= src.len) table[hash(read32(src, i - 2))] = @intCast(i - 2);
+            }
+        }
+        try emit(dst, &out, src[anchor..], 0, 0);
+        return out;
+    }
+
+    /// Decompress `src` into `dst` and return the decompressed length.
+    /// Malformed input, or output that would not fit, is `CorruptData`.
+    pub fn decompress(dst: []u8, src: []const u8) Error!usize {
+        var ip: usize = 0;
+        var op: usize = 0;
+        while (true) {
+            if (ip >= src.len) return Error.CorruptData;
+            const token = src[ip];
+            ip += 1;
+            var lit: usize = token >> 4;
+            if (lit == 15) lit += try readExt(src, &ip);
+            if (lit > src.len - ip or lit > dst.len - op) return Error.CorruptData;
+            @memcpy(dst[op..][0..lit], src[ip..][0..lit]);
+            ip += lit;
+            op += lit;
+            if (ip == src.len) return op;
+
+            if (src.len - ip < 2) return Error.CorruptData;
+            const offset: usize = std.mem.readInt(u16, src[ip..][0..2], .little);
+            ip += 2;
+            if (offset == 0 or offset > op) return Error.CorruptData;
+            var len: usize = @as(usize, token & 15) + min_match;
+            if (token & 15 == 15) len += try readExt(src, &ip);
+            if (len > dst.len - op) return Error.CorruptData;
+            if (offset >= len) {
+                @memcpy(dst[op..][0..len], dst[op - offset ..][0..len]);
+            } else if (offset == 1) {
+                @memset(dst[op..][0..len], dst[op - 1]);
+            } else {
+                // Overlapping copy, at most `offset` bytes at a time.
+                var k: usize = 0;
+                while (k < len) {
+                    const n = @min(len - k, offset);
+                    @memcpy(dst[op + k ..][0..n], dst[op + k - offset ..][0..n]);
+                    k += n;
+                }
+            }
+            op += len;
+        }
+    }
+
+    inline fn read32(bytes: []const u8, pos: usize) u32 {
+        return std.mem.readInt(u32, bytes[pos..][0..4], .little);
+    }
+
+    inline fn hash(v: u32) usize {
+        return (v *% 2654435761) >> (32 - hash_bits);
+    }
+
+    /// Length of the common run at `p` and `q` (`p < q`), up to the end of `src`.
+    fn matchLen(src: []const u8, p: usize, q: usize) usize {
+        var n: usize = 0;
+        while (q + n + 8 <= src.len) : (n += 8) {
+            const x = std.mem.readInt(u64, src[p + n ..][0..8], .little) ^
+                std.mem.readInt(u64, src[q + n ..][0..8], .little);
+            if (x != 0) return n + @ctz(x) / 8;
+        }
+        while (q + n < src.len and src[p + n] == src[q + n]) n += 1;
+        return n;
+    }
+
+    /// Write one sequence; `match_len == 0` writes the final literals.
+    fn emit(dst: []u8, out: *usize, literals: []const u8, offset: usize, match_len: usize) Error!void {
+        const worst = 1 + literals.len / 255 + 1 + literals.len + 2 + match_len / 255 + 1;
+        if (worst > dst.len - out.*) return Error.NoBufferSpace;
+        const token_pos = out.*;
+        out.* += 1;
+        var token: u8 = @as(u8, @intCast(@min(literals.len, 15))) << 4;
+        if (literals.len >= 15) writeExt(dst, out, literals.len - 15);
+        @memcpy(dst[out.*..][0..literals.len], literals);
+        out.* += literals.len;
+        if (match_len != 0) {
+            std.mem.writeInt(u16, dst[out.*..][0..2], @intCast(offset), .little);
+            out.* += 2;
+            const extra = match_len - min_match;
+            token |= @intCast(@min(extra, 15));
+            if (extra >= 15) writeExt(dst, out, extra - 15);
+        }
+        dst[token_pos] = token;
+    }
+
+    fn writeExt(dst: []u8, out: *usize, n_in: usize) void {
+        var n = n_in;
+        while (n >= 255) : (n -= 255) {
+            dst[out.*] = 255;
+            out.* += 1;
+        }
+        dst[out.*] = @intCast(n);
+        out.* += 1;
+    }
+
+    fn readExt(src: []const u8, ip: *usize) Error!usize {
+        var n: usize = 0;
+        while (true) {
+            if (ip.* >= src.len) return Error.CorruptData;
+            const b = src[ip.*];
+            ip.* += 1;
+            n += b;
+            if (b != 255) return n;
+        }
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Pack files
+// ---------------------------------------------------------------------------
+
+/// On-disk layout shared by `PackWriter` and `PackReader`:
+///
+///   header   "L3PK", version u32, flags u32, reserved u32
+///   messages each starting at a 4-byte aligned offset, zero padded
+///   index    offsets [count]u64, lengths [count]u32, key hashes [count]u32
+///            (only with `flag_key_hashes`), CRC-32C [count]u32 (only with
+///            `flag_crc32c`)
+///   footer   index offset u64, count u32, "L3PI"
+///
+/// All integers are little-endian.
+pub const pack_format = struct {
+    pub const header_magic = "L3PK".*;
+    pub const footer_magic = "L3PI".*;
+    pub const version: u32 = 1;
+    pub const header_size: usize = 16;
+    pub const footer_size: usize = 16;
+    pub const flag_key_hashes: u32 = 1;
+    pub const flag_crc32c: u32 = 2;
+
+    fn entrySize(flags: u32) usize {
+        return 8 + 4 + hashesSize(flags) + if (flags & flag_crc32c != 0) @as(usize, 4) else 0;
+    }
+
+    fn hashesSize(flags: u32) usize {
+        return if (flags & flag_key_hashes != 0) 4 else 0;
+    }
+};
+
+/// Streams messages into a pack file; see `pack_format`.
+///
+/// Output is staged in memory and written in large chunks. Call `finish()`
+/// to write the index and footer; a pack without them is rejected by
+/// `PackReader`.
+pub const PackWriter = struct {
+    allocator: std.mem.Allocator,
+    file: std.fs.File,
+    flags: u32,
+    pos: u64 = 0,
+    pending: std.ArrayListUnmanaged(u8) = .empty,
+    offsets: std.ArrayListUnmanaged(u64) = .empty,
+    lengths: std.ArrayListUnmanaged(u32) = .empty,
+    hashes: std.ArrayListUnmanaged(u32) = .empty,
+    crcs: std.ArrayListUnmanaged(u32) = .empty,
+
+    pub const Options = struct {
+        /// Store a key-hash column (`KeyData.of(key).hash`) for `appendKeyed`.
+        key_hashes: bool = false,
+        /// Store a CRC-32C of every message for `PackReader.verify`.
+        checksums: bool = false,
+    };
+
+    pub const WriteError = std.fs.File.WriteError || Error;
+
+    const flush_threshold: usize = 256 * 1024;
+
+    /// Start a pack at the beginning of `file`, which the caller owns.
+    pub fn init(allocator: std.mem.Allocator, file: std.fs.File, options: Options) WriteError!PackWriter {
+        var self: PackWriter = .{
+            .allocator = allocator,
+            .file = file,
+            .flags = (if (options.key_hashes) pack_format.flag_key_hashes else 0) |
+                (if (options.checksums) pack_format.flag_crc32c else 0),
+        };
+        errdefer self.deinit();
+        var header: [pack_format.header_size]u8 = @splat(0);
+        header[0..4].* = pack_format.header_magic;
+        std.mem.writeInt(u32, header[4..8], pack_format.version, .little);
+        std.mem.writeInt(u32, header[8..12], self.flags, .little);
+        try self.stage(&header);
+        return self;
+    }
+
+    pub fn deinit(self: *PackWriter) void {
+        self.pending.deinit(self.allocator);
+        self.offsets.deinit(self.allocator);
+        self.lengths.deinit(self.allocator);
+        self.hashes.deinit(self.allocator);
+        self.crcs.deinit(self.allocator);
+        self.* = undefined;
+    }
+
+    /// Number of messages appended so far.
+    pub fn count(self: *const PackWriter) usize {
+        return self.offsets.items.len;
+    }
+
+    /// Append one serialized message (`Buffer.data()` or equivalent).
+    pub fn append(self: *PackWriter, msg: []const u8) WriteError!void {
+        return self.appendHashed(msg, 0);
+    }
+
+    /// Append a message and record `key`'s hash in the key-hash column.
+    pub fn appendKeyed(self: *PackWriter, msg: []const u8, key: []const u8) WriteError!void {
+        if (self.flags & pack_format.flag_key_hashes == 0) return Error.InvalidArgument;
+        return self.appendHashed(msg, KeyData.of(key).hash);
+    }
+
+    fn appendHashed(self: *PackWriter, msg: []const u8, hash: u32) WriteError!void {
+        if (msg.len < node_size) return Error.InvalidArgument;
+        const len = std.math.cast(u32, msg.len) orelse return Error.InvalidArgument;
+        if (self.offsets.items.len == std.math.maxInt(u32)) return Error.NoBufferSpace;
+        const pad: usize = @intCast(std.mem.alignForward(u64, self.pos, 4) - self.pos);
+        const zeros = [_]u8{ 0, 0, 0 };
+        try self.stage(zeros[0..pad]);
+        self.offsets.append(self.allocator, self.pos) catch return Error.OutOfMemory;
+        self.lengths.append(self.allocator, len) catch return Error.OutOfMemory;
+        if (self.flags & pack_format.flag_key_hashes != 0) {
+            self.hashes.append(self.allocator, hash) catch return Error.OutOfMemory;
+        }
+        if (self.flags & pack_format.flag_crc32c != 0) {
+            self.crcs.append(self.allocator, crc32c.checksum(msg)) catch return Error.OutOfMemory;
+        }
+        try self.stage(msg);
+    }
+
+    /// Write the index and footer and flush everything to the file.
+    pub fn finish(self: *PackWriter) WriteError!void {
+        const index_ofs = std.mem.alignForward(u64, self.pos, 4);
+        const zeros = [_]u8{ 0, 0, 0 };
+        try self.stage(zeros[0..@intCast(index_ofs - self.pos)]);
+        var word: [8]u8 = undefined;
+        for (self.offsets.items) |o| {
+            std.mem.writeInt(u64, &word, o, .little);
+            try self.stage(&word);
+        }
+        for (self.lengths.items) |l| {
+            std.mem.writeInt(u32, word[0..4], l, .little);
+            try self.stage(word[0..4]);
+        }
+        for (self.hashes.items) |h| {
+            std.mem.writeInt(u32, word[0..4], h, .little);
+            try self.stage(word[0..4]);
+        }
+        for (self.crcs.items) |crc| {
+            std.mem.writeInt(u32, word[0..4], crc, .little);
+            try self.stage(word[0..4]);
+        }
+        var footer: [pack_format.footer_size]u8 = undefined;
+        std.mem.writeInt(u64, footer[0..8], index_ofs, .little);
+        std.mem.writeInt(u32, footer[8..12], @intCast(self.offsets.items.len), .little);
+        footer[12..16].* = pack_format.footer_magic;
+        try self.stage(&footer);
+        try self.flush();
+    }
+
+    fn stage(self: *PackWriter, bytes: []const u8) WriteError!void {
+        if (self.pending.items.len + bytes.len > flush_threshold) try self.flush();
+        if (bytes.len >= flush_threshold) {
+            try self.file.writeAll(bytes);
+        } else {
+            self.pending.appendSlice(self.allocator, bytes) catch return Error.OutOfMemory;
+        }
+        self.pos += bytes.len;
+    }
+
+    fn flush(self: *PackWriter) WriteError!void {
+        try self.file.writeAll(self.pending.items);
+        self.pending.clearRetainingCapacity();
+    }
+};
+
+/// Read-only, memory-mapped access to a pack file written by `PackWriter`.
+///
+/// `open` validates the footer and index (not the messages; see `verify`);
+/// message `i` is then an O(1) slice of the mapping. Views validate nodes as they are
+/// read, like `MappedDocument`.
+pub const PackReader = struct {
+    mem: []align(std.heap.page_size_min) u8,
+    index_ofs: usize,
+    n: usize,
+    flags: u32,
+
+    pub const OpenError = std.fs.File.OpenError || std.fs.File.StatError || std.posix.MMapError || Error;
+
+    const max_threads: usize = 64;
+
+    pub fn open(path: []const u8) OpenError!PackReader {
+        return openAt(std.fs.cwd(), path);
+    }
+
+    pub fn openAt(dir: std.fs.Dir, sub_path: []const u8) OpenError!PackReader {
+        const file = try dir.openFile(sub_path, .{});
+        defer file.close();
+        return fromFile(file);
+    }
+
+    /// Map an already-open file. The caller keeps ownership of `file`.
+    pub fn fromFile(file: std.fs.File) OpenError!PackReader {
+        const size = (try file.stat()).size;
+        if (size < pack_format.header_size + pack_format.footer_size) return Error.CorruptData;
+        if (size > std.math.maxInt(usize)) return Error.InvalidArgument;
+        const mem = try std.posix.mmap(null, @intCast(size), std.posix.PROT.READ, .{ .TYPE = .PRIVATE }, file.handle, 0);
+        errdefer std.posix.munmap(mem);
+        std.posix.madvise(mem.ptr, mem.len, std.posix.MADV.RANDOM) catch {};
+        return validate(mem);
+    }
+
+    fn validate(mem: []align(std.heap.page_size_min) u8) Error!PackReader {
+        if (!std.mem.eql(u8, mem[0..4], &pack_format.header_magic)) return Error.CorruptData;
+        if (std.mem.readInt(u32, mem[4..8], .little) != pack_format.version) return Error.CorruptData;
+        const flags = std.mem.readInt(u32, mem[8..12], .little);
+        const footer = mem[mem.len - pack_format.footer_size ..];
+        if (!std.mem.eql(u8, footer[12..16], &pack_format.footer_magic)) return Error.CorruptData;
+        const index_ofs = std.math.cast(usize, std.mem.readInt(u64, footer[0..8], .little)) orelse return Error.CorruptData;
+        const n: usize = std.mem.readInt(u32, footer[8..12], .little);
+        const index_len = std.math.mul(usize, n, pack_format.entrySize(flags)) catch return Error.CorruptData;
+        if (index_ofs < pack_format.header_size or index_ofs & 3 != 0) return Error.CorruptData;
+        if (index_ofs +| index_len != mem.len - pack_format.footer_size) return Error.CorruptData;
+
+        const self: PackReader = .{ .mem = mem, .index_ofs = index_ofs, .n = n, .flags = flags };
+        // Check every entry once so that `bytes` can slice without checks.
+        for (0..n) |i| {
+            const o = self.offsetAt(i);
+            const l = self.lengthAt(i);
+            if (o < pack_format.header_size or o & 3 != 0 or l < node_size) return Error.CorruptData;
+            if (o > index_ofs or l > index_ofs - o) return Error.CorruptData;
+        }
+        return self;
+    }
+
+    pub fn close(self: *PackReader) void {
+        std.posix.munmap(self.mem);
+        self.* = undefined;
+    }
+
+    /// Number of messages in the pack.
+    pub fn len(self: *const PackReader) usize {
+        return self.n;
+    }
+
+    inline fn offsetAt(self: *const PackReader, i: usize) usize {
+        return @intCast(std.mem.readInt(u64, self.mem[self.index_ofs + 8 * i ..][0..8], .little));
+    }
+
+    inline fn lengthAt(self: *const PackReader, i: usize) usize {
+        return std.mem.readInt(u32, self.mem[self.index_ofs + 8 * self.n + 4 * i ..][0..4], .little);
+    }
+
+    /// Bytes of message `i`, 4-byte aligned within the mapping.
+    pub fn bytes(self: *const PackReader, i: usize) Error![]align(4) const u8 {
+        if (i >= self.n) return Error.NotFound;
+        const o = self.offsetAt(i);
+        return @alignCast(self.mem[o..][0..self.lengthAt(i)]);
+    }
+
+    /// Read view of message `i`.
+    pub fn view(self: *const PackReader, i: usize) Error!ConstView {
+        return ConstView.init(try self.bytes(i));
+    }
+
+    /// Key hash stored for message `i`, or null if the pack has no key-hash column.
+    pub fn keyHash(self: *const PackReader, i: usize) ?u32 {
+        if (self.flags & pack_format.flag_key_hashes == 0 or i >= self.n) return null;
+        return std.mem.readInt(u32, self.mem[self.index_ofs + 12 * self.n + 4 * i ..][0..4], .little);
+    }
+
+    /// CRC-32C stored for message `i`, or null if the pack has no checksums.
+    pub fn checksum(self: *const PackReader, i: usize) ?u32 {
+        if (self.flags & pack_format.flag_crc32c == 0 or i >= self.n) return null;
+        const column = self.index_ofs + (12 + pack_format.hashesSize(self.flags)) * self.n;
+        return std.mem.readInt(u32, self.mem[column + 4 * i ..][0..4], .little);
+    }
+
+    /// Check message `i` against its stored CRC-32C. `CorruptData` on a
+    /// mismatch, `InvalidArgument` if the pack was written without checksums.
+    pub fn verify(self: *const PackReader, i: usize) Error!void {
+        const want = self.checksum(i) orelse
+            return if (i >= self.n) Error.NotFound else Error.InvalidArgument;
+        if (crc32c.checksum(try self.bytes(i)) != want) return Error.CorruptData;
+    }
+
+    /// `verify` every message.
+    pub fn verifyAll(self: *const PackReader) Error!void {
+        for (0..self.n) |i| try self.verify(i);
+    }
+
+    /// First message at or after `start` whose stored key hash matches `key`.
+    /// Hashes can collide; callers that need certainty must check the message.
+    pub fn indexOfKey(self: *const PackReader, key: []const u8, start: usize) ?usize {
+        if (self.flags & pack_format.flag_key_hashes == 0) return null;
+        const h = KeyData.of(key).hash;
+        for (start..self.n) |i| {
+            if (self.keyHash(i).? == h) return i;
+        }
+        return null;
+    }
+
+    /// Call `func(context, i, view)` for every message, split into contiguous
+    /// ranges over up to `thread_count` threads (the caller's thread runs the
+    /// last range). `func` must be safe to call concurrently.
+    pub fn parallelEach(
+        self: *const PackReader,
+        thread_count: usize,
+        context: anytype,
+        comptime func: fn (@TypeOf(context), usize, ConstView) void,
+    ) std.Thread.SpawnError!void {
+        const Worker = struct {
+            fn run(r: *const PackReader, lo: usize, hi: usize, ctx: @TypeOf(context)) void {
+                for (lo..hi) |i| func(ctx, i, .{ .bytes = r.bytes(i) catch unreachable });
+            }
+        };
+        if (self.n == 0) return;
+        const parts = @max(1, @min(thread_count, max_threads, self.n));
+        var threads: [max_threads]std.Thread = undefined;
+        var spawned: usize = 0;
+        defer for (threads[0..spawned]) |t| t.join();
+        for (0..parts - 1) |p| {
+            threads[p] = try std.Thread.spawn(.{}, Worker.run, .{ self, p * self.n / parts, (p + 1) * self.n / parts, context });
+            spawned += 1;
+        }
+        Worker.run(self, (parts - 1) * self.n / parts, self.n, context);
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Stream framing
+// ---------------------------------------------------------------------------
+
+/// Wire framing used by `FrameWriter` and `FrameReader`:
+///
+///   length u32   payload length in bytes (padding excluded)
+///   flags  u32   `flag_*` bits; unknown bits are rejected
+///   payload      followed by zero padding to a multiple of 4 bytes
+///   crc32c u32   only with `flag_crc32c`: CRC-32C of the unpadded payload
+///
+/// With `flag_lz` the payload is the original length as a u32 followed by
+/// an `lz` block; the checksum covers these bytes as sent.
+///
+/// Header and padding keep every payload 4-byte aligned in the receive
+/// buffer, so frames can be read in place. Integers are little-endian.
+pub const frame_format = struct {
+    pub const header_size: usize = 8;
+    /// The padded payload is followed by its little-endian CRC-32C.
+    pub const flag_crc32c: u32 = 1;
+    pub const flag_lz: u32 = 2;
+    pub const known_flags: u32 = flag_crc32c | flag_lz;
+    pub const trailer_size: usize = 4;
+
+    fn trailer(flags: u32) usize {
+        return if (flags & flag_crc32c != 0) trailer_size else 0;
+    }
+
+    fn padded(len: usize) usize {
+        return std.mem.alignForward(usize, len, 4);
+    }
+};
+
+/// A received frame. `payload` points into the reader's buffer (already
+/// decompressed) and is valid until the next `FrameReader.next()`.
+pub const Frame = struct {
+    payload: []align(4) u8,
+    flags: u32,
+
+    /// Read-only view of the payload.
+    pub fn view(self: Frame) Error!ConstView {
+        return ConstView.init(self.payload);
+    }
+
+    /// The payload as a `Buffer`, in place. Its capacity equals its length,
+    /// so only in-place overwrites succeed.
+    pub fn buffer(self: Frame) Error!Buffer {
+        return Buffer.fromSerialized(self.payload, self.payload.len);
+    }
+};
+
+/// Reads frames from a stream file descriptor into one large aligned buffer.
+///
+/// Frames are returned in place; consumed bytes are reclaimed by moving the
+/// unread tail to the front when the buffer fills. The buffer grows (up to
+/// `max_frame_len` plus header) only for frames that do not fit.
+pub const FrameReader = struct {
+    allocator: std.mem.Allocator,
+    fd: std.posix.fd_t,
+    mem: []align(4) u8,
+    start: usize = 0,
+    end: usize = 0,
+    max_frame_len: usize,
+    /// Decompression output, allocated on the first compressed frame.
+    scratch: ?[]align(4) u8 = null,
+
+    pub const Options = struct {
+        capacity: usize = 256 * 1024,
+        max_frame_len: usize = 64 * 1024 * 1024,
+    };
+
+    pub const ReadError = std.posix.ReadError || Error;
+
+    pub fn init(allocator: std.mem.Allocator, fd: std.posix.fd_t, options: Options) Error!FrameReader {
+        const cap = std.mem.alignForward(usize, @max(options.capacity, frame_format.header_size + node_size), 4);
+        const mem = allocator.alignedAlloc(u8, .@"4", cap) catch return Error.OutOfMemory;
+        return .{ .allocator = allocator, .fd = fd, .mem = mem, .max_frame_len = options.max_frame_len };
+    }
+
+    pub fn deinit(self: *FrameReader) void {
+        self.allocator.free(self.mem);
+        if (self.scratch) |mem| self.allocator.free(mem);
+        self.* = undefined;
+    }
+
+    /// Next frame, or null at a clean end of stream. A stream that ends
+    /// inside a frame, or a checksummed frame whose CRC does not match, is
+    /// `CorruptData`.
+    pub fn next(self: *FrameReader) ReadError!?Frame {
+        if (!try self.fill(frame_format.header_size)) return null;
+        const h = self.mem[self.start..][0..frame_format.header_size];
+        const len: usize = std.mem.readInt(u32, h[0..4], .little);
+        const flags = std.mem.readInt(u32, h[4..8], .little);
+        if (flags & ~frame_format.known_flags != 0) return Error.CorruptData;
+        if (len > self.max_frame_len) return Error.CorruptData;
+        const padded = frame_format.padded(len);
+        const total = frame_format.header_size + padded + frame_format.trailer(flags);
+        if (!try self.fill(total)) return Error.CorruptData;
+        const payload_start = self.start + frame_format.header_size;
+        if (flags & frame_format.flag_crc32c != 0) {
+            const want = std.mem.readInt(u32, self.mem[payload_start + padded ..][0..4], .little);
+            if (crc32c.checksum(self.mem[payload_start..][0..len]) != want) return Error.CorruptData;
+        }
+        self.start += total;
+        const payload: []align(4) u8 = @alignCast(self.mem[payload_start..][0..len]);
+        if (flags & frame_format.flag_lz != 0) return .{ .payload = try self.inflate(payload), .flags = flags };
+        return .{ .payload = payload, .flags = flags };
+    }
+
+    fn inflate(self: *FrameReader, wire: []const u8) Error![]align(4) u8 {
+        if (wire.len < 4) return Error.CorruptData;
+        const raw_len: usize = std.mem.readInt(u32, wire[0..4], .little);
+        if (raw_len > self.max_frame_len) return Error.CorruptData;
+        if (self.scratch == null or self.scratch.?.len < raw_len) {
+            if (self.scratch) |mem| self.allocator.free(mem);
+            self.scratch = null;
+            self.scratch = self.allocator.alignedAlloc(u8, .@"4", std.mem.alignForward(usize, raw_len, 4)) catch return Error.OutOfMemory;
+        }
+        const out = self.scratch.?[0..raw_len];
+        if (try lz.decompress(out, wire[4..]) != raw_len) return Error.CorruptData;
+        return out;
+    }
+
+    /// Ensure `n` unread bytes are buffered. Returns false on end of stream
+    /// before any of them arrived.
+    fn fill(self: *FrameReader, n: usize) ReadError!bool {
+        if (self.end - self.start >= n) return true;
+        if (self.start + n > self.mem.len) {
+            const unread = self.end - self.start;
+            std.mem.copyForwards(u8, self.mem[0..unread], self.mem[self.start..self.end]);
+            self.start = 0;
+            self.end = unread;
+            if (n > self.mem.len) {
+                self.mem = self.allocator.realloc(self.mem, std.mem.alignForward(usize, n, 4)) catch return Error.OutOfMemory;
+            }
+        }
+        const had = self.end - self.start;
+        while (self.end - self.start < n) {
+            const got = try std.posix.read(self.fd, self.mem[self.end..]);
+            if (got == 0) {
+                if (self.end - self.start == 0 and had == 0) return false;
+                return Error.CorruptData;
+            }
+            self.end += got;
+        }
+        return true;
+    }
+};
+
+/// Queues frames and writes them with `writev`, several frames per call.
+///
+/// Payload memory is referenced, not copied, and must stay valid until a
+/// `flush()` succeeds. Compressed payloads are staged in the writer.
+pub const FrameWriter = struct {
+    allocator: std.mem.Allocator,
+    fd: std.posix.fd_t,
+    frames: std.ArrayListUnmanaged(Queued) = .empty,
+    iov: std.ArrayListUnmanaged(std.posix.iovec_const) = .empty,
+    compressed: std.ArrayListUnmanaged(u8) = .empty,
+    checksums: bool = false,
+    compress_min: ?usize = null,
+    /// Bytes of the first queued frame already written by a failed flush.
+    written: usize = 0,
+
+    const Queued = struct {
+        header: [frame_format.header_size]u8,
+        payload: []const u8,
+        /// Offset of the payload in `compressed`, which may move until flush.
+        compressed_at: ?usize = null,
+        trailer: [frame_format.trailer_size]u8 = undefined,
+    };
+
+    pub const Options = struct {
+        /// Append a CRC-32C to every frame; readers verify it.
+        checksums: bool = false,
+        /// `lz`-compress payloads of at least this many bytes, keeping the
+        /// result only when it is smaller. Null disables compression.
+        compress_min: ?usize = null,
+    };
+
+    pub const WriteError = std.posix.WriteError || Error;
+
+    const zero_pad = [_]u8{ 0, 0, 0 };
+
+    pub fn init(allocator: std.mem.Allocator, fd: std.posix.fd_t) FrameWriter {
+        return initWithOptions(allocator, fd, .{});
+    }
+
+    pub fn initWithOptions(allocator: std.mem.Allocator, fd: std.posix.fd_t, options: Options) FrameWriter {
+        return .{ .allocator = allocator, .fd = fd, .checksums = options.checksums, .compress_min = options.compress_min };
+    }
+
+    pub fn deinit(self: *FrameWriter) void {
+        self.frames.deinit(self.allocator);
+        self.iov.deinit(self.allocator);
+        self.compressed.deinit(self.allocator);
+        self.* = undefined;
+    }
+
+    /// Queue one frame carrying `payload` (e.g. `Buffer.data()`).
+    pub fn push(self: *FrameWriter, payload: []const u8) Error!void {
+        return self.pushFlags(payload, 0);
+    }
+
+    fn pushFlags(self: *FrameWriter, payload: []const u8, flags_in: u32) Error!void {
+        var len = std.math.cast(u32, payload.len) orelse return Error.InvalidArgument;
+        var flags = if (self.checksums) flags_in | frame_format.flag_crc32c else flags_in;
+        var q: Queued = .{ .header = undefined, .payload = payload };
+        if (self.compress_min != null and payload.len >= self.compress_min.?) {
+            const at = self.compressed.items.len;
+            const dst = self.compressed.addManyAsSlice(self.allocator, 4 + lz.compressBound(payload.len)) catch return Error.OutOfMemory;
+            std.mem.writeInt(u32, dst[0..4], len, .little);
+            const n = 4 + (lz.compress(dst[4..], payload) catch unreachable);
+            if (n < payload.len) {
+                self.compressed.shrinkRetainingCapacity(at + n);
+                q.payload = dst[0..n];
+                q.compressed_at = at;
+                len = @intCast(n);
+                flags |= frame_format.flag_lz;
+            } else {
+                self.compressed.shrinkRetainingCapacity(at);
+            }
+        }
+        std.mem.writeInt(u32, q.header[0..4], len, .little);
+        std.mem.writeInt(u32, q.header[4..8], flags, .little);
+        if (self.checksums) std.mem.writeInt(u32, &q.trailer, crc32c.checksum(q.payload), .little);
+        self.frames.append(self.allocator, q) catch return Error.OutOfMemory;
+    }
+
+    /// Write all queued frames. If a write fails part way (e.g. `WouldBlock`
+    /// on a non-blocking socket), the frames already written are dropped
+    /// from the queue and the next `flush()` resumes at the first unwritten
+    /// byte, so retrying never duplicates output.
+    pub fn flush(self: *FrameWriter) WriteError!void {
+        self.iov.clearRetainingCapacity();
+        self.iov.ensureTotalCapacity(self.allocator, self.frames.items.len * 4) catch return Error.OutOfMemory;
+        for (self.frames.items) |*q| {
+            if (q.compressed_at) |at| q.payload = self.compressed.items[at..][0..q.payload.len];
+            self.iov.appendAssumeCapacity(.{ .base = &q.header, .len = q.header.len });
+            if (q.payload.len != 0) self.iov.appendAssumeCapacity(.{ .base = q.payload.ptr, .len = q.payload.len });
+            const pad = frame_format.padded(q.payload.len) - q.payload.len;
+            if (pad != 0) self.iov.appendAssumeCapacity(.{ .base = &zero_pad, .len = pad });
+            if (self.checksums) self.iov.appendAssumeCapacity(.{ .base = &q.trailer, .len = q.trailer.len });
+        }
+        var sent = self.written;
+        writevAll(self.fd, self.iov.items, &sent) catch |err| {
+            self.dropSent(sent);
+            return err;
+        };
+        self.frames.clearRetainingCapacity();
+        self.compressed.clearRetainingCapacity();
+        self.written = 0;
+    }
+
+    fn frameSize(self: *const FrameWriter, q: *const Queued) usize {
+        const trailer: usize = if (self.checksums) q.trailer.len else 0;
+        return q.header.len + frame_format.padded(q.payload.len) + trailer;
+    }
+
+    /// Drop the frames covered by the first `sent` queued bytes and keep the
+    /// remainder as progress into the new first frame. `compressed` is left
+    /// alone, so the remaining `compressed_at` offsets stay valid.
+    fn dropSent(self: *FrameWriter, sent: usize) void {
+        var left = sent;
+        var k: usize = 0;
+        while (k < self.frames.items.len) : (k += 1) {
+            const size = self.frameSize(&self.frames.items[k]);
+            if (left < size) break;
+            left -= size;
+        }
+        const rest = self.frames.items[k..];
+        std.mem.copyForwards(Queued, self.frames.items[0..rest.len], rest);
+        self.frames.shrinkRetainingCapacity(rest.len);
+        self.written = left;
+    }
+
+    /// `writev` every byte of `iov` past the first `sent.*`; `iov` is
+    /// consumed and `sent` keeps counting, including on error.
+    fn writevAll(fd: std.posix.fd_t, iov: []std.posix.iovec_const, sent: *usize) std.posix.WriteError!void {
+        var i: usize = 0;
+        var n = sent.*;
+        const max_iov = 1024; // IOV_MAX on Linux and the BSDs
+        while (true) {
+            while (i < iov.len and n >= iov[i].len) : (i += 1) n -= iov[i].len;
+            if (n != 0) {
+                iov[i].base += n;
+                iov[i].len -= n;
+            }
+            if (i == iov.len) return;
+            n = try std.posix.writev(fd, iov[i..@min(iov.len, i + max_iov)]);
+            sent.* += n;
+        }
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Shared-memory publishing
+// ---------------------------------------------------------------------------
+
+/// Layout of a region shared by `SharedPublisher` and `SharedSubscriber`:
+///
+///   header  "L3SH", version u32, slot_count u32, slot_size u32,
+///           next_seq u64 (sequence of the next message), zero padded to 64
+///   slots   slot_count x stride, each: state u64, len u32, reserved u32,
+///           then slot_size payload bytes
+///
+/// Message `seq` lives in slot `seq % slot_count`. A slot's state is a
+/// seqlock: `2*seq + 1` while message `seq` is being written, `2*seq + 2`
+/// once it is complete, 0 if never written. Integers are native-endian;
+/// the region is only shared between processes on one host.
+pub const shared_format = struct {
+    pub const header_magic = "L3SH".*;
+    pub const version: u32 = 1;
+    pub const header_size: usize = 64;
+    pub const slot_header_size: usize = 16;
+    const next_seq_ofs: usize = 16;
+
+    fn stride(slot_size: usize) usize {
+        return std.mem.alignForward(usize, slot_header_size + slot_size, 64);
+    }
+};
+
+/// A mapping of a shared message region, created with `create` (memfd) or
+/// attached to with `fromFd` (an fd inherited or received over a Unix
+/// socket).
+pub const SharedRegion = struct {
+    mem: []align(std.heap.page_size_min) u8,
+    fd: std.posix.fd_t,
+    slot_count: u32,
+    slot_size: u32,
+
+    pub const CreateError = std.posix.MemFdCreateError || std.posix.TruncateError || std.posix.MMapError || Error;
+    pub const AttachError = std.posix.FStatError || std.posix.MMapError || Error;
+
+    /// Create an anonymous memfd-backed region (Linux only). The region owns
+    /// the fd; share it with `fd` before `close`.
+    pub fn create(name: []const u8, slot_count: u32, slot_size: u32) CreateError!SharedRegion {
+        if (slot_count == 0 or slot_size < node_size) return Error.InvalidArgument;
+        const size = shared_format.header_size + @as(usize, slot_count) * shared_format.stride(slot_size);
+        const fd = if (builtin.os.tag == .linux) try std.posix.memfd_create(name, 0) else return Error.InvalidArgument;
+        errdefer std.posix.close(fd);
+        try std.posix.ftruncate(fd, size);
+        const mem = try std.posix.mmap(null, size, std.posix.PROT.READ | std.posix.PROT.WRITE, .{ .TYPE = .SHARED }, fd, 0);
+        // ftruncate zero-fills: every slot starts in state 0 and next_seq is 0.
+        mem[0..4].* = shared_format.header_magic;
+        std.mem.writeInt(u32, mem[4..8], shared_format.version, .little);
+        std.mem.writeInt(u32, mem[8..12], slot_count, .little);
+        std.mem.writeInt(u32, mem[12..16], slot_size, .little);
+        return .{ .mem = mem, .fd = fd, .slot_count = slot_count, .slot_size = slot_size };
+    }
+
+    /// Map an existing region. Takes ownership of `fd`.
+    pub fn fromFd(fd: std.posix.fd_t) AttachError!SharedRegion {
+        const st = try std.posix.fstat(fd);
+        if (st.size < shared_format.header_size) return Error.CorruptData;
+        const size: usize = @intCast(st.size);
+        // Subscribers need write access for the seqlock re-check in `SharedSubscriber.check`.
+        const mem = try std.posix.mmap(null, size, std.posix.PROT.READ | std.posix.PROT.WRITE, .{ .TYPE = .SHARED }, fd, 0);
+        errdefer std.posix.munmap(mem);
+        if (!std.mem.eql(u8, mem[0..4], &shared_format.header_magic)) return Error.CorruptData;
+        if (std.mem.readInt(u32, mem[4..8], .little) != shared_format.version) return Error.CorruptData;
+        const slot_count = std.mem.readInt(u32, mem[8..12], .little);
+        const slot_size = std.mem.readInt(u32, mem[12..16], .little);
+        if (slot_count == 0 or slot_size < node_size) return Error.CorruptData;
+        const need = std.math.mul(usize, slot_count, shared_format.stride(slot_size)) catch return Error.CorruptData;
+        if (need > size - shared_format.header_size) return Error.CorruptData;
+        return .{ .mem = mem, .fd = fd, .slot_count = slot_count, .slot_size = slot_size };
+    }
+
+    /// Unmap and close the fd.
+    pub fn close(self: *SharedRegion) void {
+        std.posix.munmap(self.mem);
+        std.posix.close(self.fd);
+        self.* = undefined;
+    }
+
+    fn nextSeq(self: *const SharedRegion) *u64 {
+        return @ptrCast(@alignCast(self.mem.ptr + shared_format.next_seq_ofs));
+    }
+
+    fn slotBase(self: *const SharedRegion, seq: u64) usize {
+        const i: usize = @intCast(seq % self.slot_count);
+        return shared_format.header_size + i * shared_format.stride(self.slot_size);
+    }
+
+    fn state(self: *const SharedRegion, seq: u64) *u64 {
+        return @ptrCast(@alignCast(self.mem.ptr + self.slotBase(seq)));
+    }
+
+    fn lenPtr(self: *const SharedRegion, seq: u64) *u32 {
+        return @ptrCast(@alignCast(self.mem.ptr + self.slotBase(seq) + 8));
+    }
+
+    fn payload(self: *const SharedRegion, seq: u64) []align(16) u8 {
+        const start = self.slotBase(seq) + shared_format.slot_header_size;
+        return @alignCast(self.mem[start..][0..self.slot_size]);
+    }
+};
+
+/// Single writer of a `SharedRegion`. Messages are written once, into the
+/// shared mapping; each publish overwrites the oldest slot.
+pub const SharedPublisher = struct {
+    region: *SharedRegion,
+
+    /// A message being built in place; finish with `commit`.
+    pub const Pending = struct {
+        seq: u64,
+        buf: Buffer,
+    };
+
+    /// Start message `seq` in its slot and return an empty object `Buffer`
+    /// over the slot, for building the message without a copy.
+    pub fn reserve(self: SharedPublisher) Error!Pending {
+        const seq = @atomicLoad(u64, self.region.nextSeq(), .monotonic);
+        // acq_rel keeps the payload writes below from moving above the mark.
+        _ = @atomicRmw(u64, self.region.state(seq), .Xchg, 2 * seq + 1, .acq_rel);
+        return .{ .seq = seq, .buf = try Buffer.initObj(self.region.payload(seq)) };
+    }
+
+    /// Make a reserved message visible to subscribers. Returns its sequence.
+    pub fn commit(self: SharedPublisher, pending: *const Pending) u64 {
+        const seq = pending.seq;
+        @atomicStore(u32, self.region.lenPtr(seq), @intCast(pending.buf.len), .monotonic);
+        @atomicStore(u64, self.region.state(seq), 2 * seq + 2, .release);
+        @atomicStore(u64, self.region.nextSeq(), seq + 1, .release);
+        return seq;
+    }
+
+    /// Copy an already-serialized message into the next slot and publish it.
+    pub fn publish(self: SharedPublisher, msg: []const u8) Error!u64 {
+        if (msg.len < node_size or msg.len > self.region.slot_size) return Error.InvalidArgument;
+        var pending = try self.reserve();
+        @memcpy(pending.buf.buf[0..msg.len], msg);
+        pending.buf.len = msg.len;
+        return self.commit(&pending);
+    }
+};
+
+/// A message read in place from a `SharedRegion`.
+pub const SharedMessage = struct {
+    seq: u64,
+    view: ConstView,
+};
+
+/// Reader of a `SharedRegion`. Reads are in place; a slow reader can be
+/// overtaken by the publisher, so call `check` after using a message (or
+/// before acting on what was read) to detect that the slot was reused.
+pub const SharedSubscriber = struct {
+    region: *SharedRegion,
+    /// Sequence `poll` will read next.
+    next: u64 = 0,
+
+    /// Sequence of the next message the publisher will write.
+    pub fn head(self: *const SharedSubscriber) u64 {
+        return @atomicLoad(u64, self.region.nextSeq(), .acquire);
+    }
+
+    /// Message `seq`: `NotFound` if it is not yet published,
+    /// `StaleReference` if its slot has already been reused.
+    pub fn get(self: *const SharedSubscriber, seq: u64) Error!SharedMessage {
+        const s = @atomicLoad(u64, self.region.state(seq), .acquire);
+        const want = 2 * seq + 2;
+        if (s != want) return if (s < want) Error.NotFound else Error.StaleReference;
+        const len = @atomicLoad(u32, self.region.lenPtr(seq), .monotonic);
+        if (len < node_size or len > self.region.slot_size) return Error.CorruptData;
+        return .{ .seq = seq, .view = try ConstView.init(self.region.payload(seq)[0..len]) };
+    }
+
+    /// Fail with `StaleReference` if `msg`'s slot was overwritten since `get`.
+    pub fn check(self: *const SharedSubscriber, msg: SharedMessage) Error!void {
+        // A release RMW orders the reads of the message before this re-read
+        // of the slot state (a plain acquire load would not).
+        const s = @atomicRmw(u64, self.region.state(msg.seq), .Add, 0, .acq_rel);
+        if (s != 2 * msg.seq + 2) return Error.StaleReference;
+    }
+
+    /// Next message in order, or null if caught up. If the reader fell more
+    /// than `slot_count` messages behind, it skips to the oldest slot still
+    /// held and returns `StaleReference` once.
+    pub fn poll(self: *SharedSubscriber) Error!?SharedMessage {
+        const h = self.head();
+        if (self.next >= h) return null;
+        if (h - self.next > self.region.slot_count) {
+            self.next = h - self.region.slot_count;
+            return Error.StaleReference;
+        }
+        const msg = self.get(self.next) catch |err| switch (err) {
+            Error.StaleReference => {
+                self.next += 1;
+                return err;
+            },
+            else => return err,
+        };
+        self.next += 1;
+        return msg;
+    }
+
+    /// The most recently published message, or null if none yet.
+    pub fn latest(self: *const SharedSubscriber) Error!?SharedMessage {
+        const h = self.head();
+        if (h == 0) return null;
+        return try self.get(h - 1);
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Message ring
+// ---------------------------------------------------------------------------
+
+/// Lock-free ring of variable-length messages for many producers and one
+/// consumer (single-producer use is the same code with no contention).
+///
+/// The ring lives entirely in caller memory, so it works the same on heap
+/// memory shared by threads and on a shared mapping used by processes
+/// (format it once with `init`, then `attach` from the other side).
+///
+/// Layout: a 192-byte header (magic and capacity, then `tail` and `head`
+/// on their own cache lines) followed by a power-of-two data area. Each
+/// record is a 16-byte header (size u32, state u32, len u32, reserved)
+/// and a payload, padded to 16 bytes and never split across the end of the
+/// data area; a producer that would wrap first claims the rest of the area
+/// as a padding record. Producers claim space by CAS on `tail`, and
+/// publish by storing the record state with release ordering. The consumer
+/// zeroes what it releases before advancing `head`, so stale bytes from an
+/// earlier lap never read as a committed header.
+pub const MessageRing = struct {
+    mem: []align(64) u8,
+    cap: u64,
+
+    pub const header_size: usize = 192;
+    const record_header_size: usize = 16;
+    const header_magic = "L3RG".*;
+    const tail_ofs: usize = 64;
+    const head_ofs: usize = 128;
+    const min_cap: usize = 2 * (record_header_size + node_size);
+
+    const state_empty: u32 = 0;
+    const state_ready: u32 = 1;
+    const state_padding: u32 = 2;
+
+    /// A claimed record; build the message in `buf`, then `commit`.
+    pub const Reservation = struct {
+        pos: u64,
+        buf: Buffer,
+    };
+
+    /// A committed record read in place; hand back with `release`.
+    pub const Message = struct {
+        pos: u64,
+        size: u32,
+        bytes: []align(16) const u8,
+
+        pub fn view(self: Message) Error!ConstView {
+            return ConstView.init(self.bytes);
+        }
+    };
+
+    /// Format `mem` as an empty ring. The data area is the largest power of
+    /// two that fits after the header, and must hold two node-sized records.
+    pub fn init(mem: []align(64) u8) Error!MessageRing {
+        if (mem.len <= header_size) return Error.InvalidArgument;
+        const cap = std.math.floorPowerOfTwo(usize, @min(mem.len - header_size, std.math.maxInt(u32)));
+        if (cap < min_cap) return Error.InvalidArgument;
+        @memset(mem[0 .. header_size + cap], 0);
+        mem[0..4].* = header_magic;
+        std.mem.writeInt(u64, mem[8..16], cap, .little);
+        return .{ .mem = mem, .cap = cap };
+    }
+
+    /// Use a ring already formatted by `init`, e.g. in another process.
+    pub fn attach(mem: []align(64) u8) Error!MessageRing {
+        if (mem.len < header_size or !std.mem.eql(u8, mem[0..4], &header_magic)) return Error.CorruptData;
+        const cap = std.mem.readInt(u64, mem[8..16], .little);
+        if (!std.math.isPowerOfTwo(cap) or cap < min_cap or cap > mem.len - header_size) return Error.CorruptData;
+        return .{ .mem = mem, .cap = cap };
+    }
+
+    inline fn counter(self: *const MessageRing, ofs: usize) *u64 {
+        return @ptrCast(@alignCast(self.mem.ptr + ofs));
+    }
+
+    inline fn recordAt(self: *const MessageRing, pos: u64) [*]align(16) u8 {
+        return @alignCast(self.mem.ptr + header_size + @as(usize, @intCast(pos & (self.cap - 1))));
+    }
+
+    inline fn word(rec: [*]align(16) u8, i: usize) *u32 {
+        return @ptrCast(@alignCast(rec + 4 * i));
+    }
+
+    /// Claim a record with room for a message of up to `max_len` bytes and
+    /// return an empty object `Buffer` over it. Returns null if the ring is
+    /// currently too full; `InvalidArgument` if it could never fit.
+    pub fn reserve(self: *const MessageRing, max_len: usize) Error!?Reservation {
+        const size = record_header_size + std.mem.alignForward(usize, @max(max_len, node_size), 16);
+        if (size > self.cap / 2) return Error.InvalidArgument;
+        const tail = self.counter(tail_ofs);
+        var t = @atomicLoad(u64, tail, .monotonic);
+        while (true) {
+            const h = @atomicLoad(u64, self.counter(head_ofs), .acquire);
+            // The consumer may have moved past our (stale) tail; the head
+            // never passes the live tail, so a fresh load is >= h.
+            if (h > t) {
+                t = @atomicLoad(u64, tail, .monotonic);
+                continue;
+            }
+            const to_end = self.cap - (t & (self.cap - 1));
+            const pad: u64 = if (size > to_end) to_end else 0;
+            if (t + pad + size - h > self.cap) return null;
+            t = @cmpxchgWeak(u64, tail, t, t + pad + size, .acq_rel, .monotonic) orelse {
+                if (pad != 0) {
+                    const p = self.recordAt(t);
+                    word(p, 0).* = @intCast(pad);
+                    @atomicStore(u32, word(p, 1), state_padding, .release);
+                }
+                const pos = t + pad;
+                const rec = self.recordAt(pos);
+                word(rec, 0).* = @intCast(size);
+                const payload = rec[record_header_size..size];
+                return .{ .pos = pos, .buf = try Buffer.initObj(payload) };
+            };
+        }
+    }
+
+    /// Publish a reserved record.
+    pub fn commit(self: *const MessageRing, r: *const Reservation) void {
+        const rec = self.recordAt(r.pos);
+        word(rec, 2).* = @intCast(r.buf.len);
+        @atomicStore(u32, word(rec, 1), state_ready, .release);
+    }
+
+    /// Copy a serialized message into the ring. Returns false if full.
+    pub fn push(self: *const MessageRing, msg: []const u8) Error!bool {
+        if (msg.len < node_size) return Error.InvalidArgument;
+        var r = (try self.reserve(msg.len)) orelse return false;
+        @memcpy(r.buf.buf[0..msg.len], msg);
+        r.buf.len = msg.len;
+        self.commit(&r);
+        return true;
+    }
+
+    /// Oldest committed message, or null if there is none yet. Consumer only.
+    pub fn peek(self: *const MessageRing) ?Message {
+        const head = self.counter(head_ofs);
+        while (true) {
+            const h = @atomicLoad(u64, head, .monotonic);
+            const rec = self.recordAt(h);
+            const state = @atomicLoad(u32, word(rec, 1), .acquire);
+            switch (state) {
+                state_ready => {
+                    const size = word(rec, 0).*;
+                    const len = word(rec, 2).*;
+                    return .{ .pos = h, .size = size, .bytes = rec[record_header_size..][0..len] };
+                },
+                state_padding => self.advance(h, word(rec, 0).*),
+                else => return null,
+            }
+        }
+    }
+
+    /// Free a message returned by `peek`. Its bytes must no longer be used.
+    pub fn release(self: *const MessageRing, msg: Message) void {
+        self.advance(msg.pos, msg.size);
+    }
+
+    fn advance(self: *const MessageRing, pos: u64, size: u32) void {
+        @memset(self.recordAt(pos)[0..size], 0);
+        @atomicStore(u64, self.counter(head_ofs), pos + size, .release);
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Delta shipping
+// ---------------------------------------------------------------------------
+
+/// Delta layout produced by `DeltaTracker.exportDelta`:
+///
+///   header  "L3DT", version u32, base_len u64, new_len u64,
+///           patch_count u32, base_crc u32 (CRC-32C of the base bytes),
+///           new_crc u32 (CRC-32C of the resulting `new_len` bytes)
+///   patches ofs u32, len u32, then `len` bytes; sorted, non-overlapping
+///
+/// Applying every patch to a buffer holding the base bytes and setting its
+/// length to `new_len` reproduces the source. Integers are little-endian.
+pub const delta_format = struct {
+    pub const header_magic = "L3DT".*;
+    pub const version: u32 = 3;
+    pub const header_size: usize = 36;
+    pub const patch_header_size: usize = 8;
+};
+
+/// Records what changes in a document after a checkpoint so that replicas
+/// can be brought up to date with `exportDelta`/`applyDelta` instead of a
+/// full copy.
+///
+/// Attach with `buf.delta = &tracker` or `mctx.setDeltaTracker(&tracker)`.
+/// Every write through that buffer (set/append and reserve APIs, `Cursor`,
+/// `Slack`, `serialize`, `applyDelta`, `ManagedContext` resets and imports)
+/// then records, before it happens, the bytes it can change in place: the
+/// nodes on the key's descent path and the old entry. Everything else a
+/// write touches lies past the checkpoint length and ships as one appended
+/// range. Code that patches the buffer by other means reports the bytes
+/// with `noteRange`. If noting fails, the write is not made.
+pub const DeltaTracker = struct {
+    allocator: std.mem.Allocator,
+    base_len: usize = 0,
+    base_crc: u32 = 0,
+    ranges: std.ArrayListUnmanaged(Range) = .empty,
+
+    const Range = struct { start: usize, end: usize };
+    const footprint_max: usize = 64;
+    const compact_threshold: usize = 4096;
+
+    pub fn init(allocator: std.mem.Allocator) DeltaTracker {
+        return .{ .allocator = allocator };
+    }
+
+    pub fn deinit(self: *DeltaTracker) void {
+        self.ranges.deinit(self.allocator);
+        self.* = undefined;
+    }
+
+    /// Start a new delta at the current state of `src`. Checksums the whole
+    /// buffer so `applyDelta` can verify the replica's base.
+    pub fn checkpoint(self: *DeltaTracker, src: anytype) void {
+        const d = constBufferOf(src).data();
+        self.base_len = d.len;
+        self.base_crc = crc32c.checksum(d);
+        self.ranges.clearRetainingCapacity();
+    }
+
+    /// Record the footprint of a set of `key` in the object at `ofs`.
+    pub fn noteSet(self: *DeltaTracker, src: anytype, ofs: Offset, key: []const u8) Error!void {
+        const kz = try SharedMethods(Buffer).toKeyZ(key);
+        const kd = KeyData.of(key);
+        return self.footprint(constBufferOf(src), ofs, @ptrCast(&kz), kd.hash, kd.size);
+    }
+
+    /// Record the footprint of an append to the array at `ofs`.
+    pub fn noteAppend(self: *DeltaTracker, src: anytype, ofs: Offset) Error!void {
+        const b = constBufferOf(src);
+        return self.footprint(b, ofs, null, try b.count(ofs), 0);
+    }
+
+    /// Record that `[start, start + len)` is modified in place.
+    pub fn noteRange(self: *DeltaTracker, start: usize, len: usize) Error!void {
+        if (start >= self.base_len or len == 0) return;
+        if (self.ranges.items.len >= compact_threshold) self.compact();
+        self.ranges.append(self.allocator, .{ .start = start, .end = @min(self.base_len, start +| len) }) catch return Error.OutOfMemory;
+    }
+
+    fn footprint(self: *DeltaTracker, b: Buffer, ofs: Offset, key: ?[*:0]const u8, hash: u32, size: u32) Error!void {
+        var starts: [footprint_max]usize = undefined;
+        var lens: [footprint_max]usize = undefined;
+        const ret = c.shim_lite3_write_footprint(b.buf, b.len, @intFromEnum(ofs), key, hash, size, &starts, &lens, footprint_max);
+        if (ret < 0) {
+            // Pathological probe chains: fall back to shipping the whole prefix.
+            const err = translateError(ret);
+            if (err != Error.NoBufferSpace) return err;
+            return self.noteRange(0, self.base_len);
+        }
+        for (starts[0..@intCast(ret)], lens[0..@intCast(ret)]) |s, l| try self.noteRange(s, l);
+    }
+
+    /// Sort and merge recorded ranges in place.
+    fn compact(self: *DeltaTracker) void {
+        const items = self.ranges.items;
+        if (items.len == 0) return;
+        std.mem.sort(Range, items, {}, struct {
+            fn lessThan(_: void, a: Range, b: Range) bool {
+                return a.start < b.start;
+            }
+        }.lessThan);
+        var out: usize = 0;
+        for (items[1..]) |r| {
+            if (r.start <= items[out].end) {
+                items[out].end = @max(items[out].end, r.end);
+            } else {
+                out += 1;
+                items[out] = r;
+            }
+        }
+        self.ranges.shrinkRetainingCapacity(out + 1);
+    }
+
+    /// Encode the changes to `src` since the checkpoint (see `delta_format`).
+    /// The caller owns the returned bytes.
+    pub fn exportDelta(self: *DeltaTracker, allocator: std.mem.Allocator, src: anytype) Error![]u8 {
+        const d = constBufferOf(src).data();
+        if (d.len < self.base_len) return Error.InvalidArgument;
+        self.compact();
+        const tail: usize = d.len - self.base_len;
+        const patch_count = self.ranges.items.len + @intFromBool(tail != 0);
+        var size = delta_format.header_size + patch_count * delta_format.patch_header_size + tail;
+        for (self.ranges.items) |r| size += r.end - r.start;
+
+        const out = allocator.alloc(u8, size) catch return Error.OutOfMemory;
+        @memset(out[0..delta_format.header_size], 0);
+        out[0..4].* = delta_format.header_magic;
+        std.mem.writeInt(u32, out[4..8], delta_format.version, .little);
+        std.mem.writeInt(u64, out[8..16], self.base_len, .little);
+        std.mem.writeInt(u64, out[16..24], d.len, .little);
+        std.mem.writeInt(u32, out[24..28], @intCast(patch_count), .little);
+        std.mem.writeInt(u32, out[28..32], self.base_crc, .little);
+        std.mem.writeInt(u32, out[32..36], crc32c.checksum(d), .little);
+        var pos: usize = delta_format.header_size;
+        for (self.ranges.items) |r| pos = writePatch(out, pos, r.start, d[r.start..r.end]);
+        if (tail != 0) pos = writePatch(out, pos, self.base_len, d[self.base_len..]);
+        std.debug.assert(pos == out.len);
+        return out;
+    }
+
+    fn writePatch(out: []u8, pos: usize, start: usize, bytes: []const u8) usize {
+        std.mem.writeInt(u32, out[pos..][0..4], @intCast(start), .little);
+        std.mem.writeInt(u32, out[pos + 4 ..][0..4], @intCast(bytes.len), .little);
+        @memcpy(out[pos + delta_format.patch_header_size ..][0..bytes.len], bytes);
+        return pos + delta_format.patch_header_size + bytes.len;
+    }
+};
+
+/// Apply a delta from `DeltaTracker.exportDelta` to `dst` (`*Buffer` or
+/// `*ManagedContext`). `dst` must match the delta's base length and base
+/// CRC-32C; otherwise nothing is written and `StaleReference` is returned.
+/// The CRC detects a replica that has drifted from the base, including at
+/// the same length, but is not a defense against a crafted delta. The
+/// result is checksummed from the base and patch bytes before anything is
+/// written; a mismatch with the delta's new CRC (a truncated or damaged
+/// delta, or one exported without every write noted) is `CorruptData`.
+pub fn applyDelta(dst: anytype, delta: []const u8) Error!void {
+    if (delta.len < delta_format.header_size) return Error.CorruptData;
+    if (!std.mem.eql(u8, delta[0..4], &delta_format.header_magic)) return Error.CorruptData;
+    if (std.mem.readInt(u32, delta[4..8], .little) != delta_format.version) return Error.CorruptData;
+    const base_len = std.math.cast(usize, std.mem.readInt(u64, delta[8..16], .little)) orelse return Error.CorruptData;
+    const new_len = std.math.cast(usize, std.mem.readInt(u64, delta[16..24], .little)) orelse return Error.CorruptData;
+    const patch_count = std.mem.readInt(u32, delta[24..28], .little);
+    if (new_len < base_len or new_len > std.math.maxInt(u32)) return Error.CorruptData;
+    if (mutBufferOf(dst).len != base_len) return Error.StaleReference;
+
+    // Validate everything before touching `dst`, checksumming the result
+    // as it would be: base bytes in the gaps, patch bytes elsewhere.
+    const base = mutBufferOf(dst).data();
+    var new_crc: u32 = 0;
+    var covered: usize = 0;
+    var pos: usize = delta_format.header_size;
+    for (0..patch_count) |_| {
+        if (delta.len - pos < delta_format.patch_header_size) return Error.CorruptData;
+        const start: usize = std.mem.readInt(u32, delta[pos..][0..4], .little);
+        const len: usize = std.mem.readInt(u32, delta[pos + 4 ..][0..4], .little);
+        pos += delta_format.patch_header_size;
+        if (len > delta.len - pos or start + len > new_len) return Error.CorruptData;
+        if (start < covered or start > @max(covered, base_len)) return Error.CorruptData;
+        if (start > covered) new_crc = crc32c.update(new_crc, base[covered..start]);
+        new_crc = crc32c.update(new_crc, delta[pos..][0..len]);
+        covered = start + len;
+        pos += len;
+    }
+    if (pos != delta.len or new_len > @max(covered, base_len)) return Error.CorruptData;
+    if (covered < new_len) new_crc = crc32c.update(new_crc, base[covered..new_len]);
+    if (crc32c.checksum(base) != std.mem.readInt(u32, delta[28..32], .little)) return Error.StaleReference;
+    if (new_crc != std.mem.readInt(u32, delta[32..36], .little)) return Error.CorruptData;
+
+    switch (@TypeOf(dst)) {
+        *Buffer => if (new_len > dst.capacity) return Error.NoBufferSpace,
+        *ManagedContext => try dst.ensureCapacity(new_len),
+        else => @compileError("expected *Buffer or *ManagedContext, found " ++ @typeName(@TypeOf(dst))),
+    }
+    const b = mutBufferOf(dst);
+    if (b.delta) |tracker| {
+        pos = delta_format.header_size;
+        for (0..patch_count) |_| {
+            const start: usize = std.mem.readInt(u32, delta[pos..][0..4], .little);
+            const len: usize = std.mem.readInt(u32, delta[pos + 4 ..][0..4], .little);
+            try tracker.noteRange(start, len);
+            pos += delta_format.patch_header_size + len;
+        }
+    }
+    pos = delta_format.header_size;
+    for (0..patch_count) |_| {
+        const start: usize = std.mem.readInt(u32, delta[pos..][0..4], .little);
+        const len: usize = std.mem.readInt(u32, delta[pos + 4 ..][0..4], .little);
+        pos += delta_format.patch_header_size;
+        @memcpy(b.buf[start..][0..len], delta[pos..][0..len]);
+        pos += len;
+    }
+    b.len = new_len;
+}
+
+// ---------------------------------------------------------------------------
+// Operation log
+// ---------------------------------------------------------------------------
+
+/// A change feed of logical writes, recorded as a Lite3 document.
+///
+/// Attach with `buf.oplog = &log` or `mctx.setOpLog(&log)`. Every successful
+/// set/append made through the Buffer methods is then appended to the log's
+/// root array as an object:
+///
+///   "o"  op kind: `op_set` or `op_append`
+///   "p"  path from the root to the container: strings for object keys,
+///        integers for array indexes
+///   "k"  key (sets only)
+///   "v"  new value; new objects/arrays are recorded empty and filled by
+///        later ops
+///
+/// Paths do not depend on buffer layout, so `replay` can apply the log to
+/// any document that holds the same logical state. Container offsets seen
+/// for the first time are resolved by indexing the source document once.
+/// Each recorded op re-checks that every container on its path still sits
+/// under its recorded key or index. A container whose key was overwritten
+/// is unreachable, so writes through its old offset (or a descendant's)
+/// drop the stale link and fail to record with `StaleReference`.
+/// Writes that bypass the Buffer methods (reserve APIs, `serialize`,
+/// `Cursor`, `Slack`, `ExternalBlobs`, `applyDelta`) are not recorded. If
+/// recording fails, the write itself has already been applied.
+pub const OpLog = struct {
+    allocator: std.mem.Allocator,
+    ops: ManagedContext,
+    arena: std.heap.ArenaAllocator,
+    parents: std.AutoHashMapUnmanaged(usize, Link) = .empty,
+    path: std.ArrayListUnmanaged(Link) = .empty,
+
+    pub const op_set: i64 = 0;
+    pub const op_append: i64 = 1;
+
+    /// Where a container sits in its parent.
+    const Link = struct {
+        parent: usize,
+        key: ?[]const u8,
+        index: u32,
+    };
+
+    const path_depth_max: usize = 1024;
+
+    pub fn init(allocator: std.mem.Allocator) Error!OpLog {
+        var ops = try ManagedContext.init(allocator);
+        errdefer ops.deinit();
+        try ops.resetArr();
+        return .{ .allocator = allocator, .ops = ops, .arena = .init(allocator) };
+    }
+
+    pub fn deinit(self: *OpLog) void {
+        self.ops.deinit();
+        self.arena.deinit();
+        self.parents.deinit(self.allocator);
+        self.path.deinit(self.allocator);
+        self.* = undefined;
+    }
+
+    /// The encoded log (a Lite3 array of op objects).
+    pub fn data(self: *const OpLog) []const u8 {
+        return self.ops.data();
+    }
+
+    /// Number of recorded ops.
+    pub fn count(self: *const OpLog) Error!u32 {
+        return self.ops.count(root);
+    }
+
+    /// Drop recorded ops; cached container paths are kept.
+    pub fn clear(self: *OpLog) Error!void {
+        try self.ops.resetArr();
+    }
+
+    /// Forget cached container paths, e.g. after the source was reset or
+    /// re-imported. `ManagedContext` does this itself.
+    pub fn forgetPaths(self: *OpLog) void {
+        self.parents.clearRetainingCapacity();
+        _ = self.arena.reset(.retain_capacity);
+    }
+
+    fn record(self: *OpLog, src: *const Buffer, ofs: Offset, key: ?[]const u8, value: Value) Error!void {
+        try self.resolve(src, ofs);
+        const op = try self.ops.arrAppendObj(root);
+        try self.ops.setI64(op, "o", if (key == null) op_append else op_set);
+        const p = try self.ops.setArr(op, "p");
+        for (self.path.items) |l| {
+            if (l.key) |k| try self.ops.arrAppendStr(p, k) else try self.ops.arrAppendI64(p, l.index);
+        }
+        if (key) |k| try self.ops.setStr(op, "k", k);
+        switch (value) {
+            .null => try self.ops.setNull(op, "v"),
+            .bool_ => |b| try self.ops.setBool(op, "v", b),
+            .i64_ => |n| try self.ops.setI64(op, "v", n),
+            .f64_ => |f| try self.ops.setF64(op, "v", f),
+            .string => |s| try self.ops.setStr(op, "v", s),
+            .bytes => |b| try self.ops.setBytes(op, "v", b),
+            .object => |child| {
+                _ = try self.ops.setObj(op, "v");
+                try self.link(src, child, ofs, key);
+            },
+            .array => |child| {
+                _ = try self.ops.setArr(op, "v");
+                try self.link(src, child, ofs, key);
+            },
+        }
+    }
+
+    fn link(self: *OpLog, src: *const Buffer, child: Offset, parent: Offset, key: ?[]const u8) Error!void {
+        const l: Link = if (key) |k| .{
+            .parent = @intFromEnum(parent),
+            .key = self.arena.allocator().dupe(u8, k) catch return Error.OutOfMemory,
+            .index = 0,
+        } else .{
+            .parent = @intFromEnum(parent),
+            .key = null,
+            .index = (try src.count(parent)) - 1,
+        };
+        self.parents.put(self.allocator, @intFromEnum(child), l) catch return Error.OutOfMemory;
+    }
+
+    /// Fill `path` with the links from the root down to `ofs`.
+    fn resolve(self: *OpLog, src: *const Buffer, ofs: Offset) Error!void {
+        self.path.clearRetainingCapacity();
+        if (ofs == root) return;
+        if (!self.parents.contains(@intFromEnum(ofs))) try self.indexAll(src);
+        var cur = @intFromEnum(ofs);
+        while (cur != @intFromEnum(root)) {
+            if (self.path.items.len == path_depth_max) return Error.CorruptData;
+            // Every reachable container was indexed, so a missing link means
+            // `cur` was replaced (its stale link dropped below).
+            const l = self.parents.get(cur) orelse return Error.StaleReference;
+            if (!try linkHolds(src, l, cur)) {
+                _ = self.parents.remove(cur);
+                return Error.StaleReference;
+            }
+            self.path.append(self.allocator, l) catch return Error.OutOfMemory;
+            cur = l.parent;
+        }
+        std.mem.reverse(Link, self.path.items);
+    }
+
+    /// Whether the key or index in `l` still holds the container at `child`.
+    fn linkHolds(src: *const Buffer, l: Link, child: usize) Error!bool {
+        const parent: Offset = @enumFromInt(l.parent);
+        const found: Offset = if (l.key) |k| blk: {
+            const t = src.getType(parent, k) catch |err| return if (err == Error.NotFound) false else err;
+            break :blk switch (t) {
+                .object => try src.getObj(parent, k),
+                .array => try src.getArr(parent, k),
+                else => return false,
+            };
+        } else switch (try src.arrGetType(parent, l.index)) {
+            .object => try src.arrGetObj(parent, l.index),
+            .array => try src.arrGetArr(parent, l.index),
+            else => return false,
+        };
+        return @intFromEnum(found) == child;
+    }
+
+    /// Record the parent link of every container in `src`.
+    fn indexAll(self: *OpLog, src: *const Buffer) Error!void {
+        self.forgetPaths();
+        var stack: std.ArrayListUnmanaged(usize) = .empty;
+        defer stack.deinit(self.allocator);
+        stack.append(self.allocator, @intFromEnum(root)) catch return Error.OutOfMemory;
+        while (stack.pop()) |parent| {
+            var it = try src.iterate(@enumFromInt(parent));
+            var index: u32 = 0;
+            while (try it.next()) |entry| : (index += 1) {
+                const v = @intFromEnum(entry.val_offset);
+                const t = src.buf[v];
+                if (t != @intFromEnum(Type.object) and t != @intFromEnum(Type.array)) continue;
+                const key = if (entry.key) |k| self.arena.allocator().dupe(u8, k) catch return Error.OutOfMemory else null;
+                self.parents.put(self.allocator, v, .{ .parent = parent, .key = key, .index = index }) catch return Error.OutOfMemory;
+                stack.append(self.allocator, v) catch return Error.OutOfMemory;
+            }
+        }
+    }
+};
+
+/// Apply the ops recorded in an `OpLog` (its `data()`) to `target`, any
+/// type with the Buffer set/append/get methods (`*Buffer`,
+/// `*ManagedContext`, `*Context`).
+pub fn replay(log: []const u8, target: anytype) Error!void {
+    const v = try ConstView.init(log);
+    const n = try v.count(root);
+    for (0..n) |i| {
+        const op = try v.arrGetObj(root, @intCast(i));
+        const p = try v.getArr(op, "p");
+        const depth = try v.count(p);
+        var ofs = root;
+        for (0..depth) |j| {
+            const seg: u32 = @intCast(j);
+            ofs = switch (try v.arrGetType(p, seg)) {
+                .string => blk: {
+                    const k = try v.arrGetStr(p, seg);
+                    break :blk switch (try target.getType(ofs, k)) {
+                        .object => try target.getObj(ofs, k),
+                        .array => try target.getArr(ofs, k),
+                        else => return Error.InvalidArgument,
+                    };
+                },
+                .i64_ => blk: {
+                    const index = std.math.cast(u32, try v.arrGetI64(p, seg)) orelse return Error.CorruptData;
+                    break :blk switch (try target.arrGetType(ofs, index)) {
+                        .object => try target.arrGetObj(ofs, index),
+                        .array => try target.arrGetArr(ofs, index),
+                        else => return Error.InvalidArgument,
+                    };
+                },
+                else => return Error.CorruptData,
+            };
+        }
+
+        const value = try v.getValue(op, "v");
+        switch (try v.getI64(op, "o")) {
+            OpLog.op_set => {
+                const k = try v.getStr(op, "k");
+                switch (value) {
+                    .null => try target.setNull(ofs, k),
+                    .bool_ => |b| try target.setBool(ofs, k, b),
+                    .i64_ => |x| try target.setI64(ofs, k, x),
+                    .f64_ => |f| try target.setF64(ofs, k, f),
+                    .string => |s| try target.setStr(ofs, k, s),
+                    .bytes => |b| try target.setBytes(ofs, k, b),
+                    .object => {
+                        _ = try target.setObj(ofs, k);
+                    },
+                    .array => {
+                        _ = try target.setArr(ofs, k);
+                    },
+                }
+            },
+            OpLog.op_append => switch (value) {
+                .null => try target.arrAppendNull(ofs),
+                .bool_ => |b| try target.arrAppendBool(ofs, b),
+                .i64_ => |x| try target.arrAppendI64(ofs, x),
+                .f64_ => |f| try target.arrAppendF64(ofs, f),
+                .string => |s| try target.arrAppendStr(ofs, s),
+                .bytes => |b| try target.arrAppendBytes(ofs, b),
+                .object => {
+                    _ = try target.arrAppendObj(ofs);
+                },
+                .array => {
+                    _ = try target.arrAppendArr(ofs);
+                },
+            },
+            else => return Error.CorruptData,
+        }
+    }
+}
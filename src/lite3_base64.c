@@ -0,0 +1,343 @@
+/**
+ * lite3_base64.c - Vectorized base64 codec used by the JSON bridge.
+ *
+ * The SIMD kernels follow the well-known pshufb/multiply-shift scheme
+ * (W. Mula, D. Lemire, "Faster Base64 Encoding and Decoding Using AVX2
+ * Instructions"). Each kernel only handles whole, valid blocks; tails,
+ * padding and error reporting always go through the scalar code so the
+ * three implementations produce byte-identical results.
+ */
+#include "lite3_base64.h"
+#include <errno.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LITE3_B64_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static const char b64_enc_table[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+#define B64_INV 0xFF
+
+static const uint8_t b64_dec_table[256] = {
+    ['A'] = 1,  ['B'] = 2,  ['C'] = 3,  ['D'] = 4,  ['E'] = 5,  ['F'] = 6,
+    ['G'] = 7,  ['H'] = 8,  ['I'] = 9,  ['J'] = 10, ['K'] = 11, ['L'] = 12,
+    ['M'] = 13, ['N'] = 14, ['O'] = 15, ['P'] = 16, ['Q'] = 17, ['R'] = 18,
+    ['S'] = 19, ['T'] = 20, ['U'] = 21, ['V'] = 22, ['W'] = 23, ['X'] = 24,
+    ['Y'] = 25, ['Z'] = 26, ['a'] = 27, ['b'] = 28, ['c'] = 29, ['d'] = 30,
+    ['e'] = 31, ['f'] = 32, ['g'] = 33, ['h'] = 34, ['i'] = 35, ['j'] = 36,
+    ['k'] = 37, ['l'] = 38, ['m'] = 39, ['n'] = 40, ['o'] = 41, ['p'] = 42,
+    ['q'] = 43, ['r'] = 44, ['s'] = 45, ['t'] = 46, ['u'] = 47, ['v'] = 48,
+    ['w'] = 49, ['x'] = 50, ['y'] = 51, ['z'] = 52, ['0'] = 53, ['1'] = 54,
+    ['2'] = 55, ['3'] = 56, ['4'] = 57, ['5'] = 58, ['6'] = 59, ['7'] = 60,
+    ['8'] = 61, ['9'] = 62, ['+'] = 63, ['/'] = 64,
+};
+
+/* Entries hold sextet + 1 so that unlisted characters (zero-initialized)
+   map to B64_INV after the subtraction below. */
+static inline uint8_t b64_sextet(unsigned char ch)
+{
+    return (uint8_t)(b64_dec_table[ch] - 1);
+}
+
+/* ---- Scalar ---- */
+
+static size_t b64_enc_scalar(const unsigned char *src, size_t len, char *dst)
+{
+    size_t i = 0;
+    char *o = dst;
+    for (; i + 3 <= len; i += 3) {
+        uint32_t v = ((uint32_t)src[i] << 16) | ((uint32_t)src[i + 1] << 8) | src[i + 2];
+        o[0] = b64_enc_table[(v >> 18) & 0x3f];
+        o[1] = b64_enc_table[(v >> 12) & 0x3f];
+        o[2] = b64_enc_table[(v >> 6) & 0x3f];
+        o[3] = b64_enc_table[v & 0x3f];
+        o += 4;
+    }
+    size_t rem = len - i;
+    if (rem == 1) {
+        uint32_t v = (uint32_t)src[i] << 16;
+        o[0] = b64_enc_table[(v >> 18) & 0x3f];
+        o[1] = b64_enc_table[(v >> 12) & 0x3f];
+        o[2] = '=';
+        o[3] = '=';
+        o += 4;
+    } else if (rem == 2) {
+        uint32_t v = ((uint32_t)src[i] << 16) | ((uint32_t)src[i + 1] << 8);
+        o[0] = b64_enc_table[(v >> 18) & 0x3f];
+        o[1] = b64_enc_table[(v >> 12) & 0x3f];
+        o[2] = b64_enc_table[(v >> 6) & 0x3f];
+        o[3] = '=';
+        o += 4;
+    }
+    return (size_t)(o - dst);
+}
+
+/* Decodes `src[0..len]` (len % 4 == 0) into `dst`. Returns bytes written or
+   SIZE_MAX on malformed input. Padding is only accepted in the final quad. */
+static size_t b64_dec_scalar(const char *src, size_t len, unsigned char *dst)
+{
+    const unsigned char *s = (const unsigned char *)src;
+    unsigned char *o = dst;
+    for (size_t i = 0; i < len; i += 4) {
+        uint8_t a = b64_sextet(s[i]);
+        uint8_t b = b64_sextet(s[i + 1]);
+        if (a == B64_INV || b == B64_INV)
+            return SIZE_MAX;
+        int last = (i + 4 == len);
+        if (last && s[i + 2] == '=' && s[i + 3] == '=') {
+            *o++ = (unsigned char)((a << 2) | (b >> 4));
+            break;
+        }
+        uint8_t c = b64_sextet(s[i + 2]);
+        if (c == B64_INV)
+            return SIZE_MAX;
+        if (last && s[i + 3] == '=') {
+            *o++ = (unsigned char)((a << 2) | (b >> 4));
+            *o++ = (unsigned char)((b << 4) | (c >> 2));
+            break;
+        }
+        uint8_t d = b64_sextet(s[i + 3]);
+        if (d == B64_INV)
+            return SIZE_MAX;
+        *o++ = (unsigned char)((a << 2) | (b >> 4));
+        *o++ = (unsigned char)((b << 4) | (c >> 2));
+        *o++ = (unsigned char)((c << 6) | d);
+    }
+    return (size_t)(o - dst);
+}
+
+/* ---- x86 SIMD kernels ---- */
+
+#ifdef LITE3_B64_X86
+
+__attribute__((target("ssse3")))
+static inline __m128i b64_enc_reshuffle_128(__m128i in)
+{
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i b64_enc_translate_128(__m128i in)
+{
+    const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4,
+                                      -4, -4, -4, -4, -19, -16, 0, 0);
+    __m128i idx = _mm_subs_epu8(in, _mm_set1_epi8(51));
+    idx = _mm_sub_epi8(idx, _mm_cmpgt_epi8(in, _mm_set1_epi8(25)));
+    return _mm_add_epi8(in, _mm_shuffle_epi8(lut, idx));
+}
+
+/* Reads 16 bytes, consumes 12, writes 16 characters. */
+__attribute__((target("ssse3")))
+static size_t b64_enc_ssse3(const unsigned char *src, size_t len, char *dst)
+{
+    size_t i = 0;
+    char *o = dst;
+    for (; i + 16 <= len; i += 12) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i out = b64_enc_translate_128(b64_enc_reshuffle_128(in));
+        _mm_storeu_si128((__m128i *)o, out);
+        o += 16;
+    }
+    o += b64_enc_scalar(src + i, len - i, o);
+    return (size_t)(o - dst);
+}
+
+/* Reads 28 bytes, consumes 24, writes 32 characters. */
+__attribute__((target("avx2")))
+static size_t b64_enc_avx2(const unsigned char *src, size_t len, char *dst)
+{
+    const __m256i shuf = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                         10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m256i lut = _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4,
+                                         -4, -4, -4, -4, -19, -16, 0, 0,
+                                         65, 71, -4, -4, -4, -4, -4, -4,
+                                         -4, -4, -4, -4, -19, -16, 0, 0);
+    size_t i = 0;
+    char *o = dst;
+    for (; i + 28 <= len; i += 24) {
+        __m256i in = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(src + i))),
+            _mm_loadu_si128((const __m128i *)(src + i + 12)), 1);
+        in = _mm256_shuffle_epi8(in, shuf);
+        const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+        const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+        const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        const __m256i sextets = _mm256_or_si256(t1, t3);
+
+        __m256i idx = _mm256_subs_epu8(sextets, _mm256_set1_epi8(51));
+        idx = _mm256_sub_epi8(idx, _mm256_cmpgt_epi8(sextets, _mm256_set1_epi8(25)));
+        const __m256i out = _mm256_add_epi8(sextets, _mm256_shuffle_epi8(lut, idx));
+        _mm256_storeu_si256((__m256i *)o, out);
+        o += 32;
+    }
+    o += b64_enc_ssse3(src + i, len - i, o);
+    return (size_t)(o - dst);
+}
+
+/* Reads 16 characters, writes 16 bytes of which 12 are valid. Stops at the
+   first block holding padding or an invalid character and leaves it to the
+   scalar path. The `i + 24 <= len` bound keeps the 4-byte overrun inside the
+   caller's decoded length. */
+__attribute__((target("ssse3")))
+static size_t b64_dec_ssse3(const char *src, size_t len, unsigned char *dst, size_t *consumed)
+{
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f = _mm_set1_epi8(0x2f);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t i = 0;
+    unsigned char *o = dst;
+    for (; i + 24 <= len; i += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+        const __m128i hi_nib = _mm_and_si128(_mm_srli_epi32(in, 4), mask_2f);
+        const __m128i lo_nib = _mm_and_si128(in, mask_2f);
+        const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nib);
+        const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nib);
+        const __m128i bad = _mm_and_si128(lo, hi);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) != 0xFFFF)
+            break;
+        const __m128i eq_2f = _mm_cmpeq_epi8(in, mask_2f);
+        in = _mm_add_epi8(in, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nib)));
+
+        __m128i out = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+        out = _mm_madd_epi16(out, _mm_set1_epi32(0x00011000));
+        out = _mm_shuffle_epi8(out, pack);
+        _mm_storeu_si128((__m128i *)o, out);
+        o += 12;
+    }
+    *consumed = i;
+    return (size_t)(o - dst);
+}
+
+/* Reads 32 characters, writes 32 bytes of which 24 are valid. */
+__attribute__((target("avx2")))
+static size_t b64_dec_avx2(const char *src, size_t len, unsigned char *dst, size_t *consumed)
+{
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                              0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 16, 19, 4, -65, -65, -71, -71,
+                                              0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+    size_t i = 0;
+    unsigned char *o = dst;
+    for (; i + 48 <= len; i += 32) {
+        __m256i in = _mm256_loadu_si256((const __m256i *)(src + i));
+        const __m256i hi_nib = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask_2f);
+        const __m256i lo_nib = _mm256_and_si256(in, mask_2f);
+        const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nib);
+        const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nib);
+        const __m256i bad = _mm256_and_si256(lo, hi);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(bad, _mm256_setzero_si256())) != -1)
+            break;
+        const __m256i eq_2f = _mm256_cmpeq_epi8(in, mask_2f);
+        in = _mm256_add_epi8(in, _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nib)));
+
+        __m256i out = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+        out = _mm256_madd_epi16(out, _mm256_set1_epi32(0x00011000));
+        out = _mm256_shuffle_epi8(out, pack);
+        out = _mm256_permutevar8x32_epi32(out, lanes);
+        _mm256_storeu_si256((__m256i *)o, out);
+        o += 24;
+    }
+    size_t rest = 0;
+    o += b64_dec_ssse3(src + i, len - i, o, &rest);
+    *consumed = i + rest;
+    return (size_t)(o - dst);
+}
+
+enum { B64_LEVEL_UNSET = 0, B64_LEVEL_SCALAR, B64_LEVEL_SSSE3, B64_LEVEL_AVX2 };
+
+static int b64_detect_level(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return B64_LEVEL_SCALAR;
+    int level = (ecx & bit_SSSE3) ? B64_LEVEL_SSSE3 : B64_LEVEL_SCALAR;
+    if (level == B64_LEVEL_SSSE3 && (ecx & bit_OSXSAVE)) {
+        unsigned int xcr0_lo, xcr0_hi;
+        __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        (void)xcr0_hi;
+        /* OS must save both XMM and YMM state. */
+        if ((xcr0_lo & 0x6) == 0x6 &&
+            __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2))
+            level = B64_LEVEL_AVX2;
+    }
+    return level;
+}
+
+/* Idempotent lazy init: concurrent first callers store the same value. */
+static int b64_level(void)
+{
+    static volatile int level = B64_LEVEL_UNSET;
+    int l = level;
+    if (l == B64_LEVEL_UNSET) {
+        l = b64_detect_level();
+        level = l;
+    }
+    return l;
+}
+
+#endif /* LITE3_B64_X86 */
+
+/* ---- Public entry points ---- */
+
+size_t lite3_b64_enc(const unsigned char *src, size_t len, char *dst)
+{
+#ifdef LITE3_B64_X86
+    switch (b64_level()) {
+    case B64_LEVEL_AVX2:  return b64_enc_avx2(src, len, dst);
+    case B64_LEVEL_SSSE3: return b64_enc_ssse3(src, len, dst);
+    default: break;
+    }
+#endif
+    return b64_enc_scalar(src, len, dst);
+}
+
+int lite3_b64_dec(const char *src, size_t len, unsigned char *dst, size_t *out_len)
+{
+    if (len % 4 != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t consumed = 0;
+    size_t written = 0;
+#ifdef LITE3_B64_X86
+    switch (b64_level()) {
+    case B64_LEVEL_AVX2:  written = b64_dec_avx2(src, len, dst, &consumed); break;
+    case B64_LEVEL_SSSE3: written = b64_dec_ssse3(src, len, dst, &consumed); break;
+    default: break;
+    }
+#endif
+    size_t tail = b64_dec_scalar(src + consumed, len - consumed, dst + written);
+    if (tail == SIZE_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (out_len)
+        *out_len = written + tail;
+    return 0;
+}
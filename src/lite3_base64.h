@@ -0,0 +1,51 @@
+/**
+ * lite3_base64.h - Vectorized base64 codec used by the JSON bridge.
+ *
+ * Standard alphabet (RFC 4648 section 4) with '=' padding. Encoding and
+ * decoding write straight into caller-provided memory so the JSON encoder can
+ * target the yyjson string pool and the JSON decoder can target the Lite3
+ * buffer without intermediate allocations.
+ *
+ * On x86/x86_64 an AVX2 or SSSE3 kernel is selected at runtime via CPUID;
+ * every other target uses the portable scalar path.
+ */
+#ifndef LITE3_BASE64_H
+#define LITE3_BASE64_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Number of characters produced when encoding `len` bytes (padding included). */
+static inline size_t lite3_b64_enc_len(size_t len)
+{
+    return ((len + 2) / 3) * 4;
+}
+
+/* Exact number of bytes produced when decoding `src[0..len]`.
+   Returns SIZE_MAX if `len` is not a multiple of 4. */
+static inline size_t lite3_b64_dec_len(const char *src, size_t len)
+{
+    if (len % 4 != 0) return SIZE_MAX;
+    if (len == 0) return 0;
+    size_t pad = (src[len - 1] == '=') + (src[len - 2] == '=');
+    return (len / 4) * 3 - pad;
+}
+
+/* Encode `len` bytes into `dst`, which must hold `lite3_b64_enc_len(len)`
+   characters. No NUL-terminator is written. Returns the characters written. */
+size_t lite3_b64_enc(const unsigned char *src, size_t len, char *dst);
+
+/* Decode padded base64 `src[0..len]` into `dst`, which must hold
+   `lite3_b64_dec_len(src, len)` bytes. Nothing is written past that length.
+   Returns 0 on success, -1 with errno = EINVAL on malformed input. */
+int lite3_b64_dec(const char *src, size_t len, unsigned char *dst, size_t *out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LITE3_BASE64_H */
@@ -77,3 +77,23 @@ int64_t lite3_json_enc_pretty_buf(const unsigned char *buf, size_t buflen, size_
     (void)json_bufsz;
     return lite3_json_disabled_error();
 }
+
+int lite3_json_dec_opts(unsigned char *buf, size_t *out_buflen, size_t bufsz, const char *json_str, size_t json_len, unsigned flags) {
+    (void)buf;
+    (void)out_buflen;
+    (void)bufsz;
+    (void)json_str;
+    (void)json_len;
+    (void)flags;
+    return lite3_json_disabled_error();
+}
+
+char *lite3_json_enc_opts(const unsigned char *buf, size_t buflen, size_t ofs, unsigned flags, size_t *out_len) {
+    (void)buf;
+    (void)buflen;
+    (void)ofs;
+    (void)flags;
+    if (out_len) *out_len = 0;
+    errno = EINVAL;
+    return NULL;
+}
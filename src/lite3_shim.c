@@ -10,6 +10,7 @@
 #include "lite3_context_api.h"
 #include "lite3_shim.h"
 #include <string.h>
+#include <stddef.h>
 #include <errno.h>
 #include <stdlib.h>
 
@@ -287,8 +288,526 @@ int shim_lite3_iter_next(const unsigned char *buf, size_t buflen, shim_lite3_ite
     return 0;
 }
 
+/* ---- Buffer API: Raw value slots (precomputed key data) ---- */
+
+int shim_lite3_get_val_kd(const unsigned char *buf, size_t buflen, size_t ofs,
+                          const char *key, uint32_t key_hash, uint32_t key_size,
+                          size_t *out_val_ofs)
+{
+    int ret;
+    if ((ret = _lite3_verify_obj_get(buf, buflen, ofs, key)) < 0)
+        return ret;
+    lite3_key_data kd = { .hash = key_hash, .size = key_size };
+    lite3_val *val;
+    if ((ret = lite3_get_impl(buf, buflen, ofs, key, kd, &val)) < 0)
+        return ret;
+    *out_val_ofs = (size_t)((const unsigned char *)val - buf);
+    return ret;
+}
+
+int shim_lite3_set_val_kd(unsigned char *buf, size_t *inout_buflen, size_t ofs, size_t bufsz,
+                          const char *key, uint32_t key_hash, uint32_t key_size,
+                          uint8_t type, size_t payload_len, size_t *out_val_ofs)
+{
+    int ret;
+    if ((ret = _lite3_verify_obj_set(buf, inout_buflen, ofs, bufsz, key)) < 0)
+        return ret;
+    lite3_key_data kd = { .hash = key_hash, .size = key_size };
+    switch (type) {
+    case LITE3_TYPE_OBJECT:
+        return lite3_set_obj_impl(buf, inout_buflen, ofs, bufsz, key, kd, out_val_ofs);
+    case LITE3_TYPE_ARRAY:
+        return lite3_set_arr_impl(buf, inout_buflen, ofs, bufsz, key, kd, out_val_ofs);
+    default:
+        if (type >= LITE3_TYPE_INVALID) {
+            errno = EINVAL;
+            return -1;
+        }
+        break;
+    }
+    lite3_val *val;
+    if ((ret = lite3_set_impl(buf, inout_buflen, ofs, bufsz, key, kd, payload_len, &val)) < 0)
+        return ret;
+    val->type = type;
+    *out_val_ofs = (size_t)((unsigned char *)val - buf);
+    return ret;
+}
+
+int shim_lite3_arr_get_val(const unsigned char *buf, size_t buflen, size_t ofs,
+                           uint32_t index, size_t *out_val_ofs)
+{
+    lite3_val *val;
+    int ret;
+    if ((ret = _lite3_get_by_index(buf, buflen, ofs, index, &val)) < 0)
+        return ret;
+    *out_val_ofs = (size_t)((const unsigned char *)val - buf);
+    return ret;
+}
+
+int shim_lite3_arr_append_val(unsigned char *buf, size_t *inout_buflen, size_t ofs, size_t bufsz,
+                              uint8_t type, size_t payload_len, size_t *out_val_ofs)
+{
+    int ret;
+    switch (type) {
+    case LITE3_TYPE_OBJECT:
+        return lite3_arr_append_obj(buf, inout_buflen, ofs, bufsz, out_val_ofs);
+    case LITE3_TYPE_ARRAY:
+        return lite3_arr_append_arr(buf, inout_buflen, ofs, bufsz, out_val_ofs);
+    default:
+        if (type >= LITE3_TYPE_INVALID) {
+            errno = EINVAL;
+            return -1;
+        }
+        break;
+    }
+    lite3_val *val;
+    if ((ret = _lite3_set_by_append(buf, inout_buflen, ofs, bufsz, payload_len, &val)) < 0)
+        return ret;
+    val->type = type;
+    *out_val_ofs = (size_t)((unsigned char *)val - buf);
+    return ret;
+}
+
+int shim_lite3_bump_gen(unsigned char *buf, size_t buflen, size_t ofs)
+{
+    int ret;
+    if ((ret = _lite3_verify_get(buf, buflen, ofs)) < 0)
+        return ret;
+    if (buf[ofs] != LITE3_TYPE_OBJECT && buf[ofs] != LITE3_TYPE_ARRAY) {
+        errno = EINVAL;
+        return -1;
+    }
+    uint32_t gen_type;
+    memcpy(&gen_type, buf + ofs, sizeof(gen_type));
+    gen_type = (gen_type & 0xFFu) | (((gen_type >> 8) + 1) << 8);
+    memcpy(buf + ofs, &gen_type, sizeof(gen_type));
+    return 0;
+}
+
+/* ---- Buffer API: Shapes and inline lookup caches ---- */
+
+/* Mirror of `struct node` in lite3.c, which is private to that file. */
+struct shim_node {
+    uint32_t gen_type;
+    uint32_t hashes[7];
+    uint32_t size_kc;
+    uint32_t kv_ofs[7];
+    uint32_t child_ofs[8];
+};
+_Static_assert(sizeof(struct shim_node) == LITE3_NODE_SIZE, "shim_node must mirror struct node");
+_Static_assert(offsetof(struct shim_node, size_kc) == LITE3_NODE_SIZE_KC_OFFSET, "shim_node must mirror struct node");
+_Static_assert(SHIM_LITE3_TREE_HEIGHT_MAX == LITE3_TREE_HEIGHT_MAX, "tree height mismatch");
+
+#define SHIM_NODE_KEY_COUNT_MASK 0x7u
+#define SHIM_NODE_TYPE_MASK 0xFFu
+#define SHIM_NODE_GEN_SHIFT 8
+#define SHIM_KEY_TAG_SIZE_MASK 0x3u
+#define SHIM_KEY_TAG_KEY_SIZE_SHIFT 2
+#define SHIM_KEY_TAG_SIZE_MAX 4
+
+/* Node at `ofs`, or NULL with errno set if misaligned or out of bounds. */
+static const struct shim_node *shim_node_at(const unsigned char *buf, size_t buflen, size_t ofs)
+{
+    if (LITE3_NODE_SIZE > buflen || ofs > buflen - LITE3_NODE_SIZE) {
+        errno = EFAULT;
+        return NULL;
+    }
+    if (((uintptr_t)(buf + ofs) & LITE3_NODE_ALIGNMENT_MASK) != 0) {
+        errno = EBADMSG;
+        return NULL;
+    }
+    return (const struct shim_node *)(buf + ofs);
+}
+
+/* Compare the key entry at `kv_ofs` against `key`. Returns 1 and the value
+   offset on a match, 0 on mismatch, -1 with errno set if out of bounds. */
+static int shim_match_key(const unsigned char *buf, size_t buflen, size_t kv_ofs,
+                          const char *key, size_t key_size, size_t *out_val_ofs)
+{
+    if (SHIM_KEY_TAG_SIZE_MAX > buflen || kv_ofs > buflen - SHIM_KEY_TAG_SIZE_MAX) {
+        errno = EFAULT;
+        return -1;
+    }
+    size_t tag_size = (size_t)(buf[kv_ofs] & SHIM_KEY_TAG_SIZE_MASK) + 1;
+    size_t stored_size = 0;
+    memcpy(&stored_size, buf + kv_ofs, tag_size);
+    stored_size >>= SHIM_KEY_TAG_KEY_SIZE_SHIFT;
+    kv_ofs += tag_size;
+    if (stored_size > buflen || kv_ofs > buflen - stored_size) {
+        errno = EFAULT;
+        return -1;
+    }
+    if (stored_size != key_size || memcmp(buf + kv_ofs, key, key_size) != 0)
+        return 0;
+    *out_val_ofs = kv_ofs + stored_size;
+    return 1;
+}
+
+/* Bounds-check the value entry at `val_ofs`, as lite3_get_impl does, and
+   optionally return its size (type byte included). */
+static int shim_verify_val(const unsigned char *buf, size_t buflen, size_t val_ofs, size_t *out_entry_size)
+{
+    if (LITE3_VAL_SIZE > buflen || val_ofs > buflen - LITE3_VAL_SIZE) {
+        errno = EFAULT;
+        return -1;
+    }
+    uint8_t type = buf[val_ofs];
+    if (type >= LITE3_TYPE_INVALID) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t entry_size = LITE3_VAL_SIZE + lite3_type_sizes[type];
+    if (type == LITE3_TYPE_STRING || type == LITE3_TYPE_BYTES) {
+        uint32_t byte_count;
+        if (entry_size > buflen || val_ofs > buflen - entry_size) {
+            errno = EFAULT;
+            return -1;
+        }
+        memcpy(&byte_count, buf + val_ofs + LITE3_VAL_SIZE, sizeof(byte_count));
+        entry_size += byte_count;
+    }
+    if (entry_size > buflen || val_ofs > buflen - entry_size) {
+        errno = EFAULT;
+        return -1;
+    }
+    if (out_entry_size)
+        *out_entry_size = entry_size;
+    return 0;
+}
+
+static uint64_t shim_shape_mix(uint64_t h, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        h ^= (v >> (8 * i)) & 0xFFu;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/* `budget` caps the total node visits: a well-formed tree has at most
+   buflen / LITE3_NODE_SIZE nodes, while aliased child offsets could
+   otherwise revisit subtrees exponentially within the depth limit. */
+static int shim_shape_walk(const unsigned char *buf, size_t buflen, size_t ofs, int depth,
+                           size_t *budget, uint64_t *h)
+{
+    const struct shim_node *node = shim_node_at(buf, buflen, ofs);
+    if (!node)
+        return -1;
+    if (depth > LITE3_TREE_HEIGHT_MAX || *budget == 0) {
+        errno = EBADMSG;
+        return -1;
+    }
+    (*budget)--;
+    uint32_t key_count = node->size_kc & SHIM_NODE_KEY_COUNT_MASK;
+    *h = shim_shape_mix(*h, key_count);
+    for (uint32_t i = 0; i < key_count; i++)
+        *h = shim_shape_mix(*h, node->hashes[i]);
+    if (node->child_ofs[0]) {
+        for (uint32_t i = 0; i <= key_count; i++) {
+            if (shim_shape_walk(buf, buflen, node->child_ofs[i], depth + 1, budget, h) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+int shim_lite3_shape(const unsigned char *buf, size_t buflen, size_t ofs, uint64_t *out_shape)
+{
+    int ret;
+    if ((ret = _lite3_verify_get(buf, buflen, ofs)) < 0)
+        return ret;
+    const struct shim_node *node = shim_node_at(buf, buflen, ofs);
+    if (!node)
+        return -1;
+    uint64_t h = shim_shape_mix(0xcbf29ce484222325ULL, node->gen_type & SHIM_NODE_TYPE_MASK);
+    size_t budget = buflen / LITE3_NODE_SIZE;
+    if ((ret = shim_shape_walk(buf, buflen, ofs, 0, &budget, &h)) < 0)
+        return ret;
+    *out_shape = h;
+    return 0;
+}
+
+/* Full descent mirroring lite3_get_impl, recording the path into `ic`. */
+static int shim_ic_lookup(const unsigned char *buf, size_t buflen, size_t ofs,
+                          const char *key, uint32_t key_hash, uint32_t key_size,
+                          shim_lite3_ic *ic, size_t *out_val_ofs)
+{
+    for (uint32_t attempt = 0; attempt < LITE3_HASH_PROBE_MAX; attempt++) {
+        uint32_t hash = key_hash + attempt * attempt;
+        const struct shim_node *node = shim_node_at(buf, buflen, ofs);
+        uint8_t depth = 0;
+        if (!node)
+            return -1;
+        for (;;) {
+            uint32_t key_count = node->size_kc & SHIM_NODE_KEY_COUNT_MASK;
+            uint32_t i = 0;
+            while (i < key_count && node->hashes[i] < hash)
+                i++;
+            if (i < key_count && node->hashes[i] == hash) {
+                size_t val_ofs;
+                int match = shim_match_key(buf, buflen, node->kv_ofs[i], key, key_size, &val_ofs);
+                if (match < 0)
+                    return -1;
+                if (match == 0)
+                    break; /* hash collision: next probe */
+                if (shim_verify_val(buf, buflen, val_ofs, NULL) < 0)
+                    return -1;
+                ic->hash = hash;
+                ic->depth = depth;
+                ic->slot = (uint8_t)i;
+                *out_val_ofs = val_ofs;
+                return 0;
+            }
+            if (!node->child_ofs[0]) {
+                errno = ENOENT;
+                return -1;
+            }
+            if (depth >= SHIM_LITE3_TREE_HEIGHT_MAX) {
+                errno = EBADMSG;
+                return -1;
+            }
+            ic->path[depth++] = (uint8_t)i;
+            if (!(node = shim_node_at(buf, buflen, node->child_ofs[i])))
+                return -1;
+        }
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+int shim_lite3_ic_get_val(const unsigned char *buf, size_t buflen, size_t ofs,
+                          const char *key, uint32_t key_hash, uint32_t key_size,
+                          shim_lite3_ic *ic, size_t *out_val_ofs)
+{
+    int ret;
+    if ((ret = _lite3_verify_obj_get(buf, buflen, ofs, key)) < 0)
+        return ret;
+    if (ic->depth != SHIM_LITE3_IC_EMPTY && ic->depth <= SHIM_LITE3_TREE_HEIGHT_MAX) {
+        const struct shim_node *node = shim_node_at(buf, buflen, ofs);
+        for (uint8_t d = 0; node && d < ic->depth; d++) {
+            uint32_t key_count = node->size_kc & SHIM_NODE_KEY_COUNT_MASK;
+            if (!node->child_ofs[0] || ic->path[d] > key_count)
+                node = NULL;
+            else
+                node = shim_node_at(buf, buflen, node->child_ofs[ic->path[d]]);
+        }
+        size_t val_ofs;
+        if (node && ic->slot < (node->size_kc & SHIM_NODE_KEY_COUNT_MASK)
+                && node->hashes[ic->slot] == ic->hash
+                && shim_match_key(buf, buflen, node->kv_ofs[ic->slot], key, key_size, &val_ofs) == 1
+                && shim_verify_val(buf, buflen, val_ofs, NULL) == 0) {
+            *out_val_ofs = val_ofs;
+            return 1;
+        }
+    }
+    ic->depth = SHIM_LITE3_IC_EMPTY;
+    if ((ret = shim_ic_lookup(buf, buflen, ofs, key, key_hash, key_size, ic, out_val_ofs)) < 0) {
+        ic->depth = SHIM_LITE3_IC_EMPTY;
+        return ret;
+    }
+    return 0;
+}
+
+/* ---- Buffer API: Cursors ---- */
+
+static void shim_cursor_reset(shim_lite3_cursor *cur, size_t ofs, uint32_t gen_type)
+{
+    cur->gen = gen_type;
+    cur->ofs = ofs;
+    cur->depth = 0;
+    cur->node_ofs[0] = (uint32_t)ofs;
+    cur->lo[0] = 0;
+    cur->hi[0] = (uint64_t)UINT32_MAX + 1;
+}
+
+/* Find `key` below the object at `ofs`, starting from the deepest node on the
+   cursor's path whose hash range contains the probe hash. The path is then
+   truncated/extended to end at the node holding the key (or the leaf where
+   the search ended). A miss that did not start at `ofs` is retried from
+   `ofs`, so results never depend on the cursor being current. */
+static int shim_cursor_find(const unsigned char *buf, size_t buflen, size_t ofs,
+                            const char *key, uint32_t key_hash, uint32_t key_size,
+                            shim_lite3_cursor *cur, size_t *out_val_ofs, size_t *out_entry_size)
+{
+    const struct shim_node *top = shim_node_at(buf, buflen, ofs);
+    if (!top)
+        return -1;
+    if (cur->depth > SHIM_LITE3_TREE_HEIGHT_MAX || cur->ofs != ofs || cur->gen != top->gen_type)
+        shim_cursor_reset(cur, ofs, top->gen_type);
+
+    for (uint32_t attempt = 0; attempt < LITE3_HASH_PROBE_MAX; attempt++) {
+        uint64_t hash = (uint32_t)(key_hash + attempt * attempt);
+        uint8_t d = cur->depth;
+        while (d > 0 && !(cur->lo[d] <= hash && hash < cur->hi[d]))
+            d--;
+        uint8_t start = d;
+        for (;;) {
+            const struct shim_node *node = shim_node_at(buf, buflen, cur->node_ofs[d]);
+            if (!node)
+                return -1;
+            uint32_t key_count = node->size_kc & SHIM_NODE_KEY_COUNT_MASK;
+            uint32_t i = 0;
+            while (i < key_count && node->hashes[i] < hash)
+                i++;
+            if (i < key_count && node->hashes[i] == hash) {
+                size_t val_ofs;
+                int match = shim_match_key(buf, buflen, node->kv_ofs[i], key, key_size, &val_ofs);
+                if (match < 0)
+                    return -1;
+                if (match == 0)
+                    break; /* hash collision: next probe */
+                if (shim_verify_val(buf, buflen, val_ofs, out_entry_size) < 0)
+                    return -1;
+                cur->depth = d;
+                *out_val_ofs = val_ofs;
+                return 0;
+            }
+            if (!node->child_ofs[0]) {
+                if (start != 0) {
+                    /* confirm the miss from the top before reporting it */
+                    start = d = 0;
+                    continue;
+                }
+                cur->depth = d;
+                errno = ENOENT;
+                return -1;
+            }
+            if (d >= SHIM_LITE3_TREE_HEIGHT_MAX) {
+                shim_cursor_reset(cur, ofs, top->gen_type);
+                errno = EBADMSG;
+                return -1;
+            }
+            cur->node_ofs[d + 1] = node->child_ofs[i];
+            cur->lo[d + 1] = i > 0 ? (uint64_t)node->hashes[i - 1] + 1 : cur->lo[d];
+            cur->hi[d + 1] = i < key_count ? (uint64_t)node->hashes[i] : cur->hi[d];
+            d++;
+        }
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+int shim_lite3_cursor_get_val(const unsigned char *buf, size_t buflen, size_t ofs,
+                              const char *key, uint32_t key_hash, uint32_t key_size,
+                              shim_lite3_cursor *cur, size_t *out_val_ofs)
+{
+    int ret;
+    if ((ret = _lite3_verify_obj_get(buf, buflen, ofs, key)) < 0)
+        return ret;
+    return shim_cursor_find(buf, buflen, ofs, key, key_hash, key_size, cur, out_val_ofs, NULL);
+}
+
+int shim_lite3_cursor_set_val(unsigned char *buf, size_t *inout_buflen, size_t ofs, size_t bufsz,
+                              const char *key, uint32_t key_hash, uint32_t key_size,
+                              uint8_t type, size_t payload_len,
+                              shim_lite3_cursor *cur, size_t *out_val_ofs)
+{
+    int ret;
+    if ((ret = _lite3_verify_obj_set(buf, inout_buflen, ofs, bufsz, key)) < 0)
+        return ret;
+    if (type < LITE3_TYPE_OBJECT) {
+        size_t val_ofs, entry_size;
+        if (shim_cursor_find(buf, *inout_buflen, ofs, key, key_hash, key_size, cur, &val_ofs, &entry_size) == 0) {
+            if (payload_len < entry_size) {
+                /* Same rule as lite3_set_impl: overwrite in place and bump the
+                   generation; the node tree is unchanged, so keep the path. */
+                struct shim_node *top = (struct shim_node *)(buf + ofs);
+                uint32_t gen = (top->gen_type >> SHIM_NODE_GEN_SHIFT) + 1;
+                top->gen_type = (top->gen_type & SHIM_NODE_TYPE_MASK) | (gen << SHIM_NODE_GEN_SHIFT);
+                cur->gen = top->gen_type;
+#ifdef LITE3_ZERO_MEM_DELETED
+                memset(buf + val_ofs, LITE3_ZERO_MEM_8, entry_size); /* zero out old value */
+#endif
+                buf[val_ofs] = type;
+                *out_val_ofs = val_ofs;
+                return 0;
+            }
+        } else if (errno != ENOENT) {
+            return -1;
+        }
+    }
+    cur->depth = SHIM_LITE3_IC_EMPTY;
+    return shim_lite3_set_val_kd(buf, inout_buflen, ofs, bufsz, key, key_hash, key_size,
+                                 type, payload_len, out_val_ofs);
+}
+
+/* ---- Buffer API: Write footprints ---- */
+
+static int shim_footprint_add(size_t *out_ofs, size_t *out_len, size_t cap, size_t *n, size_t ofs, size_t len)
+{
+    if (*n == cap) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    out_ofs[*n] = ofs;
+    out_len[*n] = len;
+    (*n)++;
+    return 0;
+}
+
+int shim_lite3_write_footprint(const unsigned char *buf, size_t buflen, size_t ofs,
+                               const char *key, uint32_t key_hash, uint32_t key_size,
+                               size_t *out_ofs, size_t *out_len, size_t cap)
+{
+    int ret;
+    if ((ret = _lite3_verify_get(buf, buflen, ofs)) < 0)
+        return ret;
+    size_t n = 0;
+    /* Mirrors the descent in lite3_set_impl. Splits only rewrite the node
+       being split and its parent, both on the path; new nodes are appended. */
+    uint32_t probe_attempts = key ? LITE3_HASH_PROBE_MAX : 1U;
+    for (uint32_t attempt = 0; attempt < probe_attempts; attempt++) {
+        uint32_t hash = key_hash + attempt * attempt;
+        size_t node_ofs = ofs;
+        int collision = 0;
+        for (int depth = 0; !collision; depth++) {
+            const struct shim_node *node = shim_node_at(buf, buflen, node_ofs);
+            if (!node)
+                return -1;
+            if (depth > SHIM_LITE3_TREE_HEIGHT_MAX) {
+                errno = EBADMSG;
+                return -1;
+            }
+            if (shim_footprint_add(out_ofs, out_len, cap, &n, node_ofs, LITE3_NODE_SIZE) < 0)
+                return -1;
+            uint32_t key_count = node->size_kc & SHIM_NODE_KEY_COUNT_MASK;
+            uint32_t i = 0;
+            while (i < key_count && node->hashes[i] < hash)
+                i++;
+            if (i < key_count && node->hashes[i] == hash) {
+                size_t kv_ofs = node->kv_ofs[i];
+                size_t val_ofs = kv_ofs;
+                size_t entry_size;
+                if (key) {
+                    int match = shim_match_key(buf, buflen, kv_ofs, key, key_size, &val_ofs);
+                    if (match < 0)
+                        return -1;
+                    if (match == 0) {
+                        collision = 1; /* next probe */
+                        continue;
+                    }
+                }
+                /* Overwrites either reuse the value in place or zero the old
+                   key and value (LITE3_ZERO_MEM_DELETED). */
+                if (shim_verify_val(buf, buflen, val_ofs, &entry_size) < 0)
+                    return -1;
+                if (shim_footprint_add(out_ofs, out_len, cap, &n, kv_ofs, val_ofs + entry_size - kv_ofs) < 0)
+                    return -1;
+                return (int)n;
+            }
+            if (!node->child_ofs[0])
+                return (int)n; /* inserted into this leaf */
+            node_ofs = node->child_ofs[i];
+        }
+    }
+    return (int)n;
+}
+
 /* ---- Buffer API: JSON ---- */
 
+_Static_assert(SHIM_LITE3_JSON_BYTES_DATA_URI == LITE3_JSON_BYTES_DATA_URI, "JSON flag mismatch");
+_Static_assert(SHIM_LITE3_JSON_PRETTY == LITE3_JSON_PRETTY, "JSON flag mismatch");
+
 int shim_lite3_json_dec(unsigned char *buf, size_t *out_buflen, size_t bufsz,
                         const char *json_str, size_t json_len)
 {
@@ -311,6 +830,18 @@ int64_t shim_lite3_json_enc_buf(const unsigned char *buf, size_t buflen, size_t
     return lite3_json_enc_buf(buf, buflen, ofs, json_buf, json_bufsz);
 }
 
+int shim_lite3_json_dec_opts(unsigned char *buf, size_t *out_buflen, size_t bufsz,
+                             const char *json_str, size_t json_len, unsigned flags)
+{
+    return lite3_json_dec_opts(buf, out_buflen, bufsz, json_str, json_len, flags);
+}
+
+char *shim_lite3_json_enc_opts(const unsigned char *buf, size_t buflen, size_t ofs,
+                               unsigned flags, size_t *out_len)
+{
+    return lite3_json_enc_opts(buf, buflen, ofs, flags, out_len);
+}
+
 /* ---- Context API ---- */
 
 lite3_ctx *shim_lite3_ctx_create(void) { return lite3_ctx_create(); }
@@ -431,3 +962,30 @@ int shim_lite3_ctx_count(lite3_ctx *ctx, size_t ofs, uint32_t *out) { return lit
 int shim_lite3_ctx_import_from_buf(lite3_ctx *ctx, const unsigned char *buf, size_t buflen) { return lite3_ctx_import_from_buf(ctx, buf, buflen); }
 
 int shim_lite3_ctx_json_dec(lite3_ctx *ctx, const char *json_str, size_t json_len) { return lite3_ctx_json_dec(ctx, json_str, json_len); }
+int shim_lite3_ctx_json_dec_opts(lite3_ctx *ctx, const char *json_str, size_t json_len, unsigned flags) { return lite3_ctx_json_dec_opts(ctx, json_str, json_len, flags); }
+
+int shim_lite3_ctx_set_val_kd(lite3_ctx *ctx, size_t ofs, const char *key, uint32_t key_hash, uint32_t key_size,
+                              uint8_t type, size_t payload_len, size_t *out_val_ofs)
+{
+    int ret;
+    errno = 0;
+    while ((ret = shim_lite3_set_val_kd(ctx->buf, &ctx->buflen, ofs, ctx->bufsz, key, key_hash, key_size,
+                                        type, payload_len, out_val_ofs)) < 0) {
+        if (errno == ENOBUFS && lite3_ctx_grow_impl(ctx) == 0)
+            continue;
+        return ret;
+    }
+    return ret;
+}
+
+int shim_lite3_ctx_arr_append_val(lite3_ctx *ctx, size_t ofs, uint8_t type, size_t payload_len, size_t *out_val_ofs)
+{
+    int ret;
+    errno = 0;
+    while ((ret = shim_lite3_arr_append_val(ctx->buf, &ctx->buflen, ofs, ctx->bufsz, type, payload_len, out_val_ofs)) < 0) {
+        if (errno == ENOBUFS && lite3_ctx_grow_impl(ctx) == 0)
+            continue;
+        return ret;
+    }
+    return ret;
+}
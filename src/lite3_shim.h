@@ -88,13 +88,102 @@ int shim_lite3_iter_create(const unsigned char *buf, size_t buflen, size_t ofs,
 int shim_lite3_iter_next(const unsigned char *buf, size_t buflen, shim_lite3_iter *iter,
                          const char **key_ptr, uint32_t *key_len, size_t *val_ofs);
 
+/* ---- Buffer API: Raw value slots (precomputed key data) ---- */
+/* Variants of get/set that take the key's DJB2 hash and size (strlen + 1)
+   precomputed by the caller and expose the raw value slot: `*out_val_ofs` is
+   the offset of the value's type byte, followed by its payload. The set
+   variants write the type byte (and initialize nodes for objects/arrays);
+   the caller writes the `payload_len` payload bytes. */
+int shim_lite3_get_val_kd(const unsigned char *buf, size_t buflen, size_t ofs,
+                          const char *key, uint32_t key_hash, uint32_t key_size,
+                          size_t *out_val_ofs);
+int shim_lite3_set_val_kd(unsigned char *buf, size_t *inout_buflen, size_t ofs, size_t bufsz,
+                          const char *key, uint32_t key_hash, uint32_t key_size,
+                          uint8_t type, size_t payload_len, size_t *out_val_ofs);
+int shim_lite3_arr_get_val(const unsigned char *buf, size_t buflen, size_t ofs,
+                           uint32_t index, size_t *out_val_ofs);
+int shim_lite3_arr_append_val(unsigned char *buf, size_t *inout_buflen, size_t ofs, size_t bufsz,
+                              uint8_t type, size_t payload_len, size_t *out_val_ofs);
+/* Bump the generation of the object/array at `ofs`, as every lite3 write
+   does. For callers that rewrite a value slot in place themselves. */
+int shim_lite3_bump_gen(unsigned char *buf, size_t buflen, size_t ofs);
+
+/* ---- Buffer API: Shapes and inline lookup caches ---- */
+#define SHIM_LITE3_TREE_HEIGHT_MAX 9
+#define SHIM_LITE3_IC_EMPTY 0xFFu
+
+/* Where one key was last found below an object: the child index taken at
+   each level, the slot in the final node and the (probe-adjusted) hash
+   stored there. `depth == SHIM_LITE3_IC_EMPTY` means nothing is cached. */
+typedef struct {
+    uint32_t hash;
+    uint8_t depth;
+    uint8_t slot;
+    uint8_t path[SHIM_LITE3_TREE_HEIGHT_MAX];
+} shim_lite3_ic;
+
+/* Fingerprint of the node tree at `ofs`: container type, then the key count
+   and key hashes of every node in depth-first order. Objects built from the
+   same keys in the same order share a shape. */
+int shim_lite3_shape(const unsigned char *buf, size_t buflen, size_t ofs, uint64_t *out_shape);
+/* Like shim_lite3_get_val_kd, but first replays the path cached in `ic`,
+   checking only the slot hash and key bytes. Returns 1 on a cache hit, 0 on
+   a miss (full lookup; `ic` updated) and < 0 on error (`ic` emptied). */
+int shim_lite3_ic_get_val(const unsigned char *buf, size_t buflen, size_t ofs,
+                          const char *key, uint32_t key_hash, uint32_t key_size,
+                          shim_lite3_ic *ic, size_t *out_val_ofs);
+
+/* ---- Buffer API: Cursors ---- */
+/* The last path walked below the object at `ofs`: node offsets from `ofs`
+   down, with the inclusive-exclusive hash range [lo, hi) each node covers.
+   Lookups start from the deepest node whose range holds the key hash. The
+   path is discarded when the object's generation (`gen`) changes. */
+typedef struct {
+    uint32_t gen;
+    uint8_t depth;
+    size_t ofs;
+    uint32_t node_ofs[SHIM_LITE3_TREE_HEIGHT_MAX + 1];
+    uint64_t lo[SHIM_LITE3_TREE_HEIGHT_MAX + 1];
+    uint64_t hi[SHIM_LITE3_TREE_HEIGHT_MAX + 1];
+} shim_lite3_cursor;
+
+/* Same contract as shim_lite3_get_val_kd / shim_lite3_set_val_kd. The set
+   variant overwrites in place (keeping the path) when the key exists and the
+   new payload fits, and otherwise falls back to shim_lite3_set_val_kd. */
+int shim_lite3_cursor_get_val(const unsigned char *buf, size_t buflen, size_t ofs,
+                              const char *key, uint32_t key_hash, uint32_t key_size,
+                              shim_lite3_cursor *cur, size_t *out_val_ofs);
+int shim_lite3_cursor_set_val(unsigned char *buf, size_t *inout_buflen, size_t ofs, size_t bufsz,
+                              const char *key, uint32_t key_hash, uint32_t key_size,
+                              uint8_t type, size_t payload_len,
+                              shim_lite3_cursor *cur, size_t *out_val_ofs);
+
+/* ---- Buffer API: Write footprints ---- */
+/* Byte ranges that a set of `key` (or, with key == NULL, an array append at
+   index `key_hash`) under the container at `ofs` can modify in place: every
+   node on each probe's descent path, plus the existing key/value entry if
+   the key is present. Everything else a write touches is appended. Writes
+   up to `cap` ranges to out_ofs/out_len and returns their count; fails with
+   ENOBUFS if `cap` is too small. */
+int shim_lite3_write_footprint(const unsigned char *buf, size_t buflen, size_t ofs,
+                               const char *key, uint32_t key_hash, uint32_t key_size,
+                               size_t *out_ofs, size_t *out_len, size_t cap);
+
 /* ---- Buffer API: JSON ---- */
+/* Mirrors of the LITE3_JSON_* option flags in lite3.h. */
+#define SHIM_LITE3_JSON_BYTES_DATA_URI 0x1u
+#define SHIM_LITE3_JSON_PRETTY 0x2u
+
 int shim_lite3_json_dec(unsigned char *buf, size_t *out_buflen, size_t bufsz,
                         const char *json_str, size_t json_len);
 char *shim_lite3_json_enc(const unsigned char *buf, size_t buflen, size_t ofs, size_t *out_len);
 char *shim_lite3_json_enc_pretty(const unsigned char *buf, size_t buflen, size_t ofs, size_t *out_len);
 int64_t shim_lite3_json_enc_buf(const unsigned char *buf, size_t buflen, size_t ofs,
                                 char *json_buf, size_t json_bufsz);
+int shim_lite3_json_dec_opts(unsigned char *buf, size_t *out_buflen, size_t bufsz,
+                             const char *json_str, size_t json_len, unsigned flags);
+char *shim_lite3_json_enc_opts(const unsigned char *buf, size_t buflen, size_t ofs,
+                               unsigned flags, size_t *out_len);
 
 /* ---- Context API ---- */
 typedef struct lite3_ctx lite3_ctx;
@@ -150,6 +239,12 @@ int shim_lite3_ctx_arr_get_type(lite3_ctx *ctx, size_t ofs, uint32_t index);
 int shim_lite3_ctx_count(lite3_ctx *ctx, size_t ofs, uint32_t *out);
 int shim_lite3_ctx_import_from_buf(lite3_ctx *ctx, const unsigned char *buf, size_t buflen);
 int shim_lite3_ctx_json_dec(lite3_ctx *ctx, const char *json_str, size_t json_len);
+int shim_lite3_ctx_json_dec_opts(lite3_ctx *ctx, const char *json_str, size_t json_len, unsigned flags);
+
+/* Context variants of the raw value slot functions; grow the context on ENOBUFS. */
+int shim_lite3_ctx_set_val_kd(lite3_ctx *ctx, size_t ofs, const char *key, uint32_t key_hash, uint32_t key_size,
+                              uint8_t type, size_t payload_len, size_t *out_val_ofs);
+int shim_lite3_ctx_arr_append_val(lite3_ctx *ctx, size_t ofs, uint8_t type, size_t payload_len, size_t *out_val_ofs);
 
 #ifdef __cplusplus
 }
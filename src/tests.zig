@@ -12,6 +12,7 @@
 //   - Interoperability: Buffer → Context import
 
 const std = @import("std");
+const builtin = @import("builtin");
 const testing = std.testing;
 const lite3 = @import("lite3");
 
@@ -397,6 +398,71 @@ test "Buffer: JSON decode from string" {
     try testing.expectEqual(@as(i64, 88), try buf.arrGetI64(scores_ofs, 2));
 }
 
+test "Buffer: JSON encodes bytes as plain base64 by default" {
+    if (!lite3.json_enabled) return;
+
+    var mem: [4096]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+    try buf.setBytes(lite3.root, "b", &.{ 0x00, 0xFF, 0x80 });
+
+    const json = try buf.jsonEncode(lite3.root);
+    defer json.deinit();
+    try testing.expectEqualStrings("{\"b\":\"AP+A\"}", json.slice());
+
+    // Without the data URI option, the base64 string stays a string.
+    var mem2: [4096]u8 align(4) = undefined;
+    var buf2 = try lite3.Buffer.jsonDecodeWithOptions(&mem2, json.slice(), .{});
+    try testing.expectEqual(lite3.Type.string, try buf2.getType(lite3.root, "b"));
+}
+
+test "Buffer: JSON bytes data URI round-trip" {
+    if (!lite3.json_enabled) return;
+
+    // Large enough to exercise the vectorized base64 paths plus a scalar tail.
+    var blob: [301]u8 = undefined;
+    for (&blob, 0..) |*b, i| b.* = @truncate(i *% 131 +% 7);
+
+    var mem: [8192]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+    try buf.setBytes(lite3.root, "blob", &blob);
+    try buf.setBytes(lite3.root, "empty", "");
+    try buf.setStr(lite3.root, "text", "plain");
+    const arr = try buf.setArr(lite3.root, "list");
+    try buf.arrAppendBytes(arr, blob[0..50]);
+
+    const opts: lite3.JsonOptions = .{ .bytes_data_uri = true };
+    const json = try buf.jsonEncodeWithOptions(lite3.root, opts);
+    defer json.deinit();
+
+    var expected: [std.base64.standard.Encoder.calcSize(blob.len)]u8 = undefined;
+    _ = std.base64.standard.Encoder.encode(&expected, &blob);
+    const pos = std.mem.indexOf(u8, json.slice(), &expected) orelse return error.TestUnexpectedResult;
+    try testing.expect(std.mem.endsWith(u8, json.slice()[0..pos], "\"data:;base64,"));
+
+    var mem2: [8192]u8 align(4) = undefined;
+    var buf2 = try lite3.Buffer.jsonDecodeWithOptions(&mem2, json.slice(), opts);
+    try testing.expectEqualSlices(u8, &blob, try buf2.getBytes(lite3.root, "blob"));
+    try testing.expectEqual(@as(usize, 0), (try buf2.getBytes(lite3.root, "empty")).len);
+    try testing.expectEqualStrings("plain", try buf2.getStr(lite3.root, "text"));
+    const arr2 = try buf2.getArr(lite3.root, "list");
+    try testing.expectEqualSlices(u8, blob[0..50], try buf2.arrGetBytes(arr2, 0));
+}
+
+test "Buffer: JSON data URI with invalid base64 is rejected" {
+    if (!lite3.json_enabled) return;
+
+    const bad_len =
+        \\{"b":"data:;base64,AP+"}
+    ;
+    const bad_char =
+        \\{"b":"data:;base64,A!+A"}
+    ;
+    var mem: [4096]u8 align(4) = undefined;
+    const opts: lite3.JsonOptions = .{ .bytes_data_uri = true };
+    try testing.expectError(lite3.Error.InvalidArgument, lite3.Buffer.jsonDecodeWithOptions(&mem, bad_len, opts));
+    try testing.expectError(lite3.Error.InvalidArgument, lite3.Buffer.jsonDecodeWithOptions(&mem, bad_char, opts));
+}
+
 test "Buffer: error on key not found" {
     var mem: [4096]u8 align(4) = undefined;
     var buf = try lite3.Buffer.initObj(&mem);
@@ -649,6 +715,21 @@ test "Context: init with size" {
     try testing.expectEqualStrings("buffer", try ctx.getStr(lite3.root, "big"));
 }
 
+test "Context: capacity grows with the buffer" {
+    var ctx = try lite3.Context.init();
+    defer ctx.deinit();
+
+    try ctx.resetObj();
+    const initial_capacity = ctx.capacity();
+    try testing.expect(initial_capacity >= ctx.data().len);
+    try ctx.setStr(lite3.root, "blob", "x" ** 6000);
+    try testing.expect(ctx.capacity() > initial_capacity);
+    try testing.expect(ctx.capacity() >= ctx.data().len);
+
+    ctx.deinit();
+    try testing.expectEqual(@as(usize, 0), ctx.capacity());
+}
+
 test "Context: init from buffer" {
     // First initialize a buffer
     var mem: [4096]u8 align(4) = undefined;
@@ -702,6 +783,22 @@ test "ManagedContext: grows on NoBufferSpace" {
     try testing.expectEqual(@as(usize, 6000), s.len);
 }
 
+test "ManagedContext: jsonDecodeWithOptions grows for data URI bytes" {
+    if (!lite3.json_enabled) return;
+
+    var mctx = try lite3.ManagedContext.initWithCapacity(testing.allocator, 1024);
+    defer mctx.deinit();
+
+    const blob = [_]u8{0xA5} ** 3000;
+    var b64: [std.base64.standard.Encoder.calcSize(blob.len)]u8 = undefined;
+    _ = std.base64.standard.Encoder.encode(&b64, &blob);
+    const json = try std.fmt.allocPrint(testing.allocator, "{{\"blob\":\"data:;base64,{s}\"}}", .{&b64});
+    defer testing.allocator.free(json);
+
+    try mctx.jsonDecodeWithOptions(json, .{ .bytes_data_uri = true });
+    try testing.expectEqualSlices(u8, &blob, try mctx.getBytes(lite3.root, "blob"));
+}
+
 test "ManagedContext: initFromBuf imports an existing buffer" {
     var mem: [4096]u8 align(4) = undefined;
     var buf = try lite3.Buffer.initObj(&mem);
@@ -1685,3 +1782,1249 @@ test "Fuzz: Context rapid grow/shrink cycle" {
     try ctx.setI64(lite3.root, "final", 999);
     try testing.expectEqual(@as(i64, 999), try ctx.getI64(lite3.root, "final"));
 }
+
+// ---------------------------------------------------------------------------
+// Comptime struct serialization
+// ---------------------------------------------------------------------------
+
+const SerdePoint = struct { x: i32, y: i32 };
+const SerdeKind = enum { alpha, beta, gamma };
+const SerdeRecord = struct {
+    id: u64,
+    name: []const u8,
+    score: f64,
+    active: bool,
+    kind: SerdeKind,
+    nickname: ?[]const u8,
+    parent: ?u32,
+    origin: SerdePoint,
+    digest: [4]u8,
+    corners: [2]SerdePoint,
+};
+
+test "Serialize: nested struct round-trip" {
+    var mctx = try lite3.ManagedContext.init(testing.allocator);
+    defer mctx.deinit();
+
+    const rec = SerdeRecord{
+        .id = 7,
+        .name = "widget",
+        .score = 0.5,
+        .active = true,
+        .kind = .beta,
+        .nickname = null,
+        .parent = 3,
+        .origin = .{ .x = -1, .y = 2 },
+        .digest = .{ 0xDE, 0xAD, 0xBE, 0xEF },
+        .corners = .{ .{ .x = 0, .y = 0 }, .{ .x = 10, .y = 20 } },
+    };
+    try lite3.serialize(SerdeRecord, rec, &mctx);
+
+    // Plain accessors see the same document.
+    try testing.expectEqualStrings("widget", try mctx.getStr(lite3.root, "name"));
+    try testing.expectEqualStrings("beta", try mctx.getStr(lite3.root, "kind"));
+    try testing.expectEqual(lite3.Type.null, try mctx.getType(lite3.root, "nickname"));
+    const origin = try mctx.getObj(lite3.root, "origin");
+    try testing.expectEqual(@as(i64, -1), try mctx.getI64(origin, "x"));
+
+    const out = try lite3.deserialize(SerdeRecord, &mctx, lite3.root);
+    try testing.expectEqual(rec.id, out.id);
+    try testing.expectEqualStrings(rec.name, out.name);
+    try testing.expectEqual(rec.score, out.score);
+    try testing.expectEqual(rec.active, out.active);
+    try testing.expectEqual(rec.kind, out.kind);
+    try testing.expectEqual(@as(?[]const u8, null), out.nickname);
+    try testing.expectEqual(rec.parent, out.parent);
+    try testing.expectEqual(rec.origin, out.origin);
+    try testing.expectEqual(rec.digest, out.digest);
+    try testing.expectEqual(rec.corners, out.corners);
+}
+
+test "Serialize: serializedSize covers padding before node-sized strings" {
+    // 4-byte length + 90 bytes + terminator is exactly node_size - 1, which
+    // lite3 aligns like a node.
+    const Doc = struct { s: []const u8 };
+    const doc = Doc{ .s = "y" ** 90 };
+    var mctx = try lite3.ManagedContext.init(testing.allocator);
+    defer mctx.deinit();
+    try lite3.serialize(Doc, doc, &mctx);
+    try testing.expect(mctx.data().len <= lite3.serializedSize(Doc, doc));
+    try testing.expectEqualStrings(doc.s, (try lite3.deserialize(Doc, &mctx, lite3.root)).s);
+}
+
+test "Serialize: deserialize rejects a string with a zero length prefix" {
+    const Doc = struct { name: []const u8 };
+    var mem: [1024]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+    try buf.setStr(lite3.root, "name", "hello");
+    const at = std.mem.indexOf(u8, mem[0..buf.len], "hello\x00").?;
+    std.mem.writeInt(u32, mem[at - 4 ..][0..4], 0, .little);
+    try testing.expectError(error.CorruptData, lite3.deserialize(Doc, &buf, lite3.root));
+}
+
+test "Serialize: serializedSize reserves enough to avoid growth" {
+    const Doc = struct {
+        title: []const u8,
+        values: []const i64,
+        tags: []const []const u8,
+    };
+    var values: [64]i64 = undefined;
+    for (&values, 0..) |*v, i| v.* = @as(i64, @intCast(i)) * 1000;
+    const doc = Doc{
+        .title = "x" ** 300,
+        .values = &values,
+        .tags = &.{ "a", "bb", "ccc" },
+    };
+
+    var mctx = try lite3.ManagedContext.init(testing.allocator);
+    defer mctx.deinit();
+    try lite3.serialize(Doc, doc, &mctx);
+    try testing.expect(mctx.data().len <= lite3.serializedSize(Doc, doc));
+
+    // Capacity was reserved up front: re-serializing does not reallocate.
+    const cap = mctx.capacity();
+    try lite3.serialize(Doc, doc, &mctx);
+    try testing.expectEqual(cap, mctx.capacity());
+
+    var arena = std.heap.ArenaAllocator.init(testing.allocator);
+    defer arena.deinit();
+    const out = try lite3.deserializeAlloc(Doc, arena.allocator(), &mctx, lite3.root);
+    try testing.expectEqualStrings(doc.title, out.title);
+    try testing.expectEqualSlices(i64, doc.values, out.values);
+    try testing.expectEqual(@as(usize, 3), out.tags.len);
+    try testing.expectEqualStrings("ccc", out.tags[2]);
+}
+
+test "Serialize: missing keys use defaults and optionals" {
+    var mem: [1024]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+    try buf.setI64(lite3.root, "a", 5);
+
+    const Partial = struct { a: i16, b: i64 = 9, c: ?bool };
+    const out = try lite3.deserialize(Partial, &buf, lite3.root);
+    try testing.expectEqual(@as(i16, 5), out.a);
+    try testing.expectEqual(@as(i64, 9), out.b);
+    try testing.expectEqual(@as(?bool, null), out.c);
+
+    const Required = struct { a: i64, d: i64 };
+    try testing.expectError(lite3.Error.NotFound, lite3.deserialize(Required, &buf, lite3.root));
+}
+
+test "Serialize: type and range mismatches return InvalidArgument" {
+    var mem: [1024]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+    try buf.setI64(lite3.root, "n", 1000);
+    try buf.setStr(lite3.root, "k", "delta");
+
+    try testing.expectError(lite3.Error.InvalidArgument, lite3.deserialize(struct { n: u8 }, &buf, lite3.root));
+    try testing.expectError(lite3.Error.InvalidArgument, lite3.deserialize(struct { n: bool }, &buf, lite3.root));
+    try testing.expectError(lite3.Error.InvalidArgument, lite3.deserialize(struct { k: SerdeKind }, &buf, lite3.root));
+
+    var mctx = try lite3.ManagedContext.init(testing.allocator);
+    defer mctx.deinit();
+    try testing.expectError(lite3.Error.InvalidArgument, lite3.serialize(struct { big: u64 }, .{ .big = std.math.maxInt(u64) }, &mctx));
+}
+
+test "View: cached field access and invalidation on growth" {
+    var mctx = try lite3.ManagedContext.init(testing.allocator);
+    defer mctx.deinit();
+    const Order = struct { id: u32, price: f64, sym: []const u8, note: ?[]const u8 = null, at: SerdePoint };
+    try lite3.serialize(Order, .{ .id = 1, .price = 9.5, .sym = "ABC", .at = .{ .x = 3, .y = 4 } }, &mctx);
+
+    var v = lite3.View(Order).init(&mctx, lite3.root);
+    try testing.expectEqual(@as(f64, 9.5), try v.get(.price));
+    const price_ofs = try v.offsetOf(.price);
+    try testing.expectEqual(price_ofs, try v.offsetOf(.price));
+    try testing.expectEqualStrings("ABC", try v.get(.sym));
+    try testing.expectEqual(@as(?[]const u8, null), try v.get(.note));
+
+    // Same-size overwrite stays in place; the write bumps the generation.
+    try mctx.setF64(lite3.root, "price", 10.25);
+    try testing.expectEqual(@as(f64, 10.25), try v.get(.price));
+
+    // A longer string relocates the value and changes the length.
+    try mctx.setStr(lite3.root, "sym", "a much longer symbol");
+    try testing.expectEqualStrings("a much longer symbol", try v.get(.sym));
+
+    var at = try v.child(.at);
+    try testing.expectEqual(@as(i32, 4), try at.get(.y));
+}
+
+test "View: same-length rebuild does not reuse stale offsets" {
+    var mem: [1024]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+    try buf.setI64(lite3.root, "a", 1);
+    try buf.setI64(lite3.root, "b", 2);
+
+    const Pair = struct { a: i64, b: i64 };
+    var v = lite3.View(Pair).init(&buf, lite3.root);
+    try testing.expectEqual(@as(i64, 1), try v.get(.a));
+    try testing.expectEqual(@as(i64, 2), try v.get(.b));
+
+    // Same length and generation, but the keys trade places.
+    const len = buf.len;
+    buf = try lite3.Buffer.initObj(&mem);
+    try buf.setI64(lite3.root, "b", 20);
+    try buf.setI64(lite3.root, "a", 10);
+    try testing.expectEqual(len, buf.len);
+    try testing.expectEqual(@as(i64, 10), try v.get(.a));
+    try testing.expectEqual(@as(i64, 20), try v.get(.b));
+
+    // A rebuild without the key reports it missing.
+    buf = try lite3.Buffer.initObj(&mem);
+    try buf.setI64(lite3.root, "c", 3);
+    try buf.setI64(lite3.root, "d", 4);
+    try testing.expectEqual(len, buf.len);
+    try testing.expectError(lite3.Error.NotFound, v.get(.a));
+}
+
+test "InlineCache: hits across documents of the same shape" {
+    var mem: [8192]u8 align(4) = undefined;
+    var ic: lite3.InlineCache("k29") = .{};
+    var shape0: u64 = 0;
+
+    for (0..20) |doc| {
+        var buf = try lite3.Buffer.initObj(&mem);
+        for (0..40) |k| {
+            var key_buf: [8]u8 = undefined;
+            const key = std.fmt.bufPrint(&key_buf, "k{d}", .{k}) catch unreachable;
+            try buf.setI64(lite3.root, key, @intCast(doc * 100 + k));
+        }
+        const s = try lite3.shape(&buf, lite3.root);
+        if (doc == 0) shape0 = s else try testing.expectEqual(shape0, s);
+        try testing.expectEqual(@as(i64, @intCast(doc * 100 + 29)), try ic.get(i64, &buf, lite3.root));
+    }
+    try testing.expectEqual(@as(u64, 1), ic.misses);
+    try testing.expectEqual(@as(u64, 19), ic.hits);
+
+    // A differently shaped document still resolves correctly via a miss.
+    var buf = try lite3.Buffer.initObj(&mem);
+    try buf.setI64(lite3.root, "k29", -1);
+    try testing.expect(try lite3.shape(&buf, lite3.root) != shape0);
+    try testing.expectEqual(@as(i64, -1), try ic.get(i64, &buf, lite3.root));
+    try testing.expectEqual(@as(u64, 2), ic.misses);
+
+    buf = try lite3.Buffer.initObj(&mem);
+    try testing.expectError(lite3.Error.NotFound, ic.get(i64, &buf, lite3.root));
+}
+
+test "Cursor: sibling updates reuse the path and match plain accessors" {
+    var mctx = try lite3.ManagedContext.init(testing.allocator);
+    defer mctx.deinit();
+    const obj = try mctx.setObj(lite3.root, "deep");
+    for (0..64) |k| {
+        var key_buf: [8]u8 = undefined;
+        const key = std.fmt.bufPrint(&key_buf, "f{d}", .{k}) catch unreachable;
+        try mctx.setI64(obj, key, 0);
+    }
+
+    var cur = lite3.Cursor.init(obj);
+    const len_before = mctx.data().len;
+    for (0..64) |k| {
+        var key_buf: [8]u8 = undefined;
+        const key = std.fmt.bufPrint(&key_buf, "f{d}", .{k}) catch unreachable;
+        try cur.setI64(&mctx, key, @intCast(k * 3));
+    }
+    // Every write fit in place.
+    try testing.expectEqual(len_before, mctx.data().len);
+    try testing.expectEqual(@as(i64, 30), try mctx.getI64(obj, "f10"));
+    try testing.expectEqual(@as(i64, 189), try cur.get(i64, &mctx, "f63"));
+
+    // New keys and growing values fall back to a normal set.
+    try cur.setStr(&mctx, "f1", "now a string that does not fit");
+    try cur.setF64(&mctx, "extra", 1.5);
+    try cur.setBool(&mctx, "f2", true);
+    try testing.expectEqualStrings("now a string that does not fit", try mctx.getStr(obj, "f1"));
+    try testing.expectEqual(@as(f64, 1.5), try cur.get(f64, &mctx, "extra"));
+    try testing.expectEqual(true, try mctx.getBool(obj, "f2"));
+
+    // Mutations made without the cursor are picked up as well.
+    try mctx.setI64(obj, "f5", -5);
+    try testing.expectEqual(@as(i64, -5), try cur.get(i64, &mctx, "f5"));
+    try testing.expectError(lite3.Error.NotFound, cur.get(i64, &mctx, "missing"));
+}
+
+test "Cursor: shrinking in-place write matches a plain set byte for byte" {
+    var plain = try lite3.ManagedContext.init(testing.allocator);
+    defer plain.deinit();
+    try plain.setStr(lite3.root, "note", "a fairly long original value");
+    var cursored = try lite3.ManagedContext.initFromBuf(testing.allocator, plain.data());
+    defer cursored.deinit();
+
+    try plain.setStr(lite3.root, "note", "short");
+    var cur = lite3.Cursor.init(lite3.root);
+    try cur.setStr(&cursored, "note", "short");
+    // The tail of the old string must not survive in the message.
+    try testing.expectEqualSlices(u8, plain.data(), cursored.data());
+    try testing.expect(std.mem.indexOf(u8, cursored.data(), "original") == null);
+}
+
+test "ConstView: reads unaligned bytes like Buffer" {
+    var mem: [8192]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+    try buf.setStr(lite3.root, "route", "eu-west");
+    try buf.setBool(lite3.root, "ok", true);
+    try buf.setF64(lite3.root, "w", 0.25);
+    try buf.setNull(lite3.root, "nothing");
+    try buf.setBytes(lite3.root, "blob", &[_]u8{ 1, 2, 3 });
+    for (0..40) |k| {
+        var key_buf: [8]u8 = undefined;
+        const key = std.fmt.bufPrint(&key_buf, "n{d}", .{k}) catch unreachable;
+        try buf.setI64(lite3.root, key, @intCast(k));
+    }
+    const arr = try buf.setArr(lite3.root, "list");
+    for (0..20) |i| try buf.arrAppendI64(arr, @intCast(i * i));
+    try buf.arrAppendStr(arr, "tail");
+    const nested = try buf.arrAppendObj(arr);
+    try buf.setI64(nested, "depth", 2);
+
+    // Place the message at an odd offset, as after a 3-byte frame header.
+    var frame: [8192 + 3]u8 = undefined;
+    const msg = frame[3..][0..buf.data().len];
+    @memcpy(msg, buf.data());
+    const view = try lite3.ConstView.init(msg);
+
+    try testing.expectEqual(lite3.Type.object, try view.rootType());
+    try testing.expectEqualStrings("eu-west", try view.getStr(lite3.root, "route"));
+    try testing.expectEqual(true, try view.getBool(lite3.root, "ok"));
+    try testing.expectEqual(@as(f64, 0.25), try view.getF64(lite3.root, "w"));
+    try testing.expectEqual(lite3.Type.null, try view.getType(lite3.root, "nothing"));
+    try testing.expectEqualSlices(u8, &[_]u8{ 1, 2, 3 }, try view.getBytes(lite3.root, "blob"));
+    try testing.expectEqual(@as(i64, 39), try view.getI64(lite3.root, "n39"));
+    try testing.expectEqual(false, try view.exists(lite3.root, "missing"));
+    try testing.expectError(lite3.Error.NotFound, view.getI64(lite3.root, "missing"));
+    try testing.expectError(lite3.Error.InvalidArgument, view.getI64(lite3.root, "route"));
+
+    const varr = try view.getArr(lite3.root, "list");
+    try testing.expectEqual(arr, varr);
+    try testing.expectEqual(try buf.count(arr), try view.count(varr));
+    try testing.expectEqual(@as(i64, 361), try view.arrGetI64(varr, 19));
+    try testing.expectEqualStrings("tail", try view.arrGetStr(varr, 20));
+    const vnested = try view.arrGetObj(varr, 21);
+    try testing.expectEqual(@as(i64, 2), try view.getI64(vnested, "depth"));
+    try testing.expectError(lite3.Error.InvalidArgument, view.arrGetI64(varr, 22));
+
+    // Iteration yields the same entries in the same order as Buffer.iterate.
+    var it = try buf.iterate(lite3.root);
+    var vit = try view.iterate(lite3.root);
+    var n: usize = 0;
+    while (try it.next()) |e| : (n += 1) {
+        const ve = (try vit.next()).?;
+        try testing.expectEqualStrings(e.key.?, ve.key.?);
+        try testing.expectEqual(e.val_offset, ve.val_offset);
+    }
+    try testing.expectEqual(@as(?lite3.Iterator.Entry, null), try vit.next());
+    try testing.expectEqual(@as(usize, try buf.count(lite3.root)), n);
+}
+
+test "shape: aliased child offsets hit the node budget" {
+    // Ten nodes, each with all eight children pointing at the next: within
+    // the depth limit, but 8^9 leaf visits without a total node budget.
+    const n = 10;
+    var mem: [n * 96]u8 align(4) = @splat(0);
+    for (0..n) |k| {
+        const node = mem[k * 96 ..][0..96];
+        node[0] = @intFromEnum(lite3.Type.object);
+        if (k + 1 == n) continue;
+        std.mem.writeInt(u32, node[32..36], 7, .little); // key count
+        for (0..8) |i| std.mem.writeInt(u32, node[64 + 4 * i ..][0..4], @intCast((k + 1) * 96), .little);
+    }
+    var buf = lite3.Buffer{ .buf = &mem, .len = mem.len, .capacity = mem.len };
+    try testing.expectError(lite3.Error.CorruptData, lite3.shape(&buf, lite3.root));
+}
+
+test "ConstView: treeStats reports the B-tree shape" {
+    var mem: [65536]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+    var view = try lite3.ConstView.init(buf.data());
+    var stats = try view.treeStats(lite3.root);
+    try testing.expectEqual(@as(u32, 1), stats.height);
+    try testing.expectEqual(@as(u32, 0), stats.entries);
+
+    var key: [8]u8 = undefined;
+    for (0..200) |i| try buf.setI64(lite3.root, try std.fmt.bufPrint(&key, "k{d}", .{i}), @intCast(i));
+    view = try lite3.ConstView.init(buf.data());
+    stats = try view.treeStats(lite3.root);
+    try testing.expectEqual(@as(u32, 200), stats.entries);
+    try testing.expect(stats.height >= 3 and stats.nodes >= 200 / 7);
+    try testing.expect(stats.fill() > 0.3 and stats.fill() <= 1.0);
+}
+
+test "ConstView: rejects truncated input" {
+    var mem: [1024]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+    try buf.setStr(lite3.root, "k", "a fairly long string value");
+    try testing.expectError(lite3.Error.InvalidArgument, lite3.ConstView.init(buf.data()[0..50]));
+    const view = try lite3.ConstView.init(buf.data()[0 .. buf.data().len - 4]);
+    try testing.expectError(lite3.Error.CorruptData, view.getStr(lite3.root, "k"));
+}
+
+test "Buffer: setBytesReserve and setStrReserve fill in place" {
+    var mem: [1024]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+
+    const dst = try buf.setBytesReserve(lite3.root, "payload", 5);
+    @memcpy(dst, &[_]u8{ 9, 8, 7, 6, 5 });
+    try testing.expectEqualSlices(u8, &[_]u8{ 9, 8, 7, 6, 5 }, try buf.getBytes(lite3.root, "payload"));
+
+    const s = try buf.setStrReserve(lite3.root, "name", 3);
+    @memcpy(s, "abc");
+    try testing.expectEqualStrings("abc", try buf.getStr(lite3.root, "name"));
+
+    const arr = try buf.setArr(lite3.root, "chunks");
+    @memcpy(try buf.arrAppendBytesReserve(arr, 2), "xy");
+    @memcpy(try buf.arrAppendStrReserve(arr, 4), "zzzz");
+    try testing.expectEqualSlices(u8, "xy", try buf.arrGetBytes(arr, 0));
+    try testing.expectEqualStrings("zzzz", try buf.arrGetStr(arr, 1));
+
+    const len_before = buf.len;
+    try testing.expectError(lite3.Error.NoBufferSpace, buf.setBytesReserve(lite3.root, "huge", 4096));
+    try testing.expectEqual(len_before, buf.len);
+}
+
+test "ManagedContext: setBytesReserve grows and Context matches" {
+    var mctx = try lite3.ManagedContext.init(testing.allocator);
+    defer mctx.deinit();
+    const big = try mctx.setBytesReserve(lite3.root, "big", 10_000);
+    for (big, 0..) |*b, i| b.* = @truncate(i);
+    const got = try mctx.getBytes(lite3.root, "big");
+    try testing.expectEqual(@as(usize, 10_000), got.len);
+    try testing.expectEqual(@as(u8, @truncate(9_999)), got[9_999]);
+
+    var ctx = try lite3.Context.init();
+    defer ctx.deinit();
+    try ctx.resetObj();
+    const s = try ctx.setStrReserve(lite3.root, "s", 5000);
+    @memset(s, 'q');
+    const out = try ctx.getStr(lite3.root, "s");
+    try testing.expectEqual(@as(usize, 5000), out.len);
+    try testing.expectEqual(@as(u8, 'q'), out[4999]);
+}
+
+test "ExternalBlobs: gathered iovecs equal an ordinary message" {
+    const blob_a = "A" ** 3000;
+    const blob_b = [_]u8{ 0xAB, 0xCD } ** 700;
+
+    var mctx = try lite3.ManagedContext.init(testing.allocator);
+    defer mctx.deinit();
+    var ext: lite3.ExternalBlobs = .{};
+    defer ext.deinit(testing.allocator);
+    try mctx.setStr(lite3.root, "type", "upload");
+    try ext.setBytes(testing.allocator, &mctx, lite3.root, "file", blob_a.len, 0);
+    const parts = try mctx.setArr(lite3.root, "parts");
+    try ext.arrAppendBytes(testing.allocator, &mctx, parts, blob_b.len, 1);
+    try mctx.setI64(lite3.root, "n", 2);
+
+    var plain = try lite3.ManagedContext.init(testing.allocator);
+    defer plain.deinit();
+    try plain.setStr(lite3.root, "type", "upload");
+    try plain.setBytes(lite3.root, "file", blob_a);
+    const plain_parts = try plain.setArr(lite3.root, "parts");
+    try plain.arrAppendBytes(plain_parts, &blob_b);
+    try plain.setI64(lite3.root, "n", 2);
+
+    const blobs = [_][]const u8{ blob_a, &blob_b };
+    const iov = try ext.gather(testing.allocator, mctx.data(), &blobs);
+    defer testing.allocator.free(iov);
+    try testing.expectEqual(@as(usize, 5), iov.len);
+
+    var wire: std.ArrayListUnmanaged(u8) = .empty;
+    defer wire.deinit(testing.allocator);
+    for (iov) |v| try wire.appendSlice(testing.allocator, v.base[0..v.len]);
+    try testing.expectEqualSlices(u8, plain.data(), wire.items);
+
+    // Mismatched blob length is rejected.
+    const bad = [_][]const u8{ blob_a[1..], &blob_b };
+    try testing.expectError(lite3.Error.InvalidArgument, ext.gather(testing.allocator, mctx.data(), &bad));
+}
+
+test "ExternalBlobs: overwritten reference is sent as zeros" {
+    var mem: [4096]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+    var ext: lite3.ExternalBlobs = .{};
+    defer ext.deinit(testing.allocator);
+    try ext.setBytes(testing.allocator, &buf, lite3.root, "f", 64, 0);
+    try buf.setBytes(lite3.root, "f", "x" ** 100); // too large to overwrite in place
+
+    const blobs = [_][]const u8{"y" ** 64};
+    const iov = try ext.gather(testing.allocator, buf.data(), &blobs);
+    defer testing.allocator.free(iov);
+    for (iov) |v| try testing.expect(std.mem.indexOfScalar(u8, v.base[0..v.len], 'y') == null);
+}
+
+test "ExternalBlobs: shorter in-place overwrite keeps the new value" {
+    var mem: [4096]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+    var ext: lite3.ExternalBlobs = .{};
+    defer ext.deinit(testing.allocator);
+    try ext.setBytes(testing.allocator, &buf, lite3.root, "f", 64, 0);
+    try buf.setBytes(lite3.root, "f", "z" ** 10); // fits, so lite3 overwrites in place
+    try buf.setI64(lite3.root, "n", 7);
+
+    const blobs = [_][]const u8{"y" ** 64};
+    const iov = try ext.gather(testing.allocator, buf.data(), &blobs);
+    defer testing.allocator.free(iov);
+    var wire: std.ArrayListUnmanaged(u8) = .empty;
+    defer wire.deinit(testing.allocator);
+    for (iov) |v| try wire.appendSlice(testing.allocator, v.base[0..v.len]);
+
+    try testing.expectEqual(buf.data().len, wire.items.len);
+    try testing.expect(std.mem.indexOfScalar(u8, wire.items, 'y') == null);
+    const wire_mem = try testing.allocator.alignedAlloc(u8, .@"4", wire.items.len);
+    defer testing.allocator.free(wire_mem);
+    @memcpy(wire_mem, wire.items);
+    const view = try lite3.ConstView.init(wire_mem);
+    try testing.expectEqualSlices(u8, "z" ** 10, try view.getBytes(lite3.root, "f"));
+    try testing.expectEqual(@as(i64, 7), try view.getI64(lite3.root, "n"));
+}
+
+test "ExternalBlobs: re-reserving a key replaces the earlier reservation" {
+    var mem: [4096]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+    var ext: lite3.ExternalBlobs = .{};
+    defer ext.deinit(testing.allocator);
+    try ext.setBytes(testing.allocator, &buf, lite3.root, "att", 100, 0);
+    try ext.setBytes(testing.allocator, &buf, lite3.root, "att", 40, 1); // in place, same payload offset
+
+    const blobs = [_][]const u8{ "x" ** 100, "n" ** 40 };
+    const iov = try ext.gather(testing.allocator, buf.data(), &blobs);
+    defer testing.allocator.free(iov);
+    var wire: std.ArrayListUnmanaged(u8) = .empty;
+    defer wire.deinit(testing.allocator);
+    for (iov) |v| try wire.appendSlice(testing.allocator, v.base[0..v.len]);
+
+    try testing.expectEqual(buf.data().len, wire.items.len);
+    try testing.expect(std.mem.indexOfScalar(u8, wire.items, 'x') == null);
+    const wire_mem = try testing.allocator.alignedAlloc(u8, .@"4", wire.items.len);
+    defer testing.allocator.free(wire_mem);
+    @memcpy(wire_mem, wire.items);
+    const view = try lite3.ConstView.init(wire_mem);
+    try testing.expectEqualSlices(u8, "n" ** 40, try view.getBytes(lite3.root, "att"));
+}
+
+test "Slack: rewrites within capacity stay in place" {
+    var mem: [4096]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+    var slack: lite3.Slack = .{ .policy = .{ .round_up = 32 } };
+    defer slack.deinit(testing.allocator);
+
+    try slack.setStr(testing.allocator, &buf, lite3.root, "status", "idle");
+    const len = buf.data().len;
+    for ([_][]const u8{ "running", "waiting on io", "done", "" }) |s| {
+        try slack.setStr(testing.allocator, &buf, lite3.root, "status", s);
+        try testing.expectEqual(len, buf.data().len);
+        try testing.expectEqualStrings(s, try buf.getStr(lite3.root, "status"));
+    }
+
+    // Shrinking rewrites leave no trace of the longer value in the slack.
+    const at = std.mem.indexOf(u8, buf.data(), "status\x00").? + "status\x00".len;
+    try testing.expectEqual(@as(u8, @intFromEnum(lite3.Type.string)), mem[at]);
+    try testing.expect(std.mem.allEqual(u8, mem[at + 1 + 4 + 1 .. at + 1 + 32], 0));
+
+    // Outgrowing the slot moves it; the new slot is tracked again.
+    try slack.setStr(testing.allocator, &buf, lite3.root, "status", "x" ** 40);
+    try testing.expect(buf.data().len > len);
+    const grown = buf.data().len;
+    try slack.setStr(testing.allocator, &buf, lite3.root, "status", "short");
+    try testing.expectEqual(grown, buf.data().len);
+    try testing.expectEqualStrings("short", try buf.getStr(lite3.root, "status"));
+}
+
+test "Slack: ManagedContext bytes with explicit capacity" {
+    var mctx = try lite3.ManagedContext.init(testing.allocator);
+    defer mctx.deinit();
+    var slack: lite3.Slack = .{ .policy = .none };
+    defer slack.deinit(testing.allocator);
+
+    try slack.setBytesWithCapacity(testing.allocator, &mctx, lite3.root, "blob", "ab", 256);
+    const len = mctx.data().len;
+    try slack.setBytes(testing.allocator, &mctx, lite3.root, "blob", &([_]u8{7} ** 200));
+    try testing.expectEqual(len, mctx.data().len);
+    try testing.expectEqualSlices(u8, &([_]u8{7} ** 200), try mctx.getBytes(lite3.root, "blob"));
+}
+
+test "MappedDocument: lookups over a file mapping" {
+    var mctx = try lite3.ManagedContext.init(testing.allocator);
+    defer mctx.deinit();
+    try mctx.setStr(lite3.root, "name", "snapshot-7");
+    const items = try mctx.setArr(lite3.root, "items");
+    for (0..100) |i| try mctx.arrAppendI64(items, @intCast(i * i));
+
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+    try tmp.dir.writeFile(.{ .sub_path = "snap.lite3", .data = mctx.data() });
+
+    var doc = try lite3.MappedDocument.openAt(tmp.dir, "snap.lite3");
+    defer doc.close();
+    try doc.validate();
+    try testing.expectEqualSlices(u8, mctx.data(), doc.data());
+    try testing.expectEqualStrings("snapshot-7", try doc.view.getStr(lite3.root, "name"));
+    const arr = try doc.view.getArr(lite3.root, "items");
+    try testing.expectEqual(@as(u32, 100), try doc.view.count(arr));
+    try testing.expectEqual(@as(i64, 81 * 81), try doc.view.arrGetI64(arr, 81));
+    doc.willNeed(0, doc.data().len);
+
+    // Files too short to hold a root node are rejected before mapping.
+    try tmp.dir.writeFile(.{ .sub_path = "short.lite3", .data = "x" });
+    try testing.expectError(lite3.Error.InvalidArgument, lite3.MappedDocument.openAt(tmp.dir, "short.lite3"));
+    // So are files whose first byte is not an object or array root.
+    try tmp.dir.writeFile(.{ .sub_path = "foreign.bin", .data = &([_]u8{0xAB} ** 512) });
+    try testing.expectError(lite3.Error.InvalidArgument, lite3.MappedDocument.openAt(tmp.dir, "foreign.bin"));
+}
+
+test "PersistentDocument: synced state survives reopen and growth" {
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    {
+        var doc = try lite3.PersistentDocument.openAt(tmp.dir, "tenant.lite3");
+        defer doc.close();
+        try doc.setStr(lite3.root, "plan", "pro");
+        const flags = try doc.setArr(lite3.root, "flags");
+        // Enough entries to grow the file past its initial size.
+        for (0..500) |i| try doc.arrAppendI64(flags, @intCast(i));
+        try doc.setI64(lite3.root, "seats", 12);
+        try doc.sync();
+        try doc.setI64(lite3.root, "seats", 14); // in-place update, then synced
+        try doc.sync();
+    }
+
+    var doc = try lite3.PersistentDocument.openAt(tmp.dir, "tenant.lite3");
+    defer doc.close();
+    const buf = doc.buffer();
+    try testing.expectEqualStrings("pro", try buf.getStr(lite3.root, "plan"));
+    try testing.expectEqual(@as(i64, 14), try buf.getI64(lite3.root, "seats"));
+    const flags = try buf.getArr(lite3.root, "flags");
+    try testing.expectEqual(@as(u32, 500), try buf.count(flags));
+    try testing.expectEqual(@as(i64, 499), try buf.arrGetI64(flags, 499));
+}
+
+test "PersistentDocument: unsynced writes roll back on reopen" {
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    {
+        var doc = try lite3.PersistentDocument.openAt(tmp.dir, "tenant.lite3");
+        defer doc.close();
+        try doc.setStr(lite3.root, "plan", "pro");
+        try doc.setI64(lite3.root, "seats", 12);
+        try doc.sync();
+        // The shared mapping puts these in the file immediately, as if the
+        // kernel wrote the pages back just before a crash. No sync follows.
+        try doc.setI64(lite3.root, "seats", 99);
+        try doc.setStr(lite3.root, "plan", "ent");
+        try doc.setStr(lite3.root, "region", "eu");
+    }
+
+    var stale_buf: [4096]u8 = undefined;
+    var stale: []const u8 = undefined;
+    {
+        var doc = try lite3.PersistentDocument.openAt(tmp.dir, "tenant.lite3");
+        defer doc.close();
+        const buf = doc.buffer();
+        try testing.expectEqual(@as(i64, 12), try buf.getI64(lite3.root, "seats"));
+        try testing.expectEqualStrings("pro", try buf.getStr(lite3.root, "plan"));
+        try testing.expectError(lite3.Error.NotFound, buf.getStr(lite3.root, "region"));
+
+        // Crash after the header commit but before the journal reset: the
+        // leftover journal belongs to the previous epoch and is ignored.
+        try doc.setI64(lite3.root, "seats", 14);
+        stale = try tmp.dir.readFile("tenant.lite3-journal", &stale_buf);
+        try doc.sync();
+    }
+    try tmp.dir.writeFile(.{ .sub_path = "tenant.lite3-journal", .data = stale });
+
+    var doc = try lite3.PersistentDocument.openAt(tmp.dir, "tenant.lite3");
+    defer doc.close();
+    try testing.expectEqual(@as(i64, 14), try doc.buffer().getI64(lite3.root, "seats"));
+}
+
+test "PersistentDocument: rejects foreign files" {
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+    try tmp.dir.writeFile(.{ .sub_path = "other.bin", .data = &([_]u8{0xAB} ** 512) });
+    try testing.expectError(lite3.Error.CorruptData, lite3.PersistentDocument.openAt(tmp.dir, "other.bin"));
+}
+
+test "crc32c: known vector, combine and incremental blocks" {
+    try testing.expectEqual(@as(u32, 0xe3069283), lite3.crc32c.checksum("123456789"));
+    try testing.expectEqual(@as(u32, 0), lite3.crc32c.checksum(""));
+
+    var bytes: [3 * 4096 + 777]u8 = undefined;
+    for (&bytes, 0..) |*b, i| b.* = @truncate(i *% 2654435761 >> 13);
+    const whole = lite3.crc32c.checksum(&bytes);
+    try testing.expectEqual(whole, lite3.crc32c.update(lite3.crc32c.checksum(bytes[0..5000]), bytes[5000..]));
+    try testing.expectEqual(whole, lite3.crc32c.combine(
+        lite3.crc32c.checksum(bytes[0..5000]),
+        lite3.crc32c.checksum(bytes[5000..]),
+        bytes.len - 5000,
+    ));
+
+    var inc: lite3.crc32c.Incremental = .{};
+    defer inc.deinit(testing.allocator);
+    try testing.expectEqual(lite3.crc32c.checksum(bytes[0..6000]), try inc.checksum(testing.allocator, bytes[0..6000]));
+    try testing.expectEqual(whole, try inc.checksum(testing.allocator, &bytes));
+    bytes[4100] ^= 0xff;
+    inc.invalidate(4100, 1);
+    try testing.expectEqual(lite3.crc32c.checksum(&bytes), try inc.checksum(testing.allocator, &bytes));
+}
+
+test "crc32c: three-stream rounds match short updates" {
+    const bytes = try testing.allocator.alloc(u8, 5 * 3 * 4096 + 13);
+    defer testing.allocator.free(bytes);
+    for (bytes, 0..) |*b, i| b.* = @truncate(i *% 2246822519 >> 11);
+    // Unaligned start; pieces shorter than a round take the single-chain path.
+    const data = bytes[3..];
+    var crc: u32 = 0;
+    var p = data;
+    while (p.len != 0) {
+        const n = @min(p.len, 1000);
+        crc = lite3.crc32c.update(crc, p[0..n]);
+        p = p[n..];
+    }
+    try testing.expectEqual(crc, lite3.crc32c.checksum(data));
+    try testing.expectEqual(crc, lite3.crc32c.update(lite3.crc32c.checksum(data[0..7]), data[7..]));
+}
+
+test "lz: round trips and rejects malformed input" {
+    var mem: [8192]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initArr(&mem);
+    for (0..40) |i| {
+        const rec = try buf.arrAppendObj(lite3.root);
+        try buf.setI64(rec, "id", @intCast(i));
+        try buf.setStr(rec, "kind", "sensor");
+    }
+    var packed_mem: [8192 + 64]u8 = undefined;
+    var out: [8192]u8 = undefined;
+    for ([_][]const u8{ "", "a", "abcabcabcabcabcabc", buf.data() }) |input| {
+        const n = try lite3.lz.compress(&packed_mem, input);
+        try testing.expect(n <= lite3.lz.compressBound(input.len));
+        try testing.expectEqual(input.len, try lite3.lz.decompress(&out, packed_mem[0..n]));
+        try testing.expectEqualSlices(u8, input, out[0..input.len]);
+    }
+    const n = try lite3.lz.compress(&packed_mem, buf.data());
+    try testing.expect(n * 2 < buf.data().len);
+
+    try testing.expectError(lite3.Error.NoBufferSpace, lite3.lz.compress(packed_mem[0..8], buf.data()));
+    try testing.expectError(lite3.Error.CorruptData, lite3.lz.decompress(out[0..100], packed_mem[0..n]));
+    try testing.expectError(lite3.Error.CorruptData, lite3.lz.decompress(&out, packed_mem[0 .. n - 1]));
+    // A match reaching back before the start of the output.
+    try testing.expectError(lite3.Error.CorruptData, lite3.lz.decompress(&out, &[_]u8{ 0x10, 'x', 5, 0 }));
+}
+
+test "PackWriter/PackReader: indexed access and parallel iteration" {
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const n = 300;
+    {
+        const file = try tmp.dir.createFile("msgs.l3pk", .{});
+        defer file.close();
+        var w = try lite3.PackWriter.init(testing.allocator, file, .{ .key_hashes = true });
+        defer w.deinit();
+        var mem: [512]u8 align(4) = undefined;
+        for (0..n) |i| {
+            var buf = try lite3.Buffer.initObj(&mem);
+            try buf.setI64(lite3.root, "seq", @intCast(i));
+            // Odd-length strings leave messages at non-multiple-of-4 sizes.
+            try buf.setStr(lite3.root, "pad", "abc"[0 .. i % 3]);
+            var key: [16]u8 = undefined;
+            try w.appendKeyed(buf.data(), try std.fmt.bufPrint(&key, "k{d}", .{i}));
+        }
+        try w.finish();
+        try testing.expectEqual(@as(usize, n), w.count());
+    }
+
+    var r = try lite3.PackReader.openAt(tmp.dir, "msgs.l3pk");
+    defer r.close();
+    try testing.expectEqual(@as(usize, n), r.len());
+    const v = try r.view(123);
+    try testing.expectEqual(@as(i64, 123), try v.getI64(lite3.root, "seq"));
+    try testing.expectEqual(@as(usize, 0), @intFromPtr((try r.bytes(7)).ptr) % 4);
+    try testing.expectError(lite3.Error.NotFound, r.view(n));
+    try testing.expectEqual(@as(?usize, 42), r.indexOfKey("k42", 0));
+    try testing.expectError(lite3.Error.InvalidArgument, r.verify(0));
+
+    const Sum = struct {
+        total: std.atomic.Value(i64) = .init(0),
+        fn add(self: *@This(), _: usize, view: lite3.ConstView) void {
+            _ = self.total.fetchAdd(view.getI64(lite3.root, "seq") catch 0, .monotonic);
+        }
+    };
+    var sum: Sum = .{};
+    try r.parallelEach(4, &sum, Sum.add);
+    try testing.expectEqual(@as(i64, n * (n - 1) / 2), sum.total.load(.monotonic));
+}
+
+test "PackReader: verify against the stored checksums" {
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+    {
+        const file = try tmp.dir.createFile("sums.l3pk", .{});
+        defer file.close();
+        var w = try lite3.PackWriter.init(testing.allocator, file, .{ .key_hashes = true, .checksums = true });
+        defer w.deinit();
+        var mem: [256]u8 align(4) = undefined;
+        for (0..3) |i| {
+            var buf = try lite3.Buffer.initObj(&mem);
+            try buf.setI64(lite3.root, "seq", @intCast(i));
+            try w.appendKeyed(buf.data(), "k");
+        }
+        try w.finish();
+    }
+    {
+        var r = try lite3.PackReader.openAt(tmp.dir, "sums.l3pk");
+        defer r.close();
+        try r.verifyAll();
+        try testing.expectEqual(@as(?usize, 0), r.indexOfKey("k", 0));
+    }
+
+    // Flip a byte inside the second message.
+    const file = try tmp.dir.openFile("sums.l3pk", .{ .mode = .read_write });
+    defer file.close();
+    var r = try lite3.PackReader.fromFile(file);
+    defer r.close();
+    const pos = @intFromPtr((try r.bytes(1)).ptr) - @intFromPtr(r.mem.ptr) + 40;
+    var byte: [1]u8 = undefined;
+    _ = try file.preadAll(&byte, pos);
+    byte[0] ^= 0x55;
+    try file.pwriteAll(&byte, pos);
+    var r2 = try lite3.PackReader.fromFile(file);
+    defer r2.close();
+    try r2.verify(0);
+    try testing.expectError(lite3.Error.CorruptData, r2.verify(1));
+    try testing.expectError(lite3.Error.CorruptData, r2.verifyAll());
+}
+
+test "PackReader: rejects a pack without its footer" {
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+    try tmp.dir.writeFile(.{ .sub_path = "cut.l3pk", .data = &([_]u8{ 'L', '3', 'P', 'K', 1, 0, 0, 0 } ++ [_]u8{0} ** 120) });
+    try testing.expectError(lite3.Error.CorruptData, lite3.PackReader.openAt(tmp.dir, "cut.l3pk"));
+}
+
+fn testSocketPair() ![2]std.posix.fd_t {
+    var fds: [2]std.posix.fd_t = undefined;
+    if (std.c.socketpair(std.posix.AF.UNIX, std.posix.SOCK.STREAM, 0, &fds) != 0) return error.SocketPairFailed;
+    return fds;
+}
+
+test "FrameWriter/FrameReader: batched frames over a socketpair" {
+    const fds = try testSocketPair();
+    defer std.posix.close(fds[0]);
+
+    var msgs: [40][256]u8 align(4) = undefined;
+    var lens: [40]usize = undefined;
+    {
+        defer std.posix.close(fds[1]);
+        var w = lite3.FrameWriter.init(testing.allocator, fds[1]);
+        defer w.deinit();
+        for (&msgs, &lens, 0..) |*m, *l, i| {
+            var buf = try lite3.Buffer.initObj(@as(*align(4) [256]u8, @alignCast(m)));
+            try buf.setI64(lite3.root, "id", @intCast(i));
+            try buf.setStr(lite3.root, "tag", "xyz"[0 .. i % 4]);
+            l.* = buf.data().len;
+            try w.push(buf.data());
+        }
+        try w.flush();
+    }
+
+    // A small buffer forces the reader to compact between frames.
+    var r = try lite3.FrameReader.init(testing.allocator, fds[0], .{ .capacity = 300 });
+    defer r.deinit();
+    var i: usize = 0;
+    while (try r.next()) |frame| : (i += 1) {
+        try testing.expectEqual(@as(usize, 0), @intFromPtr(frame.payload.ptr) % 4);
+        try testing.expectEqualSlices(u8, msgs[i][0..lens[i]], frame.payload);
+        const v = try frame.view();
+        try testing.expectEqual(@as(i64, @intCast(i)), try v.getI64(lite3.root, "id"));
+    }
+    try testing.expectEqual(@as(usize, msgs.len), i);
+}
+
+test "FrameReader: stream ending inside a frame is corrupt" {
+    const fds = try testSocketPair();
+    defer std.posix.close(fds[0]);
+    const header = [_]u8{ 100, 0, 0, 0, 0, 0, 0, 0 };
+    _ = try std.posix.write(fds[1], &(header ++ [_]u8{0} ** 40));
+    std.posix.close(fds[1]);
+
+    var r = try lite3.FrameReader.init(testing.allocator, fds[0], .{});
+    defer r.deinit();
+    try testing.expectError(lite3.Error.CorruptData, r.next());
+}
+
+test "FrameReader: checksummed frames detect corruption" {
+    const fds = try testSocketPair();
+    defer std.posix.close(fds[0]);
+    {
+        defer std.posix.close(fds[1]);
+        var w = lite3.FrameWriter.initWithOptions(testing.allocator, fds[1], .{ .checksums = true });
+        defer w.deinit();
+        try w.push("hello");
+        try w.flush();
+        // Same frame with one payload bit flipped in transit.
+        var bad: [8 + 8 + 4]u8 = @splat(0);
+        std.mem.writeInt(u32, bad[0..4], 5, .little);
+        std.mem.writeInt(u32, bad[4..8], lite3.frame_format.flag_crc32c, .little);
+        @memcpy(bad[8..13], "hellp");
+        std.mem.writeInt(u32, bad[16..20], lite3.crc32c.checksum("hello"), .little);
+        _ = try std.posix.write(fds[1], &bad);
+    }
+
+    var r = try lite3.FrameReader.init(testing.allocator, fds[0], .{});
+    defer r.deinit();
+    const frame = (try r.next()).?;
+    try testing.expectEqualSlices(u8, "hello", frame.payload);
+    try testing.expectEqual(lite3.frame_format.flag_crc32c, frame.flags);
+    try testing.expectError(lite3.Error.CorruptData, r.next());
+}
+
+test "FrameWriter: flush resumes after a partial write" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+    var fds: [2]std.posix.fd_t = undefined;
+    if (std.c.socketpair(std.posix.AF.UNIX, std.posix.SOCK.STREAM | std.posix.SOCK.NONBLOCK, 0, &fds) != 0) return error.SocketPairFailed;
+    defer std.posix.close(fds[0]);
+    try std.posix.setsockopt(fds[1], std.posix.SOL.SOCKET, std.posix.SO.SNDBUF, &std.mem.toBytes(@as(c_int, 4096)));
+
+    const frames = 16;
+    const payload_len = 4096;
+    const payloads = try testing.allocator.alloc([payload_len]u8, frames);
+    defer testing.allocator.free(payloads);
+    var got: std.ArrayListUnmanaged(u8) = .empty;
+    defer got.deinit(testing.allocator);
+    var chunk: [8192]u8 = undefined;
+    {
+        defer std.posix.close(fds[1]);
+        var w = lite3.FrameWriter.init(testing.allocator, fds[1]);
+        defer w.deinit();
+        for (payloads, 0..) |*p, i| {
+            @memset(p, @intCast(i));
+            try w.push(p);
+        }
+        var retries: usize = 0;
+        while (true) : (retries += 1) {
+            w.flush() catch |err| switch (err) {
+                error.WouldBlock => {
+                    const n = try std.posix.read(fds[0], &chunk);
+                    try got.appendSlice(testing.allocator, chunk[0..n]);
+                    continue;
+                },
+                else => return err,
+            };
+            break;
+        }
+        try testing.expect(retries > 0);
+    }
+    while (true) {
+        const n = std.posix.read(fds[0], &chunk) catch |err| switch (err) {
+            error.WouldBlock => continue,
+            else => return err,
+        };
+        if (n == 0) break;
+        try got.appendSlice(testing.allocator, chunk[0..n]);
+    }
+
+    // Every frame exactly once, in order.
+    const frame_len = lite3.frame_format.header_size + payload_len;
+    try testing.expectEqual(@as(usize, frames * frame_len), got.items.len);
+    for (0..frames) |i| {
+        const f = got.items[i * frame_len ..][0..frame_len];
+        try testing.expectEqual(@as(u32, payload_len), std.mem.readInt(u32, f[0..4], .little));
+        try testing.expect(std.mem.allEqual(u8, f[lite3.frame_format.header_size..], @intCast(i)));
+    }
+}
+
+test "FrameWriter/FrameReader: compressed frames" {
+    const fds = try testSocketPair();
+    defer std.posix.close(fds[0]);
+
+    var mem: [16384]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initArr(&mem);
+    for (0..100) |i| try buf.arrAppendI64(lite3.root, @intCast(i));
+    {
+        defer std.posix.close(fds[1]);
+        var w = lite3.FrameWriter.initWithOptions(testing.allocator, fds[1], .{ .checksums = true, .compress_min = 256 });
+        defer w.deinit();
+        try w.push(buf.data());
+        try w.push("short");
+        try w.push(buf.data());
+        try w.flush();
+    }
+
+    var r = try lite3.FrameReader.init(testing.allocator, fds[0], .{});
+    defer r.deinit();
+    for (0..3) |i| {
+        const frame = (try r.next()).?;
+        if (i == 1) {
+            try testing.expectEqualSlices(u8, "short", frame.payload);
+            try testing.expectEqual(@as(u32, 0), frame.flags & lite3.frame_format.flag_lz);
+        } else {
+            try testing.expect(frame.flags & lite3.frame_format.flag_lz != 0);
+            try testing.expectEqualSlices(u8, buf.data(), frame.payload);
+            try testing.expectEqual(@as(i64, 99), try (try frame.view()).arrGetI64(lite3.root, 99));
+        }
+    }
+    try testing.expect((try r.next()) == null);
+}
+
+test "SharedPublisher/SharedSubscriber: in-place reads across mappings" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+    var pub_region = try lite3.SharedRegion.create("lite3-test", 4, 256);
+    defer pub_region.close();
+    // A second mapping of the same memfd stands in for another process.
+    var sub_region = try lite3.SharedRegion.fromFd(try std.posix.dup(pub_region.fd));
+    defer sub_region.close();
+
+    const publisher: lite3.SharedPublisher = .{ .region = &pub_region };
+    var sub: lite3.SharedSubscriber = .{ .region = &sub_region };
+    try testing.expect((try sub.poll()) == null);
+
+    var pending = try publisher.reserve();
+    try pending.buf.setStr(lite3.root, "event", "built-in-place");
+    try testing.expectEqual(@as(u64, 0), publisher.commit(&pending));
+    var mem: [256]u8 align(4) = undefined;
+    var buf = try lite3.Buffer.initObj(&mem);
+    try buf.setI64(lite3.root, "n", 1);
+    try testing.expectEqual(@as(u64, 1), try publisher.publish(buf.data()));
+
+    const first = (try sub.poll()).?;
+    try testing.expectEqualStrings("built-in-place", try first.view.getStr(lite3.root, "event"));
+    try sub.check(first);
+    const second = (try sub.poll()).?;
+    try testing.expectEqual(@as(i64, 1), try second.view.getI64(lite3.root, "n"));
+
+    // Lapping the ring reuses slot 0; the held message is now stale.
+    for (0..4) |_| _ = try publisher.publish(buf.data());
+    try testing.expectError(lite3.Error.StaleReference, sub.check(first));
+    try testing.expectError(lite3.Error.StaleReference, sub.get(0));
+    try testing.expectError(lite3.Error.NotFound, sub.get(6));
+    try testing.expectEqual(@as(u64, 5), (try sub.latest()).?.seq);
+}
+
+test "SharedSubscriber: reads race a publisher reusing the slot" {
+    if (builtin.os.tag != .linux) return error.SkipZigTest;
+    var region = try lite3.SharedRegion.create("lite3-race", 1, 256);
+    defer region.close();
+
+    // Same key, same value offset: a torn read can pair the string's type
+    // byte with the i64's payload, i.e. a 0xffffffff length.
+    var mem_a: [256]u8 align(4) = undefined;
+    var a = try lite3.Buffer.initObj(&mem_a);
+    try a.setStr(lite3.root, "v", "short");
+    var mem_b: [256]u8 align(4) = undefined;
+    var b = try lite3.Buffer.initObj(&mem_b);
+    try b.setI64(lite3.root, "v", -1);
+
+    const Publisher = struct {
+        fn run(r: *lite3.SharedRegion, msgs: [2][]const u8, done: *std.atomic.Value(bool)) void {
+            const publisher: lite3.SharedPublisher = .{ .region = r };
+            for (0..50_000) |i| _ = publisher.publish(msgs[i % 2]) catch unreachable;
+            done.store(true, .release);
+        }
+    };
+    var done = std.atomic.Value(bool).init(false);
+    const t = try std.Thread.spawn(.{}, Publisher.run, .{ &region, [2][]const u8{ a.data(), b.data() }, &done });
+    defer t.join();
+
+    const sub: lite3.SharedSubscriber = .{ .region = &region };
+    var copy: [256]u8 = undefined;
+    while (!done.load(.acquire)) {
+        const msg = (sub.latest() catch continue) orelse continue;
+        _ = msg.view.getType(lite3.root, "v") catch {};
+        const value = msg.view.getValue(lite3.root, "v") catch continue;
+        const n = switch (value) {
+            .string => |str| blk: {
+                @memcpy(copy[0..str.len], str);
+                break :blk str.len;
+            },
+            else => 0,
+        };
+        // Only reads that `check` confirms are required to be consistent.
+        sub.check(msg) catch continue;
+        switch (value) {
+            .string => try testing.expectEqualStrings("short", copy[0..n]),
+            .i64_ => |x| try testing.expectEqual(@as(i64, -1), x),
+            else => return error.TestUnexpectedResult,
+        }
+    }
+}
+
+test "MessageRing: producers build in place, consumer reads in order" {
+    const mem = try testing.allocator.alignedAlloc(u8, .@"64", 16 * 1024);
+    defer testing.allocator.free(mem);
+    const ring = try lite3.MessageRing.init(mem);
+
+    const producers = 3;
+    const per_producer = 2000;
+    const Producer = struct {
+        fn run(r: *const lite3.MessageRing, id: i64) void {
+            var i: i64 = 0;
+            while (i < per_producer) {
+                var res = (r.reserve(160) catch unreachable) orelse {
+                    std.Thread.yield() catch {};
+                    continue;
+                };
+                res.buf.setI64(lite3.root, "producer", id) catch unreachable;
+                res.buf.setI64(lite3.root, "i", i) catch unreachable;
+                r.commit(&res);
+                i += 1;
+            }
+        }
+    };
+    var threads: [producers]std.Thread = undefined;
+    for (&threads, 0..) |*t, id| t.* = try std.Thread.spawn(.{}, Producer.run, .{ &ring, @as(i64, @intCast(id)) });
+    defer for (threads) |t| t.join();
+
+    var next = [_]i64{0} ** producers;
+    var received: usize = 0;
+    while (received < producers * per_producer) {
+        const msg = ring.peek() orelse {
+            std.Thread.yield() catch {};
+            continue;
+        };
+        const v = try msg.view();
+        const id: usize = @intCast(try v.getI64(lite3.root, "producer"));
+        try testing.expectEqual(next[id], try v.getI64(lite3.root, "i"));
+        next[id] += 1;
+        ring.release(msg);
+        received += 1;
+    }
+    try testing.expect(ring.peek() == null);
+
+    // Another view of the same memory, as a second process would use it.
+    const other = try lite3.MessageRing.attach(mem);
+    var scratch: [128]u8 align(4) = undefined;
+    const small = try lite3.Buffer.initObj(&scratch);
+    try testing.expect(try ring.push(small.data()));
+    try testing.expectEqualSlices(u8, small.data(), other.peek().?.bytes);
+}
+
+test "MessageRing: minimum size applies to the rounded data area" {
+    const h = lite3.MessageRing.header_size;
+    var mem: [h + 256]u8 align(64) = undefined;
+    // 250 bytes round down to a 128-byte area, too small for two records.
+    try testing.expectError(lite3.Error.InvalidArgument, lite3.MessageRing.init(mem[0 .. h + 250]));
+    const ring = try lite3.MessageRing.init(&mem);
+    try testing.expectEqual(@as(u64, 256), ring.cap);
+}
+
+test "DeltaTracker: replica catches up from a small delta" {
+    var src = try lite3.ManagedContext.init(testing.allocator);
+    defer src.deinit();
+    var key: [16]u8 = undefined;
+    for (0..400) |i| try src.setStr(lite3.root, try std.fmt.bufPrint(&key, "setting{d}", .{i}), "default value");
+    const log = try src.setArr(lite3.root, "log");
+    for (0..50) |i| try src.arrAppendI64(log, @intCast(i));
+
+    var replica = try lite3.ManagedContext.initFromBuf(testing.allocator, src.data());
+    defer replica.deinit();
+
+    var tracker = lite3.DeltaTracker.init(testing.allocator);
+    defer tracker.deinit();
+    tracker.checkpoint(&src);
+    src.setDeltaTracker(&tracker);
+
+    try src.setI64(lite3.root, "setting7", 7); // in place
+    try src.setStr(lite3.root, "setting8", "a value longer than the default one"); // appended
+    try src.setBool(lite3.root, "brand-new", true);
+    try src.arrAppendI64(log, 50);
+    var cur = lite3.Cursor.init(lite3.root);
+    try cur.setI64(&src, "setting9", 9); // raw in-place write
+
+    const delta = try tracker.exportDelta(testing.allocator, &src);
+    defer testing.allocator.free(delta);
+    try testing.expect(delta.len * 10 < src.data().len);
+
+    // A damaged patch leaves the base CRC intact but not the result CRC.
+    const damaged = try testing.allocator.dupe(u8, delta);
+    defer testing.allocator.free(damaged);
+    damaged[damaged.len - 1] ^= 0xff;
+    const replica_before = try testing.allocator.dupe(u8, replica.data());
+    defer testing.allocator.free(replica_before);
+    try testing.expectError(lite3.Error.CorruptData, lite3.applyDelta(&replica, damaged));
+    try testing.expectEqualSlices(u8, replica_before, replica.data());
+
+    // Same length as the base, different bytes: rejected before any write.
+    var diverged = try lite3.ManagedContext.initFromBuf(testing.allocator, replica.data());
+    defer diverged.deinit();
+    try diverged.setI64(lite3.root, "setting9", 9); // in place
+    try testing.expectEqual(replica.data().len, diverged.data().len);
+    const before = try testing.allocator.dupe(u8, diverged.data());
+    defer testing.allocator.free(before);
+    try testing.expectError(lite3.Error.StaleReference, lite3.applyDelta(&diverged, delta));
+    try testing.expectEqualSlices(u8, before, diverged.data());
+
+    try lite3.applyDelta(&replica, delta);
+    try testing.expectEqualSlices(u8, src.data(), replica.data());
+    try testing.expectEqual(@as(i64, 7), try replica.getI64(lite3.root, "setting7"));
+    try testing.expectEqual(@as(i64, 9), try replica.getI64(lite3.root, "setting9"));
+    // The replica has moved past the delta's base.
+    try testing.expectError(lite3.Error.StaleReference, lite3.applyDelta(&replica, delta));
+}
+
+test "OpLog: recorded ops replay onto another document" {
+    var src = try lite3.ManagedContext.init(testing.allocator);
+    defer src.deinit();
+    // Created before the log is attached: resolved by indexing.
+    const cfg = try src.setObj(lite3.root, "config");
+
+    var replica = try lite3.ManagedContext.initFromBuf(testing.allocator, src.data());
+    defer replica.deinit();
+
+    var log = try lite3.OpLog.init(testing.allocator);
+    defer log.deinit();
+    src.setOpLog(&log);
+
+    try src.setStr(cfg, "region", "eu-west");
+    const limits = try src.setArr(cfg, "limits");
+    try src.arrAppendI64(limits, 10);
+    const rule = try src.arrAppendObj(limits);
+    try src.setBool(rule, "strict", true);
+    try src.setF64(lite3.root, "ratio", 0.25);
+    try src.setNull(lite3.root, "removed");
+    try testing.expectEqual(@as(u32, 7), try log.count());
+
+    src.setOpLog(null);
+    try src.setI64(lite3.root, "unlogged", 1);
+    try testing.expectEqual(@as(u32, 7), try log.count());
+
+    try lite3.replay(log.data(), &replica);
+    const r_cfg = try replica.getObj(lite3.root, "config");
+    try testing.expectEqualStrings("eu-west", try replica.getStr(r_cfg, "region"));
+    const r_limits = try replica.getArr(r_cfg, "limits");
+    try testing.expectEqual(@as(i64, 10), try replica.arrGetI64(r_limits, 0));
+    try testing.expect(try replica.getBool(try replica.arrGetObj(r_limits, 1), "strict"));
+    try testing.expectEqual(@as(f64, 0.25), try replica.getF64(lite3.root, "ratio"));
+    try testing.expectEqual(lite3.Type.null, try replica.getType(lite3.root, "removed"));
+    try testing.expectError(lite3.Error.NotFound, replica.getI64(lite3.root, "unlogged"));
+
+    // The log itself is a Lite3 document with layout-independent paths.
+    const v = try lite3.ConstView.init(log.data());
+    const op = try v.arrGetObj(lite3.root, 4);
+    const path = try v.getArr(op, "p");
+    try testing.expectEqualStrings("config", try v.arrGetStr(path, 0));
+    try testing.expectEqualStrings("limits", try v.arrGetStr(path, 1));
+    try testing.expectEqual(@as(i64, 1), try v.arrGetI64(path, 2));
+}
+
+test "OpLog: writes through a replaced container are not recorded" {
+    var src = try lite3.ManagedContext.init(testing.allocator);
+    defer src.deinit();
+    var replica = try lite3.ManagedContext.initFromBuf(testing.allocator, src.data());
+    defer replica.deinit();
+    var log = try lite3.OpLog.init(testing.allocator);
+    defer log.deinit();
+    src.setOpLog(&log);
+
+    const old = try src.setObj(lite3.root, "cfg");
+    const old_rules = try src.setArr(old, "rules");
+    _ = try src.setObj(lite3.root, "cfg"); // orphans `old` and its subtree
+    try testing.expectError(lite3.Error.StaleReference, src.setI64(old, "a", 1));
+    try testing.expectError(lite3.Error.StaleReference, src.arrAppendI64(old_rules, 2));
+    try testing.expectEqual(@as(u32, 3), try log.count());
+
+    try lite3.replay(log.data(), &replica);
+    const r_cfg = try replica.getObj(lite3.root, "cfg");
+    try testing.expectEqual(@as(u32, 0), try replica.count(r_cfg));
+}